@@ -20,35 +20,205 @@ make some optimizations on the split phase to get a better performance and merge
 #include <pthread.h>
 #include <malloc.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#else
+#include <windows.h>
+#define strtok_r strtok_s
+#endif
+#include "XML_parallel.h"
+#if defined(__GNUC__)&&(defined(__x86_64__)||defined(__i386__))
+#define XML_SCAN_X86
+#include <immintrin.h>
+#elif defined(__GNUC__)&&defined(__aarch64__)&&defined(__ARM_NEON)
+#define XML_SCAN_NEON
+#include <arm_neon.h>
+#endif
 
-/*data structure for each thread*/
-#define MAX_THREAD 10
-pthread_t thread[MAX_THREAD]; 
-int thread_args[MAX_THREAD];
-int finish_args[MAX_THREAD];
+/*data structure for the worker pool, the file is cut into many more chunks than workers and an idle worker steals the chunks of the busy ones*/
+#define CHUNKS_PER_WORKER 8   //the number of chunks cut for each worker
+#define MIN_CHUNK (16*1024)   //no chunk is cut smaller than this
+#define CANCEL_CHECK (4*1024)   //xml_process looks whether its run is cancelled once every this many bytes
+#define DEFAULT_WINDOW (1024*1024)   //the window of the streaming version when the caller gives no size
+#define SIDECAR_CUT (4*1024)   //the sidecar index keeps a cut at the first markup after every this many bytes
+typedef void (*TaskFunc)(int arg);
+
+typedef struct TaskGroup{
+	long unfinished;   //the tasks of one pool_run not finished yet, guarded by the lock of the pool
+}TaskGroup;
+
+typedef struct Task{
+	TaskFunc func;
+	int begin;   //the task calls func(i) for every i in [begin,end)
+	int end;
+	struct RunContext* run;   //the run which the task belongs to, the worker sets ctx to it
+	TaskGroup* group;
+}Task;
+
+typedef struct TaskDeque{
+	pthread_mutex_t lock;
+	Task* tasks;
+	long top;   //the oldest task, the owner takes from here and so do the other workers
+	long bottom;   //one after the newest task, the tasks are submitted here
+	long cap;
+}TaskDeque;
+
+typedef struct WorkerPool{
+	int workers;
+	pthread_t* threads;
+	int* ids;
+	TaskDeque* deques;   //one deque for each worker
+	pthread_mutex_t lock;   //guards the counters below
+	pthread_cond_t work;   //signalled when a task is submitted or the pool stops
+	pthread_cond_t done;   //signalled when the last unfinished task of a group finishes
+	long queued;   //the tasks waiting in the deques
+	int stop;
+	int next;   //the deque for the next task submitted
+}WorkerPool;
+
+WorkerPool pool;
+int workerCount=0;   //the number of workers, the number of CPUs by default
+int xmlVerbose=0;   //1--the progress of the chunks is printed, it is set by the program only, the library prints nothing
 
 /*data structure for automata*/
+#define MAX_SIZE 50
+#define MAX_QUERY 64   //the XPaths compiled into one automata, one bit of QueryMask for each query
+
+/*a state of the automata is a set of steps(see build_dfa), and the sets grow fast with the XPaths holding //, so the masks take 128 bits where the compiler has them*/
+#if defined(__SIZEOF_INT128__)
+#define MAX_STATE 128   //the states of the automata and the steps, one bit of ChildMask for each
+typedef unsigned __int128 ChildMask;   //one bit for each state, all the states(less than MAX_STATE) fit in it
+#else
+#define MAX_STATE 64
+typedef unsigned long long ChildMask;
+#endif
+typedef unsigned long long QueryMask;   //one bit for each XPath of a query
 typedef struct{
 	int start;
 	char * str;
 	int end;
 	int isoutput; 
+	QueryMask queries;   //the XPaths whose last step is this state, set for both entries of the state as isoutput is
+	int descendant;   //1--the step follows //, it is taken at any depth below its parent
 }Automata;
 
-#define MAX_SIZE 50
-Automata stateMachine[MAX_SIZE];   //save automata for XPath
+/*data structure for the predicates on the attributes of the steps, e.g. programmer[@age="35"], programmer[@age] or programmer[not(@age)]*/
+#define MAX_PRED 64   //the predicates of all the steps, one bit of PredMask for each predicate
+typedef unsigned long long PredMask;
+typedef struct Predicate{
+	char* name;   //the name of the attribute
+	long nameLen;
+	char* value;   //the value the attribute must have, NULL--the attribute only has to be there
+	long valueLen;
+	int negated;   //1--the predicate is in not(), it holds if the test on the attribute fails
+}Predicate;
+
+/*data structure for the aggregate functions around the XPaths, e.g. count(/company/develop/programmer) or sum(//salary). 
+The texts taken by such an XPath are folded into an Aggregate for each part and never kept, and the aggregates of the parts are added up while merging*/
+enum{ AGG_NONE=0, AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX };
+char* aggregateNames[]={"","count","sum","min","max"};
+typedef struct Aggregate{
+	long count;   //the texts taken
+	long numbers;   //the texts which are numbers, only they are taken by sum, min and max
+	double sum;
+	double min;
+	double max;
+}Aggregate;
+
+/*data structure for interned tag names*/
+#define MAX_TAG 64   //the tag names of a query, tagTable is kept much larger
+#define MAX_SYMBOL (2*MAX_TAG)   //the symbols run by the automata, a tag name takes one for each way the predicates of its steps turn out(see tag_symbol)
+typedef struct TagSymbol{
+	char* name;   //the tag name without the slash
+	long len;
+	int symbol;   //the first symbol of the name
+	ChildMask predSteps;   //the steps with predicates which could take the name
+	PredMask preds;   //the predicates of those steps, the attributes of the tag are looked at only for them
+	ChildMask passSteps;   //the steps of the XPaths which do not hold the name, they stay as they are below it as if the tag were not there
+}TagSymbol;
+
+#define TAG_TABLE 128   //a power of 2, much larger than MAX_TAG so that a perfect hash is found quickly
+
+/*data structure for the deterministic automata run by the stack trees, a state is a set of steps(see build_dfa). The states are built as the tags reach them: 
+xml_compile builds the ones nearest to state 1, and each run goes on from a copy of those and builds the ones its input reaches(see tag_move)*/
+#define MASK_WORDS ((MAX_STATE+63)/64)
+#define COMPILED_STATES (MAX_STATE/2)   //the states built by xml_compile at most, the others are left to the runs
+typedef unsigned long long TagMask;   //one bit for each tag id
+typedef struct Dfa{
+	int stateCount;   //the states built so far, it grows while the parts are dealt with, so it is set and read by __atomic builtins
+	int complete;   //1--every state reached by a symbol is built, no state is added while running
+	int full;   //1--a state was not built as there are MAX_STATE-1 states already, the run fails
+	int stackMapping;   //1--a tag enters a state from several states, so the mapping of a part depends on the stack below its start state
+	ChildMask stateSteps[MAX_STATE];   //the steps whose element is the current one in each state
+	ChildMask stateCarry[MAX_STATE];   //the steps whose descendants are still looked for in each state
+	int nextState[MAX_STATE][MAX_SYMBOL];   //the state entered by each symbol from each state, 0--the symbol is not taken there, -1--not built yet
+	TagMask stateTags[MAX_STATE];   //the tags found to enter each state
+	QueryMask stateQueries[MAX_STATE];   //the XPaths whose last step is in each state
+	unsigned long long acceptWords[MASK_WORDS];   //the states which hold the last step of an XPath(see mask_words)
+	unsigned long long spanWords[MASK_WORDS];   //the states which hold the last step of an XPath without an aggregate function, only their texts are kept
+}Dfa;
+
+/*data structure for a compiled query, it is built once by xml_compile and only read while running, so any number of runs could share it*/
+typedef struct Query{
+	Automata stateMachine[2*MAX_STATE];   //save the steps of the XPaths, step s(s>=2) takes the entry 2s-3 for <name> and 2s-2 for </name>
+	int stepCount;   //the number of steps, step 1 is outside the root element
+	ChildMask rootSteps;   //the steps outside the root element, one for each class of XPaths, step 1 for the first one
+	ChildMask classSteps[MAX_QUERY];   //the steps of each class, the XPaths of a class hold the same tag names and only they share steps
+	int classCount;
+	int machineCount; //the number of nodes for automata
+	int queryCount;   //the number of XPaths sharing the automata
+	int aggregates[MAX_QUERY];   //the aggregate function around each XPath, AGG_NONE--its texts are given
+	QueryMask aggregateMask;   //the XPaths with an aggregate function
+	ChildMask descendParents;   //the steps followed by a step after //
+	int stepTags[MAX_STATE];   //the tag id of each step, -1--the step is *, -2--a root step
+	char* stepFilters[MAX_STATE];   //the predicates of each step as they are written, NULL--no predicate
+	PredMask stepPreds[MAX_STATE];   //the predicates of each step, all of them must hold
+	Predicate preds[MAX_PRED];
+	int predCount;
+	PredMask negatedPreds;   //the predicates in not(), their bits are turned over once the attributes of a tag are compared(see tag_symbol)
+	int wildcard;   //1--a step is *, so the tag names not in the XPaths are not skipped but taken as otherTag
+	int otherTag;
+	int symbolCount;
+	int symbolTags[MAX_SYMBOL];   //the tag id of each symbol
+	Dfa dfa;   //the states built by xml_compile, every run starts from a copy of them
+	TagSymbol tagSymbols[MAX_TAG];   //the tag id is the index in this array
+	int tagCount;
+	int tagTable[TAG_TABLE];   //tag id+1 for each hash value, 0--empty
+	unsigned int tagSeed;   //the seed which makes the hash perfect for the tag names in the XPath
+	unsigned long long fingerprint;   //the hash of the XPaths as they are written, the state saved by a run is taken only by the same query
+}Query;
+
+/*data structure for outputs, a text is kept as a span of the input and only copied when the result is printed*/
+typedef struct Span{
+	long offset;   //the offset of the text from spanBase of the slot
+	long len;
+	int state;   //the state the text is found in, it tells which XPaths take the text
+	struct Span* next;
+}Span;
+
+typedef struct SpanList{
+	Span* head;
+	Span* tail;
+}SpanList;
 
-int stateCount=0; //the number of states for XPath
-int machineCount=1; //the number of nodes for automata
+typedef struct TextSpan{
+	char* p;   //the text in the input
+	long len;
+	int state;   //the state the text is found in(see Span)
+}TextSpan;
 
-/*data structure for each tree*/
-#define MAX_OUTPUT 20000
+/*data structure for each tree, a node keeps only the children which exist, in the order of their states(see ChildMask)*/
 typedef struct Node{
     int state;
-    struct Node ** children;
+    ChildMask childMask;   //bit i is set if the node has a child for state i
+    struct Node ** children;   //children[k] is the child for the k-th bit set in childMask
+    int childCap;   //the number of children the array could hold
     struct Node * start_node;
     struct Node * finish_node;
-    char * output;
+    SpanList output;
     int hasOutput;
     struct Node * parent;
     int isLeaf;
@@ -59,17 +229,37 @@ typedef struct QueueEle{
 	int layer;
 }QueueEle;
 
-Node* start_root[MAX_THREAD];   //start tree for each thread
-Node* finish_root[MAX_THREAD];   //finish tree for each thread
+/*data structure for the arena of each slot, the nodes and children arrays of a stack tree are carved out of its blocks*/
+#define ARENA_BLOCK (64*1024)
+typedef struct ArenaBlock{
+	struct ArenaBlock* next;
+	long used;
+	long size;
+	long pad;   //keep data aligned to 16 bytes
+	char data[];
+}ArenaBlock;
 
-/*data structure for files in each thread*/
-char * buffFiles[MAX_THREAD]; 
+typedef struct Arena{
+	ArenaBlock* head;   //the blocks in use, the first one is being carved
+	ArenaBlock* spare;   //the blocks kept by arena_reset for the next stack tree
+}Arena;
+
+/*data structure for speculative lexing, each thread keeps one stack tree(a slot) for every lexer state assumed at the beginning of its part*/
+#define MAX_SPEC 5
+int specStates[MAX_SPEC]={7,5,15,10,17};   //text, inside a tag, inside a quoted value, inside a comment, inside a CDATA
+
+typedef struct SpecRun{
+	long resync;   //the offset in the file where the lexer reaches its first token boundary; -1--this assumption fails in the part
+	long overrun;   //the offset in the file where the last token of the part ends
+	int slot;   //the stack tree for this assumption, assumptions reaching the same boundary share one tree
+	int ret;   //the return value of xml_process
+}SpecRun;
 
 /*data structure for elements in XML file*/
 typedef struct
 {
     char *p;
-    int len;
+    long len;
 }
 xml_Text;
 
@@ -95,13 +285,61 @@ typedef struct
 xml_Token;
 
 #define MAX_LINE 100
-static char multiExpContent[MAX_THREAD][MAX_LINE];  //save for multi-line explanations
-static char multiCDATAContent[MAX_THREAD][MAX_LINE]; //save for multi-line CDATA
+
+/*data structure for the table-driven lexer, the tables are built at compile time and are small enough to stay in L1*/
+enum{ XC_OTHER=0, XC_LT, XC_GT, XC_SLASH, XC_QMARK, XC_BANG, XC_DASH, XC_LBRACK, XC_RBRACK, XC_QUOTE, XC_EQ, XC_SPACE, XML_CLASSES };   //character classes
+enum{ XA_NONE=0, XA_SKIP, XA_TOKEN, XA_END_TAG, XA_START_TAG, XA_START_ATTR, XA_TEXT, XA_CDATA_OPEN, XA_COMMENT, XA_CDATA };   //actions of the transitions
+
+#define XML_STATES 20
+typedef struct LexTrans{
+	signed char next;   //the next state, -1--error
+	unsigned char action;
+}LexTrans;
+
+static const unsigned char xmlCharClass[256]={
+	['<']=XC_LT, ['>']=XC_GT, ['/']=XC_SLASH, ['?']=XC_QMARK, ['!']=XC_BANG, ['-']=XC_DASH,
+	['[']=XC_LBRACK, [']']=XC_RBRACK, ['"']=XC_QUOTE, ['=']=XC_EQ, [' ']=XC_SPACE
+};
+
+#define T(next,action) {next,action}
+#define E T(-1,XA_NONE)
+static const LexTrans xmlLexTable[XML_STATES][XML_CLASSES]={
+	/*        OTHER           <                 >                  /                 ?                 !                 -                 [                      ]                 "                    =                     ' '                 */
+	/*0 */ {T(7,XA_SKIP),  T(1,XA_NONE),     T(7,XA_SKIP),      T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),          T(7,XA_SKIP),     T(7,XA_SKIP),        T(7,XA_SKIP),         T(0,XA_NONE)},
+	/*1 */ {T(5,XA_NONE),  T(5,XA_NONE),     T(5,XA_NONE),      T(4,XA_NONE),     T(2,XA_NONE),     T(8,XA_NONE),     T(5,XA_NONE),     T(5,XA_NONE),          T(5,XA_NONE),     T(5,XA_NONE),        T(5,XA_NONE),         E},
+	/*2 */ {T(2,XA_NONE),  T(2,XA_NONE),     T(2,XA_NONE),      T(2,XA_NONE),     T(3,XA_NONE),     T(2,XA_NONE),     T(2,XA_NONE),     T(2,XA_NONE),          T(2,XA_NONE),     T(2,XA_NONE),        T(2,XA_NONE),         T(2,XA_NONE)},
+	/*3 */ {E,             E,                T(0,XA_TOKEN),     E,                E,                E,                E,                E,                     E,                E,                   E,                    E},
+	/*4 */ {T(4,XA_NONE),  T(4,XA_NONE),     T(0,XA_END_TAG),   T(4,XA_NONE),     T(4,XA_NONE),     T(4,XA_NONE),     T(4,XA_NONE),     T(4,XA_NONE),          T(4,XA_NONE),     T(4,XA_NONE),        T(4,XA_NONE),         E},
+	/*5 */ {T(5,XA_NONE),  T(5,XA_NONE),     T(0,XA_START_TAG), T(6,XA_NONE),     T(5,XA_NONE),     T(5,XA_NONE),     T(5,XA_NONE),     T(5,XA_NONE),          T(5,XA_NONE),     T(5,XA_NONE),        T(5,XA_NONE),         T(13,XA_START_ATTR)},
+	/*6 */ {E,             E,                T(0,XA_TOKEN),     E,                E,                E,                E,                E,                     E,                E,                   E,                    E},
+	/*7 */ {T(7,XA_SKIP),  T(0,XA_TEXT),     T(7,XA_SKIP),      T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),     T(7,XA_SKIP),          T(7,XA_SKIP),     T(7,XA_SKIP),        T(7,XA_SKIP),         T(7,XA_SKIP)},
+	/*8 */ {E,             E,                E,                 E,                E,                E,                T(9,XA_NONE),     T(16,XA_CDATA_OPEN),   E,                E,                   E,                    E},
+	/*9 */ {E,             E,                E,                 E,                E,                E,                T(10,XA_NONE),    E,                     E,                E,                   E,                    E},
+	/*10*/ {T(10,XA_SKIP), T(10,XA_SKIP),    T(10,XA_SKIP),     T(10,XA_SKIP),    T(10,XA_SKIP),    T(10,XA_SKIP),    T(11,XA_NONE),    T(10,XA_SKIP),         T(10,XA_SKIP),    T(10,XA_SKIP),       T(10,XA_SKIP),        T(10,XA_SKIP)},
+	/*11*/ {E,             E,                E,                 E,                E,                E,                T(12,XA_NONE),    E,                     E,                E,                   E,                    E},
+	/*12*/ {E,             E,                T(0,XA_COMMENT),   E,                E,                E,                E,                E,                     E,                E,                   E,                    E},
+	/*13*/ {T(13,XA_NONE), T(13,XA_NONE),    E,                 T(13,XA_NONE),    T(13,XA_NONE),    T(13,XA_NONE),    T(13,XA_NONE),    T(13,XA_NONE),         T(13,XA_NONE),    T(13,XA_NONE),       T(14,XA_TOKEN),       T(13,XA_NONE)},
+	/*14*/ {E,             E,                E,                 E,                E,                E,                E,                E,                     E,                T(15,XA_NONE),       E,                    T(14,XA_NONE)},
+	/*15*/ {T(15,XA_SKIP), T(15,XA_SKIP),    T(15,XA_SKIP),     T(15,XA_SKIP),    T(15,XA_SKIP),    T(15,XA_SKIP),    T(15,XA_SKIP),    T(15,XA_SKIP),         T(15,XA_SKIP),    T(5,XA_TOKEN),       T(15,XA_SKIP),        T(15,XA_SKIP)},
+	/*16*/ {E,             E,                E,                 E,                E,                E,                E,                T(17,XA_NONE),         E,                E,                   E,                    E},
+	/*17*/ {T(17,XA_SKIP), T(17,XA_SKIP),    T(17,XA_SKIP),     T(17,XA_SKIP),    T(17,XA_SKIP),    T(17,XA_SKIP),    T(17,XA_SKIP),    T(17,XA_SKIP),         T(18,XA_NONE),    T(17,XA_SKIP),       T(17,XA_SKIP),        T(17,XA_SKIP)},
+	/*18*/ {E,             E,                E,                 E,                E,                E,                E,                E,                     T(19,XA_NONE),    E,                   E,                    E},
+	/*19*/ {E,             E,                T(0,XA_CDATA),     E,                E,                E,                E,                E,                     E,                E,                   E,                    E}
+};
+#undef E
+#undef T
+
+static const char xmlSkipTo[XML_STATES]={ [7]='<', [10]='-', [15]='"', [17]=']' };   //the only structural character of a skipping state
 
 #define MAX_ATT_NUM 50
 char tokenValue[MAX_ATT_NUM][MAX_ATT_NUM]={"UNKNOWN","HEAD","NODE_END","NODE_BEGIN","NODE_BEGIN_END","TEXT","COMMENT","ATTRIBUTE_NAME","ATTRIBUTE_VALUE","CDATA"};
 char defaultToken[MAX_ATT_NUM]="WRONG_INFO";
 
+/*data structure for the structural-character scanner*/
+typedef char* (*ScanFunc)(char* p, char* end, char c);
+ScanFunc xml_scan;   //find the first byte c in [p,end) or return end, chosen by init_scanner
+pthread_once_t scannerOnce=PTHREAD_ONCE_INIT;   //init_scanner is called once, by xml_init or by the first run
+
 /*data structure for mapping result*/
 typedef struct ResultSet
 {
@@ -111,120 +349,599 @@ typedef struct ResultSet
 	int end;
 	int end_stack[MAX_SIZE];
 	int topend;
-	char* output;
+	char* output;   //the text copied by flush_result, NULL--no text has been copied
 	int hasOutput;
+	long outputLen;
+	long outputCap;
+	long* outputEnds;   //the end of each text copied into output
+	int* outputStates;   //the state of each text copied into output
+	long outputTexts;
+	long outputTextCap;
+	TextSpan* spans;   //the outputs not copied yet, they are joined with blanks
+	long spanCount;
+	long spanCap;
+	int guessed;   //1--a state below the start state was guessed, as the stack of the former parts was unknown(see map_stacks)
+	Aggregate* aggs;   //one for each XPath of the query, NULL--no text has been taken by an aggregate function
 }ResultSet;
 
+/*data structure for the state saved after a run over a file which only grows, the next run deals with the bytes after offset only(see xml_run_append). 
+The state file is the head, the states of the automata, the texts and the aggregates, one after the other*/
+#define APPEND_MAGIC "XMLAPP3"
+#define APPEND_TAIL 4096   //the bytes before offset whose hash is saved, they must be the same for the file to be taken as only grown
+typedef struct AppendHead{
+	char magic[8];
+	unsigned long long query;   //the fingerprint of the query(see xml_compile)
+	long offset;   //the bytes of the file dealt with, the next run starts there
+	unsigned long long tail;   //the hash of the APPEND_TAIL bytes before offset
+	int lexState;   //the lexer state at offset, which may be inside a comment or CDATA(see lexState)
+	int begin;
+	int begin_stack[MAX_SIZE];
+	int topbegin;
+	int end;
+	int end_stack[MAX_SIZE];
+	int topend;
+	int stateCount;   //the states built by the run, each is a SavedState, the stacks and the texts are in them
+	long spanCount;   //the number of texts, each is a SavedSpan
+	int aggCount;   //the number of aggregates, 0 or the number of XPaths
+}AppendHead;
+
+typedef struct SavedState{
+	ChildMask steps;   //see stateSteps
+	ChildMask carry;   //see stateCarry
+	TagMask tags;   //see stateTags, the tags entering the state in the former run, as the transitions are not saved
+}SavedState;
+
+typedef struct SavedSpan{
+	long offset;   //the offset of the text in the file
+	long len;
+	int state;
+}SavedSpan;
+
+/*data structure for the chunk cache, the stack trees of the chunks of a run kept for the next run over the same file(see xml_run_cached). 
+The cache file is the head, the states of the automata(SavedState), the entries sorted by their keys and the trees of the chunks. The tree of a chunk is a CachedTree followed 
+by its nodes, the children of the nodes(the numbers of the nodes) and the texts of the outputs(SavedSpan, from the beginning of the chunk). 
+The head, the states, the entries and the trees are multiples of CACHE_ALIGN bytes, so the nodes, whose childMask may be 16 bytes, are aligned in the file loaded*/
+#define CACHE_MAGIC "XMLCCH5"
+#define CACHE_ALIGN 16
+#define CACHE_CHUNK (256*1024)   //the average size of the chunks of a cached run
+#define CACHE_CHUNKS 4096   //the chunks of a larger file are made larger, so there are no more chunks than this
+#define CACHE_WINDOW 64   //the bytes a cut depends on, the gear hash forgets a byte after this many more(see cut_cached)
+typedef struct CacheHead{
+	char magic[8];
+	unsigned long long query;   //the fingerprint of the query(see xml_compile)
+	int stateCount;   //the states saved after the head, the trees are in them
+	int queryCount;
+	long entryCount;
+	long dataSize;   //the bytes of the trees after the entries
+	long reserved;   //0, the head is 48 bytes
+}CacheHead;
+
+typedef struct CacheEntry{
+	unsigned long long key;   //the hash of the bytes of the chunk, seeded by the fingerprint of the query
+	long len;   //the length of the chunk
+	long offset;   //the stack tree of the chunk in the data
+	long size;
+}CacheEntry;
+
+typedef struct CachedTree{
+	long nodeCount;   //the nodes, the start root is the first one and the finish root the second one
+	long childCount;   //the children of all the nodes, one after the other
+	long spanCount;   //the texts of all the outputs, one after the other
+	long endState;   //the lexer state where the chunk stops(see endStates)
+	int treeStates;   //the states assumed by the start tree(see treeStates)
+	int treeBelow;   //see treeBelow
+	int treeMissed;   //see treeMissed
+	int reserved;   //0, the nodes after the tree start 48 bytes on
+}CachedTree;
+
+typedef struct CachedNode{
+	ChildMask childMask;
+	int state;
+	int isLeaf;
+	int hasOutput;
+	int start;   //the number of start_node, -1--NULL
+	int finish;   //the number of finish_node
+	int parent;   //the number of parent
+	long firstSpan;   //the first text of the output
+	long spanCount;
+}CachedNode;
+
+typedef struct TreeIndex{
+	Node** nodes;   //the nodes in the order of their numbers
+	long count;
+	long* table;   //the number+1 of each node by the hash of its address, 0--empty
+	long tableCap;   //a power of 2
+}TreeIndex;
+
+/*data structure for the parallel merge, the mappings of the parts are composed by a parallel prefix on the workers*/
+typedef struct PartMap{
+	int slot;   //the slot of the stack tree of the part; -1--the part maps every state to itself
+	int failed;   //1--the part could not be dealt with
+	int first;   //1--the part is the first part of the file
+	int next[2][MAX_STATE];   //next[][s]--the state after the part(after all the parts up to it once the prefix is done) if the first part starts with s; -1--no mapping; -2--it depends on the stack below s
+	long spanEnd[2];   //the number of texts of the part(of all the parts up to it once the prefix is done)
+	ResultSet set;   //the mapping of the part for the state it really starts with
+}PartMap;
+
+/*data structure for the structural index engine*/
+#define INDEX_WORD 64
+typedef unsigned long long IndexWord;
+typedef IndexWord (*IndexFunc)(char* p);
+IndexFunc index_block;   //build the index word for 64 bytes, chosen by init_scanner
+
+typedef struct IndexFrame{
+	int state;
+	SpanList output;
+	int hasOutput;
+}IndexFrame;
+
+/*data structure for the sidecar index, the markups of an XML file are lexed once and written next to it(see xml_build_index), 
+the later runs of the structural index version map it and run the automata over the markups without lexing the file again*/
+#define SIDECAR_SUFFIX ".idx"
+#define SIDECAR_MAGIC "XMLIDX3"
+enum {EVENT_OPEN,EVENT_CLOSE,EVENT_OTHER};
+typedef struct TagEvent{
+	int kind;   //EVENT_OPEN, EVENT_CLOSE, or EVENT_OTHER for the head, the comments, the CDATA and the tags closing themselves
+	int name;   //the number of the tag name in the sidecar index, -1 for EVENT_OTHER
+	long begin;   //the offset of the open angle bracket in the file
+	long end;   //the offset of the close angle bracket in the file
+}TagEvent;
+
+/*the Bloom filter of the tag names of a cut, a part whose filters take no tag name of the XPaths is not run at all(see replay_part)*/
+#define SIDECAR_BLOOM 4
+typedef unsigned long long BloomWord;
+typedef struct SideBloom{
+	BloomWord bits[SIDECAR_BLOOM];   //two bits for each tag name(see bloom_add)
+}SideBloom;
+
+typedef struct SideName{
+	long offset;   //the offset of the name in the pool of the names
+	long len;
+}SideName;
+
+/*the sidecar index is the head, the names, the pool of the names(padded to 8 bytes), the markups, the cuts and the filters of the cuts, one after the other*/
+typedef struct SidecarHead{
+	char magic[8];
+	long fileSize;   //the size of the XML file the index is built for
+	long fileTime;   //the modification time of the XML file the index is built for
+	long fileNsec;   //the part of the modification time under a second(see file_nsec), an edit in the second the index is built is found too
+	long nameCount;
+	long poolSize;
+	long eventCount;
+	long cutCount;   //a part may begin with the markup of any cut, as the text before a markup goes with it
+}SidecarHead;
+
+/*data structure for one run of a query, everything which changes while a query runs is kept here so that several runs could go on at once. 
+The thread dealing with a run(the caller, or a worker while it runs a task of the run) finds it in ctx*/
+typedef struct RunContext{
+	Query* query;   //the compiled query, shared with the other runs
+	int mode;   //the version of the run(see main)
+
+	/*the automata of the run, the states xml_compile left out are built by the parts which reach them(see tag_move)*/
+	Dfa dfa;
+	pthread_mutex_t dfaLock;   //taken while a state is built, the states built are read without it
+
+	/*the chunks and the slots*/
+	int chunkCount;   //the number of chunks(the windows of a batch for the streaming version)
+	int* chunkStatus;   //for each chunk: 0--not finished 1--finished -1--finished without a mapping
+	int slotCount;   //chunkCount*MAX_SPEC, slot i+k*chunkCount is used by chunk i for the k-th assumed state
+	Node** start_root;   //start tree for each slot
+	Node** finish_root;   //finish tree for each slot
+	Arena* arenas;   //arena for each slot
+	char** spanBase;   //the input which the spans of each slot point into
+	long* slotLens;   //the length of the part dealt with in each slot, so that it could be dealt with again(see refresh_part)
+	int* treeStates;   //for each slot, its start tree assumes the states 0 to treeStates-1, the states built later are not in it(see tree_stale)
+	int* treeBelow;   //for each slot, 1--an end tag closes an element opened before the part, the tree knows only the states built then which it could come from
+	int* treeMissed;   //for each slot, 1--a tag would have entered a state not built yet, it is taken as not taken instead(see start_tag)
+	int* treeExact;   //for each slot, 1--the tree starts with the states the part really starts with(the first part, or a part dealt with again at the merge), its tags may build new states
+	char (*multiExpContent)[MAX_LINE];  //save for multi-line explanations, one line for each slot
+	char (*multiCDATAContent)[MAX_LINE]; //save for multi-line CDATA, one line for each slot
+
+	/*speculative lexing*/
+	SpecRun (*specRuns)[MAX_SPEC];   //the runs of each chunk
+	int* partSlot;   //the slot chosen for each part by the merge; -1--the whole part is inside a token of the former parts
+	long* partBegin;   //the offset of each part in the file
+	char** overrunLimit;   //for each slot, xml_process may go beyond the part up to this limit to finish its last token; NULL--no overrun
+	char** overrunEnd;   //for each slot, where xml_process stopped
+	int* endStates;   //for each slot, the lexer state where xml_process stopped, 0 or 7--between tokens
+	int lexState;   //the lexer state at the end of the parts merged so far, a part cut inside a token is dealt with again after it(see resume_part)
+	int speculative;   //1--the parts are cut at exact sizes and lexed from every state in specStates
+	long resolveNext;   //the boundary where the last token of the parts resolved so far ends
+
+	/*files in each chunk*/
+	char ** buffFiles;
+	long* buffLens;   //length of each part, the parts are not '\0' terminated in mmap mode
+
+	/*mmap input*/
+	char * mapBase;   //read-only mapping of the whole XML file, or the buffer given by the caller
+	long mapSize;   //the size of the mapping
+	int isMapped;   //1--buffFiles[] are views into mapBase and must not be freed
+	int isBorrowed;   //1--mapBase is the buffer of the caller and is not released by unmap_file
+
+	/*splitting the file by each thread*/
+	char * partFile;   //the name of the XML file
+	long partFileSize;   //the size of the XML file
+	long partSize;   //the default size of each part
+	int splitByThread;   //1--each thread looks for the boundaries of its own part
+
+	/*the parallel merge*/
+	PartMap* partMaps;   //one for each chunk
+	int reduceCount;   //the number of parts being merged
+	int reduceStart;   //the state at the beginning of the first part
+	ResultSet* reduceSet;   //the mapping which the parts are merged into
+	int reduceRound;   //the distance of the current round of a prefix
+	int reduceCur;   //next[reduceCur] and spanEnd[reduceCur] hold the prefix so far, the round writes the other half
+	int reduceBase;   //partMaps[reduceBase] is the first part being merged
+
+	/*the incremental merge, the worker which finishes a part merges it as soon as all the parts before it are merged,
+	so most of the merge is done while the later parts are still being dealt with*/
+	pthread_mutex_t mergeLock;   //guards chunkStatus and the counters below
+	ResultSet* mergeSet;   //the mapping which the parts are merged into
+	int mergeCount;   //the number of parts
+	int mergeFront;   //the parts before it have been merged
+	int mergeDone;   //the number of parts finished
+	int merging;   //1--a worker is merging the parts at the front
+	int mergeFailed;   //1--the parts could not be merged
+
+	/*streaming version*/
+	int windowBase;   //the number of windows dealt with before the current batch of threads, 1 for a run going on from a saved state
+
+	/*a run over a file which only grows(see xml_run_append)*/
+	char* appendBase;   //the mapping of the whole file, the mapping of the run is the part of it not dealt with yet; NULL--the run does not go on from a saved state
+	long appendSize;
+
+	/*a run which keeps the stack trees of its chunks in a cache file(see xml_run_cached)*/
+	long* cacheCuts;   //the chunks are cut at these offsets, they depend on the bytes around them only; NULL--the chunks are cut at equal sizes
+	unsigned long long cacheGear[256];   //the gear hash of each byte value
+	int cacheShift;   //a point to cut at is where the hash shifted right by this is 0
+	long cacheRegion;   //the size of the regions scanned for the points by each worker
+	long** cachePoints;   //for each region, the points found in it, while the mapping is cut
+	long* cachePointCounts;
+	char* cacheData;   //the cache loaded
+	CacheEntry* cacheEntries;   //the entries of the cache loaded, sorted by their keys
+	long cacheEntryCount;
+	unsigned long long* cacheKeys;   //for each chunk, the key of its bytes
+	char** cacheHits;   //for each chunk, its stack tree in the cache loaded; NULL--it is dealt with as usual
+	char** cacheBlobs;   //for each chunk dealt with, its stack tree to be saved; NULL--it is not saved
+	long* cacheSizes;   //for each chunk, the size of its stack tree in the cache
+
+	/*early termination, the parts still being dealt with look at cancelled once every CANCEL_CHECK bytes and stop when it is set*/
+	long limit;   //the run looks for the first limit texts in the order of the input only, 0--no limit
+	int existsOnly;   //1--the run only tells whether a text exists, a part which takes a text whatever state it starts with tells it(see part_proves)
+	int cancelled;   //1--the result is known, it is set and read by __atomic builtins as it is not guarded by a lock
+	int found;   //1--a part has proved that a text exists
+	long firstTexts;   //the texts taken so far by the first part of the file, they are all in the result as it starts with state 1
+
+	/*the structural index engine*/
+	IndexWord* structIndex;   //bit k of word w is set if byte w*64+k of the mapping is '<', '>' or '"'
+	long indexWords;   //the number of words in structIndex
+	int indexChunks;   //the number of chunks of structIndex built by the workers
+	IndexFrame* indexStack;   //the stack of the automata for stage 2
+	int indexTop;
+	int indexCap;
+
+	/*the sidecar index, it is built into the arrays below by xml_build_index, or mapped from the file by open_sidecar*/
+	char* sideBase;   //the mapping of the sidecar index; NULL--the run has no sidecar index
+	long sideSize;   //the size of the mapping
+	SideName* sideNames;
+	char* sidePool;   //the tag names, one after the other
+	TagEvent* sideEvents;   //the markups in the order of the file
+	long* sideCuts;   //the markups the parts may begin with, ascending
+	SideBloom* sideBlooms;   //the filter of the tag names from each cut to the next one
+	long sideNameCount;
+	long sidePoolSize;
+	long sideEventCount;
+	long sideCutCount;
+	int* sideTags;   //the tag id of each name for the query of the run(see tag_id)
+	char* sideQuiet;   //for each chunk, 1--no tag of the XPaths is in the part, so it is not run(see replay_part)
+	int* sideHash;   //the names by their hash, while the index is built(the number of the name+1, 0--empty)
+	long sideHashCap;   //a power of 2
+
+	/*the result*/
+	ResultSet result;   //the mapping for the whole input
+	int status;   //0--the mapping is found; -1--the XML file is wrong or the mappings could not be merged
+	long nextText;   //the next text given by xml_next_result
+	long* queryNext;   //the next text given by xml_next_query_result for each XPath, NULL until it is first called
+}RunContext;
+
+__thread RunContext* ctx=NULL;   //the run dealt with by this thread
 
 /*before thread creation*/
 int load_file(char* file_name); //load XML into memory(only used for sequential version)
-int split_file(char* file_name, int n);  //split XML file into several parts and load them into memory
+int split_file(char* file_name);  //split XML file into chunks, each chunk is loaded into memory by the worker dealing with it
+char* load_part(int thread_num, long* len);  //load a chunk into memory, called by the worker dealing with it
+int map_file(char* file_name);  //map XML file into memory and give each chunk an (offset, length) view
+int open_mapping(char* file_name);  //map the whole XML file into memory
+void locate_part(int thread_num);  //find the view of a chunk in the mapping, called by the worker dealing with it
+void unmap_file();  //release the mapping created by map_file
+int map_buffer(char* buff, long len);  //use a buffer of the caller as the mapping
+int cut_mapping();  //cut the mapping into views
 char* ReadXPath(char* xpath_name);  //load XPath into memory
-void createAutoMachine(char* xmlPath);   //create automachine for XPath.txt
+int createAutoMachine(Query* query, char* xmlPath);   //create automachine for the XPaths in XPath.txt, return value: 0--success -1--too many steps or XPaths, or a wrong predicate or aggregate function
+int parse_predicates(Query* query, char* text, PredMask* preds);  //return value: 0--success -1--the predicates could not be parsed or there are too many
+int parse_aggregate(char** path);  //return value: the aggregate function around an XPath, AGG_NONE--none -1--the parenthesis is not closed
+unsigned int tag_hash(char* s, long len, unsigned int seed);  //hash a tag name
+unsigned long long content_hash(const char* p, long len, unsigned long long seed);  //hash a text of any length
+int path_class(Query* query, char** names, long* lens, int n);  //return value: the class of an XPath, classCount--a new class
+int build_tag_table(Query* query);  //intern the tag names of the automata into a perfect hash table, return value: 0--success -1--too many names
+int build_dfa(Query* query);  //build the symbols and the first states of the automata, return value: 0--success -1--too many symbols
+int tag_lookup(Query* query, char* s, long len);  //return value: the tag id -1--not in the XPath
+int tag_id(Query* query, char* s, long len);  //return value: the tag id for a start or end tag -1--not in the XPath
+int dfa_add(Query* query, Dfa* dfa, ChildMask steps, ChildMask carry);  //return value: the new state of an automata
+void dfa_next(Query* query, Dfa* dfa, int state, int symbol, ChildMask* steps, ChildMask* carry);  //find the steps of the state a symbol enters from a state
+int dfa_build(Query* query, Dfa* dfa, int state, int symbol, int limit);  //return value: the state entered by a symbol from a state 0--the symbol is not taken there -1--no room for the state
+int tag_move(int symbol, int state, int build);  //return value: the state entered by a symbol from a state 0--the symbol is not taken there -1--the state is not built
+int tag_from(int id, int from, int to);  //return value: bit 0--a symbol of a tag enters a state from another one bit 1--a symbol is not taken there
+ChildMask mask_words(unsigned long long* words);  //return value: a mask of states kept in words
+int tag_symbol(Query* query, int id, PredMask met);  //return value: the symbol of a start tag for the predicates it meets
+PredMask attr_match(Query* query, int id, char* name, long nameLen, char* value, long valueLen);  //return value: the predicates met by an attribute of a tag
+
+/*speculative lexing for the parts cut at exact sizes*/
+long xml_resync(char* p, char* end, int state);  //find the first token boundary in a part for an assumed lexer state
+void prepare_part(int slot, char* from, char* limit, int first);  //create a stack tree in the slot for a part
+int process_part(int slot, char* from, long len, char* limit, int first);  //create a stack tree in the slot and deal with a part
+int speculate_part(int thread_num);  //deal with a part from every assumed lexer state
+int resolve_part(int i);  //choose the right assumption for a part while merging
+long lex_resume(char* p, char* end, int* state);  //finish the token left unfinished by the former part, return value: the offset of the first token boundary -1--none
+void resume_part(int i);  //deal with a part cut inside a token again from its first token boundary while merging
+
+/*arena for the stack trees*/
+void* arena_alloc(int slot, long size);  //carve zeroed memory out of the arena of a slot
+void arena_reset(int slot);  //give back everything carved out of the arena of a slot at once
+void arena_free(int slot);  //free the blocks of the arena of a slot
+Node* node_alloc(int slot);  //allocate a node in the arena of a slot
+Node** children_alloc(int slot, int cap);  //allocate a children array in the arena of a slot
+int child_count(Node* node);  //return value: the number of children of a node
+int mask_low(ChildMask m);  //return value: the smallest state in a mask, m is not 0
+int mask_high(ChildMask m);  //return value: the largest state in a mask, m is not 0
+int mask_count(ChildMask m);  //return value: the number of states in a mask
+Node* child_get(Node* node, int state);  //return value: the child of a node for a state NULL--no such child
+void child_set(Node* node, int state, Node* child, int slot);  //set the child of a node for a state
+void child_remove(Node* node, int state);  //remove the child of a node for a state
+void span_add(SpanList* list, int slot, long offset, long len, int state);  //append a span to an output
+void span_join(SpanList* to, SpanList* from);  //hand an output over to the end of another one
+void span_copy(SpanList* to, SpanList* from, int slot);  //append copies of the spans of an output to another one
+void hand_down(Node* node, int slot);  //hand the output of a node down to each of its children
+Node* start_child(Node* node, int state);  //return value: the child of a node of the start tree for a state NULL--no such child
 
 /*main functions for each thread*/
 void createTree_first(int start_state); //create tree for the first thread
 void createTree(int thread_num); //create tree for other threads
+void createTree_merge(int thread_num);  //create tree from the stack of the former parts for a part dealt with again at the merge
 void print_tree(Node* tree,int layer); //print the structure for each tree
-void add_node(Node* node, Node* root);  //insert a new node into finish tree
-void push(Node* node, Node* root, int nextState); //push new element into stack
-int checkChildren(Node* node);  //return value--the number of children -1--no child
-void pop(char * str, Node* root); //pop element due to end_tag e.g</d>
+void add_node(Node* node, Node* root, int thread_num);  //insert a new node into finish tree
+void push(Node* node, Node* root, int nextState, int thread_num); //push new element into stack
+int checkChildren(Node* node);  //return value--the smallest state of the children -1--no child
+void pop(int id, Node* root, int thread_num); //pop element due to end_tag e.g</d>
+void start_tag(int symbol, int thread_num);  //run the automata for a start tag in the stack tree of a thread
+void text_output(Node* root, int thread_num, long offset, long len);  //add a text to the nodes of the stack tree in the last step of an XPath
+char* skip_subtree(char* p, char* end);  //find the end tag of an element without dealing with anything in it
 int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);  //parse and deal with every element in an xmlText, return value:0--success -1--error 1--multiline explantion 2--multiline CDATA
 
 /*functions called by each thread*/
 char* substring(char *pText, int begin, int end);
 char* convertTokenTypeToStr(xml_TokenType type); //get the type for each element
 int xml_initText(xml_Text *pText, char *s);
+int xml_initTextLen(xml_Text *pText, char *s, long len);
 int xml_initToken(xml_Token *pToken, xml_Text *pText);
 char* ltrim(char *s); //reduct blank from left
 int left_null_count(char *s);  //calculate the number of blanket for each string
+char* scan_byte(char* p, char* end, char c);  //find the first byte c in a text one byte at a time
+#ifdef XML_SCAN_X86
+char* scan_sse2(char* p, char* end, char c);  //find the first byte c in a text 16 bytes at a time
+char* scan_avx2(char* p, char* end, char c);  //find the first byte c in a text 32 bytes at a time
+#endif
+#ifdef XML_SCAN_NEON
+char* scan_neon(char* p, char* end, char c);  //find the first byte c in a text 16 bytes at a time
+#endif
+void init_scanner();  //choose the scanner by the features of the CPU
 
 /*get and merge the mappings for the result*/
-ResultSet getresult(int n);
-void print_result(ResultSet set);
+void init_result(ResultSet* set);
+void result_add_span(ResultSet* set, char* p, long len, int state);  //append a text to a mapping without copying it
+void result_add_text(ResultSet* set, char* p, long len, int state);  //take a text into a mapping, it is folded into the aggregates or kept as a span
+int text_number(char* p, long len, double* value);  //return value: 1--the text is a number 0--it is not
+void result_join_aggregates(ResultSet* to, ResultSet* from);  //add the aggregates of a mapping to those of another one
+long result_texts(ResultSet* set);  //return value: the number of texts of a mapping
+void result_trim(ResultSet* set, long limit);  //keep the first texts of a mapping only
+void flush_result(ResultSet* set);  //copy the texts of a mapping out of the input
+void release_parts();  //free the parts loaded into memory once their texts are copied
+Node* map_stacks(int thread_num, int start, ResultSet* before, ResultSet* set);  //return value: the bottom of the stack in the finish tree NULL--no mapping for this start state
+ResultSet get_mapping(int thread_num, int start, ResultSet* before);
+int merge_result(ResultSet* final_set, ResultSet* set, int first);
+void reduce_map(int i);  //map every state through the tree of a part
+void reduce_compose(int i);  //one round of the prefix of the mappings
+void reduce_take(int i);  //take the mapping of a part for the state it starts with
+void reduce_count(int i);  //one round of the prefix of the numbers of texts
+void reduce_copy(int i);  //put the texts of a part into the final mapping
+int reduce_parts(int base, int count, int start, ResultSet* final_set);  //merge the mappings in partMaps into final_set in parallel
+void begin_merge(ResultSet* final_set, int count);  //get ready to merge the parts one by one as they finish
+void chunk_done(int i, int status);  //a part is finished, merge the parts at the front which are ready
+int merge_part(int i);  //merge one part into the mapping of the former parts
+int tree_stale(int slot, int start);  //return value: 1--the stack tree of a slot could be wrong for a start state as states have been built since 0--it is right
+ResultSet refresh_part(int i, int slot);  //deal with a part again from the stack of the former parts
+int merge_slot(int i, int slot);  //merge one part from the stack tree in a slot
+int getresult();  //merge the parts left after all of them are finished
+int merge_cancelled();  //merge the parts needed by a run which is cancelled
+void print_result(ResultSet* set);
+
+/*the worker pool and the sequential version*/
+int hardware_threads();  //return value: the number of CPUs
+int chunk_count(long size);  //return value: the number of chunks for a file
+void alloc_chunks(int chunks);  //allocate everything kept for each chunk and each slot
+int pool_start(int workers);  //start the workers
+void pool_submit(TaskFunc func, int begin, int end, TaskGroup* group);  //put a task into the deque of a worker
+int pool_take(int self, Task* task);  //return value: 1--a task is taken from the own deque or stolen 0--no task
+void *pool_worker(void *arg);  //main function of each worker
+void pool_run(int count, int grain, TaskFunc func);  //call func(0..count-1) on the workers and wait for them
+void pool_stop();  //stop the workers
+void main_task(int i);  //deal with a chunk
+int part_proves(int slot);  //return value: 1--the part takes a text whatever state it starts with 0--it does not
+void main_function();  //sequential version
+
+/*structural index engine, stage 1 builds the index in parallel and stage 2 runs the automata over it*/
+IndexWord index_byte(char* p);  //build the index word for 64 bytes one byte at a time
+#ifdef XML_SCAN_X86
+IndexWord index_sse2(char* p);  //build the index word for 64 bytes, 16 bytes at a time
+IndexWord index_avx2(char* p);  //build the index word for 64 bytes, 32 bytes at a time
+#endif
+#ifdef XML_SCAN_NEON
+IndexWord index_neon(char* p);  //build the index word for 64 bytes, 16 bytes at a time
+#endif
+void index_task(int i);  //stage 1 for a chunk of the index
+int build_index();  //run stage 1 on the workers
+long next_struct(long from, char c);  //find the next structural character by the index
+void index_output(IndexFrame* frame, long offset, long len);  //append an output to a frame of the stack
+PredMask index_attrs(int id, char* p, char* end);  //return value: the predicates met by the attributes of a tag
+void index_push(int symbol);  //run the automata for a start tag
+void index_pop(int j);  //run the automata for an end tag
+long lex_event(long cur, TagEvent* event, long* nameLen);  //find the next markup by the index, return value: the offset after it 0--no more markup -1--error
+int walk_index(ResultSet* set);  //stage 2 for the whole file
+
+/*sidecar index, the markups lexed once and kept next to the file for the later runs of the structural index version*/
+long sidecar_name(char* p, long len);  //return value: the number of a tag name in the index being built
+long file_nsec(const char* file_name, struct stat* st);  //the nanoseconds of the modification time of a file
+int write_sidecar(const char* file_name, struct stat* st);  //write the index built in the run next to the file
+int open_sidecar(char* file_name);  //map the index of the file of the run, return value: 0--mapped -1--no index or out of date
+void free_sidecar();  //release the index of the run
+void bloom_add(SideBloom* bloom, char* p, long len);  //add a tag name to a filter
+int bloom_test(SideBloom* bloom, char* p, long len);  //return value: 1--the name may be in the filter 0--it is not
+void side_range(int i, long* cut, long* cutEnd, long* first, long* last);  //the cuts and the markups of a part
+int side_text(long e, long* offset, long* len);  //return value: 1--there is a text before a markup 0--there is none
+int side_quiet(long cut, long cutEnd);  //return value: 1--no tag of the XPaths is in the cuts 0--there may be one
+int replay_part(int i);  //run the automata over the markups of a part, return value: 0--success 3--cancelled
+void quiet_texts(int i, int state, ResultSet* set);  //take the texts of a quiet part into a mapping
+
+/*streaming version for the files larger than the memory*/
+void free_tree(int thread_num);  //free the start tree and the finish tree of a thread
+char* read_window(FILE* fp, char** carry, long* carryLen, long window_size, int* eof, long* len);
+int stream_file(char* file_name, int n, long window_size, ResultSet* final_set);
+
+/*the runs of the library(see XML_parallel.h for the interface)*/
+RunContext* run_create(Query* query, int mode);  //create an empty run of a query
+int run_chunks(int n, char* file_name, long window_size);  //deal with the chunks of the current run and merge them
+RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly);  //run a query over an XML file with a limit of texts
+int dfa_save(SavedState* states);  //return value: the number of states of the automata of the run, they are copied into states
+int dfa_restore(SavedState* states, int count);  //take the states saved by a former run, return value: 0--success -1--saved for other automata
+long load_state(const char* state_name);  //take the state saved by a former run, return value: the offset to go on from 0--no state for this query and file
+int save_state(const char* state_name, long offset);  //save the result of a run for the next run over the same file
+int cut_cached();  //cut the mapping at points which depend on the bytes around them only
+void cache_scan(int r);  //find the points of one region of the mapping where the chunks may be cut
+int cache_entry_compare(const void* a, const void* b);  //order the entries of a cache by their keys
+int cache_lookup(int i);  //return value: 1--the stack tree of a chunk is taken from the cache 0--it is not there
+long tree_index(TreeIndex* index, Node* node);  //return value: the number of a node of a stack tree kept in a cache
+long cached_size(long nodeCount, long childCount, long spanCount);  //return value: the bytes of a stack tree kept in a cache
+void cache_part(int i);  //keep the stack tree of a chunk for the next run
+int load_tree(int i, char* blob, long size);  //rebuild the stack tree of a chunk kept in a cache, return value: 0--success -1--broken
+int load_cache(const char* cache_name);  //load the cache of the query, return value: 0--loaded -1--no cache for this query
+int save_cache(const char* cache_name);  //save the stack trees of the chunks of the run for the next run
+void free_cache();  //release the chunk cache of the run
+void free_chunks();  //free everything kept for each chunk and each slot of the current run
+int run_text(RunContext* run, long k, const char** text, long* len);  //return value: the state of the k-th text of a run 0--no such text
 
 
 /*************************************************
-Function: int split_file(char* file_name,int n);
-Description: split a large file into several parts according to the number of threads for this program, while keeping the split XML files into the memory
-Called By: int main(void);
-Input: file_name--the name for the xml file; n--the number of threads for this program
-Return: the number of threads(start with 0); -1--can't open the XML file
+Function: int split_file(char* file_name);
+Description: split a large file into chunks, there are many more chunks than workers(see chunk_count). 
+Only the size of each chunk is calculated here, the worker dealing with a chunk looks for its boundaries and loads it into the memory(see load_part), 
+so that no worker has to wait for the former chunks to be read.
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly);
+Input: file_name--the name for the xml file
+Return: the number of chunks(start with 0); -1--can't open the XML file
 *************************************************/
-int split_file(char* file_name,int n)
+int split_file(char* file_name)
 {
+	int n;
 	FILE *fp;
-    int i,j,k,one_size;
-    int size;
     fp = fopen (file_name,"rb");
     if (fp==NULL) { return -1;}
     fseek (fp, 0, SEEK_END);   
-    size=ftell (fp);
-    rewind(fp);
-    one_size=(size/n)+1;
-    n=n-1;
-    char ch=-1;
-    int temp_one_size=0;
-    int s;
-    for (i=0;i<n;i++)
-    {
-    	s=0;
-        buffFiles[i]=(char*)malloc((one_size+MAX_LINE)*sizeof(char));
-        
-        if(ch!=-1)
-        {
-    	    buffFiles[i][0]=ch;
-    	    buffFiles[i][1]='\0';
-    	    char * buff=(char*)malloc((one_size)*sizeof(char));
-    	    k = fread (buff,1,one_size-1,fp);
-    	    buff[one_size-1]='\0'; 
-    	    buffFiles[i]=strcat(buffFiles[i],buff);
-    	    free(buff);
-	    }
-	    else
-	    {
-	    	k = fread (buffFiles[i],1,one_size,fp);
-		}
-        /*skip the default size to look for the next open angle bracket*/
-        ch=fgetc(fp);
-        while(ch!='<')
-        {
-        	buffFiles[i][one_size+(s++)]=ch;
-        	ch=fgetc(fp);
-        	temp_one_size++;
+    ctx->partFileSize=ftell (fp);
+    fclose(fp);
+    ctx->partFile=file_name;
+    n=chunk_count(ctx->partFileSize);
+    alloc_chunks(n);
+    ctx->partSize=(ctx->partFileSize/n)+1;
+    ctx->splitByThread=1;
+    return n-1;
+}
+
+/*************************************************
+Function: char* load_part(int thread_num, long* len);
+Description: load the part of a thread into memory. The part starts from the first open angle bracket after its default begin(i*partSize) 
+and ends before the first open angle bracket after its default end, so the boundaries found by two adjacent threads are always the same. 
+The bracket may be inside a comment or CDATA, the merge finds out and deals with the part again(see resume_part).
+Called By: void main_task(int i);
+Input: thread_num--the number of the thread
+Output: len--the length of the part
+Return: the '\0' terminated part; NULL--can't open the XML file
+*************************************************/
+char* load_part(int thread_num, long* len)
+{
+	FILE *fp;
+	long nominal_begin,nominal_end,cap,size,k,begin,end;
+	char* buff;
+	char* next;
+	nominal_begin=thread_num*ctx->partSize;
+	nominal_end=nominal_begin+ctx->partSize;
+	if(nominal_end>ctx->partFileSize) nominal_end=ctx->partFileSize;
+	*len=0;
+	if(nominal_begin>=ctx->partFileSize)
+	{
+		buff=(char*)malloc(sizeof(char));
+		buff[0]='\0';
+		return buff;
+	}
+	fp = fopen (ctx->partFile,"rb");
+	if (fp==NULL) { return NULL;}
+	fseek (fp, nominal_begin, SEEK_SET);
+	cap=nominal_end-nominal_begin+MAX_LINE;
+	buff=(char*)malloc((cap+1)*sizeof(char));
+	size=fread(buff,1,cap,fp);
+	/*skip the bytes before the first open angle bracket, they belong to the former part*/
+	begin=0;
+	if(thread_num>0)
+	{
+		next=(char*)memchr(buff,'<',(size<nominal_end-nominal_begin)?size:nominal_end-nominal_begin);
+		begin=(next==NULL)?size:next-buff;
+	}
+	/*look for the first open angle bracket after the default end*/
+	end=nominal_end-nominal_begin;
+	if(begin>=end||nominal_end>=ctx->partFileSize)
+	{
+		end=(begin>=end)?begin:size;
+	}
+	else
+	{
+		while(1)
+		{
+			next=(char*)memchr(buff+end,'<',size-end);
+			if(next!=NULL)
+			{
+				end=next-buff;
+				break;
+			}
+			end=size;
+			if(size<cap) break;
+			cap=2*cap;
+			buff=(char*)realloc(buff,(cap+1)*sizeof(char));
+			k=fread(buff+size,1,cap-size,fp);
+			size+=k;
+			if(k==0) break;
 		}
-		buffFiles[i][one_size+s]='\0';
-    }
-    j = size % one_size-temp_one_size;
-    if (j!=0) {
-    buffFiles[n]=(char*)malloc((j+1)*sizeof(char));
-    if(ch!=-1)
-    {
-    	buffFiles[n][0]=ch;
-    	buffFiles[n][1]='\0';
-    	char * buff=(char*)malloc((j+1)*sizeof(char));
-    	k = fread (buff,1,j,fp);
-    	buff[j+1]='\0'; 
-    	buffFiles[n]=strcat(buffFiles[n],buff);
-    	buffFiles[n][j]='\0'; 
-    	free(buff);
-	}
-    else
-    {
-    	k = fread (buffFiles[n],1,j,fp);
-        buffFiles[n][j]='\0';  
 	}
-	
-    }
-    close(fp);
-    return n;
+	fclose(fp);
+	if(begin>end) begin=end;
+	if(begin>0) memmove(buff,buff+begin,end-begin);
+	buff[end-begin]='\0';
+	*len=end-begin;
+	return buff;
 }
 
 /*************************************************
 Function: int load_file(char* file_name);
 Description: load the XML file into memory(only used for sequential version)
-Called By: int main(void);
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly);
 Input: file_name--the name for the xml file
 Return: 0--load successful; -1--can't open the XML file
 *************************************************/
@@ -238,16 +955,188 @@ int load_file(char* file_name)
     fseek (fp, 0, SEEK_END);   
     size=ftell (fp);
     rewind(fp);
-    buffFiles[0]=(char*)malloc((size+1)*sizeof(char));
-    k = fread (buffFiles[0],1,size,fp);
-    buffFiles[0][size]='\0'; 
-    close(fp);
+    ctx->buffFiles[0]=(char*)malloc((size+1)*sizeof(char));
+    k = fread (ctx->buffFiles[0],1,size,fp);
+    ctx->buffFiles[0][size]='\0'; 
+    fclose(fp);
     return 0;
 }
 
+/*************************************************
+Function: int map_file(char* file_name);
+Description: map the XML file read-only into memory without copying any byte and cut it into chunks(see chunk_count), 
+the worker dealing with a chunk finds its view of the mapping(see locate_part). 
+Each view still ends before an open angle bracket so that it could be dealt with by xml_process directly.
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly); int xml_build_index(const char* file_name);
+Input: file_name--the name for the xml file
+Return: the number of chunks(start with 0); -1--can't open or map the XML file
+*************************************************/
+int map_file(char* file_name)
+{
+	if (open_mapping(file_name)==-1) { return -1;}
+	return cut_mapping();
+}
+
+/*************************************************
+Function: int open_mapping(char* file_name);
+Description: map the whole XML file read-only into memory as the mapping of the run, on windows the file is loaded into memory once instead
+Called By: int map_file(char* file_name); RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name); RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Input: file_name--the name for the xml file
+Return: 0--success; -1--can't open or map the XML file, or it is empty
+*************************************************/
+#ifndef _WIN32
+int open_mapping(char* file_name)
+{
+	int fd;
+	struct stat st;
+	fd = open(file_name,O_RDONLY);
+	if (fd==-1) { return -1;}
+	if (fstat(fd,&st)==-1||st.st_size==0)
+	{
+		close(fd);
+		return -1;
+	}
+	ctx->mapSize=st.st_size;
+	ctx->mapBase=(char*)mmap(NULL,ctx->mapSize,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (ctx->mapBase==MAP_FAILED)
+	{
+		ctx->mapBase=NULL;
+		return -1;
+	}
+	madvise(ctx->mapBase,ctx->mapSize,MADV_SEQUENTIAL);
+	return 0;
+}
+
+/*************************************************
+Function: void unmap_file();
+Description: release the mapping created by map_file, all the views in buffFiles[] become invalid. The buffer of the caller(see map_buffer) is not released. 
+The mapping of a run resuming a saved one is only the new bytes, the whole file mapped is released instead(see xml_run_append).
+Called By: void xml_free_run(RunContext* run);
+*************************************************/
+void unmap_file()
+{
+	if (ctx->appendBase!=NULL)
+	{
+		ctx->mapBase=ctx->appendBase;
+		ctx->mapSize=ctx->appendSize;
+		ctx->appendBase=NULL;
+	}
+	if (ctx->mapBase!=NULL&&ctx->isBorrowed==0) munmap(ctx->mapBase,ctx->mapSize);
+	ctx->mapBase=NULL;
+	ctx->mapSize=0;
+	ctx->isMapped=0;
+}
+#else
+int open_mapping(char* file_name)
+{
+	/*no mmap on windows, the whole file is loaded into memory once and used as the mapping*/
+	FILE *fp;
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return -1;}
+	fseek (fp, 0, SEEK_END);   
+	ctx->mapSize=ftell (fp);
+	rewind(fp);
+	if (ctx->mapSize==0)
+	{
+		fclose(fp);
+		return -1;
+	}
+	ctx->mapBase=(char*)malloc(ctx->mapSize*sizeof(char));
+	ctx->mapSize=fread (ctx->mapBase,1,ctx->mapSize,fp);
+	fclose(fp);
+	return 0;
+}
+
+void unmap_file()
+{
+	if (ctx->appendBase!=NULL)
+	{
+		ctx->mapBase=ctx->appendBase;
+		ctx->mapSize=ctx->appendSize;
+		ctx->appendBase=NULL;
+	}
+	if (ctx->mapBase!=NULL&&ctx->isBorrowed==0) free(ctx->mapBase);
+	ctx->mapBase=NULL;
+	ctx->mapSize=0;
+	ctx->isMapped=0;
+}
+#endif
+
+/*************************************************
+Function: int map_buffer(char* buff, long len);
+Description: use a buffer of the caller as the mapping, it is cut into views in the same way as a mapped file and is never written
+Called By: RunContext* xml_run_buffer(Query* query, const char* buff, long len, int mode);
+Input: buff--the XML text; len--the length of the text
+Return: the number of chunks(start with 0); -1--the buffer is empty
+*************************************************/
+int map_buffer(char* buff, long len)
+{
+	if (buff==NULL||len<=0) { return -1;}
+	ctx->mapBase=buff;
+	ctx->mapSize=len;
+	ctx->isBorrowed=1;
+	return cut_mapping();
+}
+
+/*************************************************
+Function: int cut_mapping();
+Description: cut the mapping into chunks(see chunk_count), the worker dealing with a chunk finds its view(see locate_part)
+Called By: int map_file(char* file_name); int map_buffer(char* buff, long len); RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name);
+Return: the number of chunks(start with 0)
+*************************************************/
+int cut_mapping()
+{
+	int n;
+	ctx->isMapped=1;
+	ctx->partFileSize=ctx->mapSize;
+	n=chunk_count(ctx->mapSize);
+	alloc_chunks(n);
+	ctx->partSize=(ctx->mapSize/n)+1;
+	ctx->splitByThread=1;
+	return n-1;
+}
+
+/*************************************************
+Function: void locate_part(int thread_num);
+Description: find the view of a thread in the mapping. The view starts from the first open angle bracket after its default begin(i*partSize) 
+and ends before the first open angle bracket after its default end, so each thread could find its own boundaries without the others. 
+The bracket may be inside a comment or CDATA, the merge finds out and deals with the part again(see resume_part).
+Called By: void main_task(int i);
+Input: thread_num--the number of the thread
+*************************************************/
+void locate_part(int thread_num)
+{
+	long begin,end;
+	char* next;
+	if(ctx->cacheCuts!=NULL)   //the cuts are known already(see cut_cached)
+	{
+		ctx->buffFiles[thread_num]=ctx->mapBase+ctx->cacheCuts[thread_num];
+		ctx->buffLens[thread_num]=ctx->cacheCuts[thread_num+1]-ctx->cacheCuts[thread_num];
+		return;
+	}
+	begin=thread_num*ctx->partSize;
+	end=begin+ctx->partSize;
+	if(begin>ctx->mapSize) begin=ctx->mapSize;
+	if(end>ctx->mapSize) end=ctx->mapSize;
+	if(thread_num>0&&begin<end)
+	{
+		next=(char*)memchr(ctx->mapBase+begin,'<',end-begin);
+		begin=(next==NULL)?end:next-ctx->mapBase;
+	}
+	if(end<ctx->mapSize)
+	{
+		next=(char*)memchr(ctx->mapBase+end,'<',ctx->mapSize-end);
+		end=(next==NULL)?ctx->mapSize:next-ctx->mapBase;
+	}
+	ctx->buffFiles[thread_num]=ctx->mapBase+begin;
+	ctx->buffLens[thread_num]=end-begin;
+}
+
+
 /*************************************************
 Function: char* ReadXPath(char* xpath_name);
-Description: load XPath from related file
+Description: load XPath from related file, the file may hold one XPath on each line, so the buffer grows with the file
 Called By: int main(void);
 Input: xpath_name--the name for the XPath file
 Return: the contents in the Xpath file; error--can't open the XPath file
@@ -257,6 +1146,7 @@ char* ReadXPath(char* xpath_name)
 	FILE *fp;
 	char* buf=(char*)malloc(MAX_LINE*sizeof(char));
 	char* xpath=(char*)malloc(MAX_LINE*sizeof(char));
+	long len=0,cap=MAX_LINE,k;
 	xpath=strcpy(xpath,"");
 	if((fp = fopen(xpath_name,"r")) == NULL)
     {
@@ -265,1561 +1155,5963 @@ char* ReadXPath(char* xpath_name)
     else{
     	while(fgets(buf,MAX_LINE,fp) != NULL)
     	{
-    		xpath=strcat(xpath,buf);
+    		k=strlen(buf);
+    		if(len+k+1>cap)
+    		{
+    			cap=2*cap+k;
+    			xpath=(char*)realloc(xpath,cap*sizeof(char));
+			}
+    		memcpy(xpath+len,buf,k+1);
+    		len+=k;
 		}
+		fclose(fp);
 	}
 	free(buf);
     return xpath;
 }
 
 /*************************************************
-Function: void createAutoMachine(char* xmlPath);
-Description: create an automata by the XPath Query command
-Called By: int main(void);
-Input: xmlPath--XPath Query command
+Function: int createAutoMachine(Query* query, char* xmlPath);
+Description: create an automata by the XPath Query commands, xmlPath holds one or more XPaths separated by '|' or new lines. 
+The steps of the XPaths are compiled into prefix trees(as YFilter does), a step shared by several XPaths takes one place, so all of them are run in one pass, 
+and the last step of each XPath is tagged with the id of the XPath(its place in xmlPath). Run alone, an XPath skips the tag names it does not hold, 
+so the XPaths holding the same names form a class(see path_class), each class has a prefix tree from a root step of its own, and the steps are shared only inside a class. 
+A step after // is taken at any depth below its parent step. 
+A step may be * for any tag name, and may hold predicates on the attributes of its tag, e.g. programmer[@age="35"], programmer[@age] or programmer[not(@age)](see parse_predicates). 
+A step on the attribute axis, e.g. //programmer/@age, is not taken. 
+An XPath may be put into an aggregate function, e.g. count(/company/develop/programmer)(see parse_aggregate). Step s(s>=2) is entered from its parent by the entry 2s-3 and left by the entry 2s-2, a root step has no entry. 
+The steps are turned into the states of the stack trees by build_dfa and the runs(see tag_move), a single XPath without // gives the chain of states it always did. 
+xmlPath is cut by strtok_r so that queries could be compiled at once
+Called By: Query* xml_compile(const char* xpath);
+Input: query--the query being compiled; xmlPath--XPath Query commands, it is cut into the tag names
+Return: 0--success; -1--there is no XPath, there are more steps, symbols, tag names, XPaths or predicates than the automata could hold, or a predicate, an attribute step or an aggregate function could not be parsed
 *************************************************/
-void createAutoMachine(char* xmlPath)
+int createAutoMachine(Query* query, char* xmlPath)
 {
-	char seps[] = "/"; 
-	char *token = strtok(xmlPath, seps); 
-	while(token!= NULL) 
+	char *pathSave;
+	char *path,*token,*p,*filter,*axis;
+	char *names[MAX_STATE],*cuts[MAX_STATE];
+	long lens[MAX_STATE];
+	int descendants[MAX_STATE];
+	PredMask stepPreds[MAX_STATE];
+	char end,quote;
+	int cur,s,e,slashes,depth,agg,n,k,c;
+	long len;
+	PredMask preds;
+	query->stepCount=1;   //step 1 is outside the root element
+	query->rootSteps=0;
+	query->classCount=0;
+	query->queryCount=0;
+	query->aggregateMask=0;
+	query->descendParents=0;
+	query->predCount=0;
+	query->negatedPreds=0;
+	for(path=strtok_r(xmlPath,"|\r\n",&pathSave);path!=NULL;path=strtok_r(NULL,"|\r\n",&pathSave))
 	{
-		stateCount++;
-		stateMachine[machineCount].start=stateCount;
-		stateMachine[machineCount].str=(char*)malloc((strlen(token)+1)*sizeof(char));
-		stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,token);
-		stateMachine[machineCount].end=stateCount+1;
-		stateMachine[machineCount].isoutput=0;
-		machineCount++;
-		if(stateCount>=1)
+		agg=parse_aggregate(&path);
+		if(agg==-1) return -1;
+		/*the steps are parsed first, as the class of the XPath is known only once all its names are*/
+		for(p=path,n=0;;)
+		{
+			/*a name after two slashes or more is a descendant step*/
+			for(slashes=0;*p=='/'||*p==' '||*p=='\t';p++)
+			{
+				if(*p=='/') slashes++;
+			}
+			if(*p=='\0') break;
+			/*the step ends at a slash or a blank which is not inside the predicates*/
+			for(token=p,depth=0,quote=0;*p!='\0';p++)
+			{
+				if(quote!=0)
+				{
+					if(*p==quote) quote=0;
+				}
+				else if(depth>0&&(*p=='"'||*p=='\'')) quote=*p;
+				else if(*p=='[') depth++;
+				else if(*p==']') depth--;
+				else if(depth==0&&(*p=='/'||*p==' '||*p=='\t')) break;
+			}
+			end=*p;
+			*p='\0';
+			filter=strchr(token,'[');
+			preds=0;
+			if(filter!=NULL&&parse_predicates(query,filter,&preds)==-1) return -1;
+			len=(filter!=NULL)?filter-token:(long)strlen(token);
+			if(len==0) return -1;   //predicates without a name
+			axis=strstr(token,"::");
+			if(token[0]=='@'||(axis!=NULL&&axis<token+len)) return -1;   //only the elements are taken, not the attributes or the other axes, e.g. //programmer/@age
+			*p=end;
+			if(n+1>=MAX_STATE) return -1;
+			names[n]=token;
+			lens[n]=len;
+			cuts[n]=p;
+			descendants[n]=(slashes>=2);
+			stepPreds[n]=preds;
+			n++;
+		}
+		if(n==0&&agg!=AGG_NONE) return -1;   //an aggregate function without an XPath
+		if(n==0) continue;   //a blank line
+		if(query->queryCount>=MAX_QUERY) return -1;
+		c=path_class(query,names,lens,n);
+		if(c==query->classCount)
 		{
-			stateMachine[machineCount].start=stateCount+1;
-			stateMachine[machineCount].str=(char*)malloc((strlen(stateMachine[machineCount-1].str)+2)*sizeof(char));
-			stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,"/");
-			stateMachine[machineCount].str=strcat(stateMachine[machineCount].str,stateMachine[machineCount-1].str);
-			stateMachine[machineCount].end=stateCount;
-			stateMachine[machineCount].isoutput=0;
+			if(c==0) s=1;
+			else
+			{
+				if(query->stepCount+1>=MAX_STATE) return -1;
+				s=++query->stepCount;
+			}
+			query->rootSteps|=(ChildMask)1<<s;
+			query->classSteps[c]=(ChildMask)1<<s;
+			query->classCount++;
 		}
-		token=strtok(NULL,seps);  
-		if(token==NULL)
+		cur=mask_low(query->classSteps[c]&query->rootSteps);
+		for(k=0;k<n;k++)
 		{
-			stateMachine[machineCount-1].isoutput=1;
-			stateMachine[machineCount].isoutput=1;
+			*cuts[k]='\0';   //the XPath is parsed, so the slash or blank after a step is not looked at again
+			token=names[k];
+			len=lens[k];
+			filter=(token[len]=='[')?token+len:NULL;
+			/*the step is shared if a former XPath takes the same name with the same predicates(see parse_predicates) from the same step on the same axis*/
+			for(s=2;s<=query->stepCount;s++)
+			{
+				if(query->stateMachine[2*s-3].str!=NULL&&query->stateMachine[2*s-3].start==cur&&query->stateMachine[2*s-3].descendant==descendants[k]&&query->stepPreds[s]==stepPreds[k]
+					&&strncmp(query->stateMachine[2*s-3].str,token,len)==0&&query->stateMachine[2*s-3].str[len]=='\0') break;
+			}
+			if(s>query->stepCount)
+			{
+				if(query->stepCount+1>=MAX_STATE) return -1;
+				s=++query->stepCount;
+				if(filter!=NULL)
+				{
+					query->stepFilters[s]=(char*)malloc((strlen(filter)+1)*sizeof(char));
+					query->stepFilters[s]=strcpy(query->stepFilters[s],filter);
+					*filter='\0';   //the name is kept without the predicates
+				}
+				query->stepPreds[s]=stepPreds[k];
+				e=2*s-3;
+				query->stateMachine[e].start=cur;
+				query->stateMachine[e].str=(char*)malloc((strlen(token)+1)*sizeof(char));
+				query->stateMachine[e].str=strcpy(query->stateMachine[e].str,token);
+				query->stateMachine[e].end=s;
+				query->stateMachine[e].descendant=descendants[k];
+				query->stateMachine[e+1].start=s;
+				query->stateMachine[e+1].str=(char*)malloc((strlen(token)+2)*sizeof(char));
+				query->stateMachine[e+1].str=strcpy(query->stateMachine[e+1].str,"/");
+				query->stateMachine[e+1].str=strcat(query->stateMachine[e+1].str,token);
+				query->stateMachine[e+1].end=cur;
+				query->stateMachine[e+1].descendant=descendants[k];
+				query->classSteps[c]|=(ChildMask)1<<s;
+				if(descendants[k]==1) query->descendParents|=(ChildMask)1<<cur;
+			}
+			cur=s;
 		}
-		else machineCount++;
+		query->aggregates[query->queryCount]=agg;
+		if(agg!=AGG_NONE) query->aggregateMask|=(QueryMask)1<<query->queryCount;
+		query->stateMachine[2*cur-3].isoutput=1;
+		query->stateMachine[2*cur-2].isoutput=1;
+		query->stateMachine[2*cur-3].queries|=(QueryMask)1<<query->queryCount;
+		query->stateMachine[2*cur-2].queries|=(QueryMask)1<<query->queryCount;
+		query->queryCount++;
 	}
-    stateCount++;
+	if(query->queryCount==0) return -1;   //no XPath at all, e.g. an empty string
+	query->machineCount=(query->stepCount>1)?2*query->stepCount-2:1;
+	if(build_tag_table(query)==-1) return -1;
+	return build_dfa(query);
 }
 
 /*************************************************
-Function: void createTree(int thread_num);
-Description: initiate a stack tree for other thread other than the first thread
-Called By: void *main_thread(void *arg);for sequential version, called by void main_function();
-Input: thread_num--the number of the thread
+Function: int path_class(Query* query, char** names, long* lens, int n);
+Description: find the class of an XPath, the XPaths of a class hold the same set of tag names, or all hold a * step, which takes every name. 
+An XPath run alone skips the names it does not hold, so only the XPaths of one class see the same tags and may share steps, 
+and the tags of the other names leave the steps of the class as they are(see build_dfa)
+Called By: int createAutoMachine(Query* query, char* xmlPath);
+Input: query--the query being compiled; names--the steps of the XPath as they are written; lens--the length of each name without the predicates; n--the number of steps
+Return: the class; classCount--the XPath starts a new class
 *************************************************/
-void createTree(int thread_num)
+int path_class(Query* query, char** names, long* lens, int n)
 {
-	start_root[thread_num]=(Node*)malloc(sizeof(Node));
-	finish_root[thread_num]=(Node*)malloc(sizeof(Node));
-	start_root[thread_num]->children=(Node**)malloc(stateCount*sizeof(Node*));
-	finish_root[thread_num]->children=(Node**)malloc(stateCount*sizeof(Node*));
-	finish_root[thread_num]->state=-1;
-	int i,j;
-	for(i=0;i<=stateCount;i++)
+	ChildMask m;
+	char* str;
+	int c,k,wildcard,classWildcard;
+	for(wildcard=0,k=0;k<n;k++)
 	{
-		start_root[thread_num]->children[i]=(Node*)malloc(sizeof(Node));
-		finish_root[thread_num]->children[i]=(Node*)malloc(sizeof(Node));
-		for(j=0;j<=stateCount;j++)
-		{
-			start_root[thread_num]->children[i]->children=(Node**)malloc(stateCount*sizeof(Node*));
-			finish_root[thread_num]->children[i]->children=(Node**)malloc(stateCount*sizeof(Node*));
-			
-			start_root[thread_num]->children[i]->children[j]=NULL;
-			finish_root[thread_num]->children[i]->children[j]=NULL;
-		}
-		finish_root[thread_num]->children[i]->hasOutput=0;
-		finish_root[thread_num]->children[i]->output=(char*)malloc(MAX_OUTPUT*sizeof(char));
-		finish_root[thread_num]->children[i]->output=strcpy(finish_root[thread_num]->children[i]->output,"");
-		start_root[thread_num]->children[i]->state=i;
-		start_root[thread_num]->children[i]->parent=start_root[thread_num];
-		finish_root[thread_num]->children[i]->state=i;
-		finish_root[thread_num]->children[i]->parent=finish_root[thread_num];
-		start_root[thread_num]->children[i]->finish_node=finish_root[thread_num]->children[i];
-		finish_root[thread_num]->children[i]->start_node=start_root[thread_num]->children[i];
-		start_root[thread_num]->children[i]->isLeaf=1;
-		finish_root[thread_num]->children[i]->isLeaf=1;
+		if(lens[k]==1&&names[k][0]=='*') wildcard=1;
 	}
-	for(i=0;i<=stateCount;i++)
+	for(c=0;c<query->classCount;c++)
 	{
-		for(j=0;j<=stateCount;j++)
+		classWildcard=0;
+		for(m=query->classSteps[c]&~query->rootSteps;m!=0;m&=m-1)
 		{
-			start_root[thread_num]->children[i]->children[j]=NULL;
-			finish_root[thread_num]->children[i]->children[j]=NULL;
+			if(strcmp(query->stateMachine[2*mask_low(m)-3].str,"*")==0) classWildcard=1;
 		}
-	}
-}
-
-/*************************************************
-Function: void createTree_first(int start_state);
-Description: initiate a stack tree for the first thread, the start_state is 1
-Called By: void *main_thread(void *arg);for sequential version, called by void main_function();
-Input: start_state is 1
-*************************************************/
-void createTree_first(int start_state)
-{
-	int thread_num=0;
-	start_root[thread_num]=(Node*)malloc(sizeof(Node));
-	finish_root[thread_num]=(Node*)malloc(sizeof(Node));
-	start_root[thread_num]->children=(Node**)malloc(stateCount*sizeof(Node*));
-	finish_root[thread_num]->children=(Node**)malloc(stateCount*sizeof(Node*));
-	start_root[thread_num]->isLeaf=0;
-	finish_root[thread_num]->isLeaf=0;
-	int i,j;
-	for(i=0;i<=stateCount;i++)
-	{
-		if(i==start_state)
-		{
-			start_root[thread_num]->children[i]=(Node*)malloc(sizeof(Node));
-		    finish_root[thread_num]->children[i]=(Node*)malloc(sizeof(Node));
-		    finish_root[thread_num]->children[i]->hasOutput=0;
-		    finish_root[thread_num]->children[i]->output=(char*)malloc(MAX_OUTPUT*sizeof(char));
-		    finish_root[thread_num]->children[i]->output=strcpy(finish_root[thread_num]->children[i]->output,"");
-		    for(j=0;j<=stateCount;j++)
-		    {
-			    start_root[thread_num]->children[i]->children=(Node**)malloc(stateCount*sizeof(Node*));
-			    finish_root[thread_num]->children[i]->children=(Node**)malloc(stateCount*sizeof(Node*));
-			    start_root[thread_num]->children[i]->children[j]=NULL;
-			    finish_root[thread_num]->children[i]->children[j]=NULL;
-		    }
-		    start_root[thread_num]->children[i]->state=i;
-		    start_root[thread_num]->children[i]->parent=start_root[thread_num];
-		    finish_root[thread_num]->children[i]->state=i;
-		    finish_root[thread_num]->children[i]->parent=finish_root[thread_num];
-		    start_root[thread_num]->children[i]->finish_node=finish_root[thread_num]->children[i];
-		    finish_root[thread_num]->children[i]->start_node=start_root[thread_num]->children[i];
-		    start_root[thread_num]->children[i]->isLeaf=1;
-		    finish_root[thread_num]->children[i]->isLeaf=1;
+		if(classWildcard!=wildcard) continue;
+		if(wildcard==1) return c;
+		/*every name of the class is in the XPath*/
+		for(m=query->classSteps[c]&~query->rootSteps;m!=0;m&=m-1)
+		{
+			str=query->stateMachine[2*mask_low(m)-3].str;
+			for(k=0;k<n&&(strncmp(str,names[k],lens[k])!=0||str[lens[k]]!='\0');k++);
+			if(k==n) break;
 		}
-		else
+		if(m!=0) continue;
+		/*and every name of the XPath is in the class*/
+		for(k=0;k<n;k++)
 		{
-			start_root[thread_num]->children[i]=NULL;
-		    finish_root[thread_num]->children[i]=NULL;
-		}		
-	}
-	for(j=0;j<=stateCount;j++)
-	{
-		start_root[thread_num]->children[start_state]->children[j]=NULL;
-		finish_root[thread_num]->children[start_state]->children[j]=NULL;
+			for(m=query->classSteps[c]&~query->rootSteps;m!=0;m&=m-1)
+			{
+				str=query->stateMachine[2*mask_low(m)-3].str;
+				if(strncmp(str,names[k],lens[k])==0&&str[lens[k]]=='\0') break;
+			}
+			if(m==0) break;
+		}
+		if(k==n) return c;
 	}
+	return query->classCount;
 }
 
 /*************************************************
-Function: void print_tree(Node* tree,int layer);
-Description: print the structure of the tree for each layer
-Called By: void *main_thread(void *arg); for sequential version, called by void main_function();
-Input: tree--the start or finish stack tree; layer--the initial layer of the tree, default is 0
+Function: int parse_predicates(Query* query, char* text, PredMask* preds);
+Description: parse the predicates of a step, each of them is [@name] for an attribute which has to be there or [@name="value"](or 'value') for an attribute 
+which has to have the value, or either of them in not(), e.g. [not(@age)], which holds if the test fails. All of them must hold. Every predicate is kept once in the query however many steps hold it, so the attributes of a tag 
+are compared with each predicate once(see attr_match), and the steps holding the same predicates have the same mask.
+Called By: int createAutoMachine(Query* query, char* xmlPath);
+Input: query--the query being compiled; text--the predicates as they are written after the name of the step, e.g. [@age="35"][@sex]
+Output: preds--the predicates of the step, bit k for query->preds[k]
+Return: 0--success; -1--the predicates could not be parsed or there are more than MAX_PRED of them
 *************************************************/
-void print_tree(Node* tree,int layer)
+int parse_predicates(Query* query, char* text, PredMask* preds)
 {
-	QueueEle element;
-	Node* node=tree;
-	int i=0;
-	layer++;
-	QueueEle queue[MAX_SIZE];
-	int top=-1;
-	int buttom=-1;
-	int lastlayer=0;
-	printf("the 0th layer only includes the root node and its state is -1;");
-	for(i=0;i<=stateCount;i++)
+	char *p=text,*name,*value;
+	char quote;
+	long nameLen,valueLen;
+	int k,negated;
+	*preds=0;
+	while(*p!='\0')
 	{
-		
-		if(node->children[i]!=NULL)
+		if(*p++!='[') return -1;
+		for(;*p==' '||*p=='\t';p++);
+		negated=0;
+		if(strncmp(p,"not(",4)==0)
 		{
-		    element.node=node->children[i];
-			element.layer=layer;
-			queue[(top+1)%MAX_SIZE]=element;
-			top=(top+1)%MAX_SIZE;
+			negated=1;
+			for(p+=4;*p==' '||*p=='\t';p++);
 		}
-	}
-	while((top-buttom)%MAX_SIZE>0)
-	{
-		element=queue[(buttom+1)%MAX_SIZE];
-		node=element.node;
-		layer=element.layer;
-		if(layer>lastlayer)
+		if(*p++!='@') return -1;
+		for(name=p;*p!='\0'&&*p!='='&&*p!=']'&&*p!=')'&&*p!=' '&&*p!='\t';p++);
+		nameLen=p-name;
+		if(nameLen==0) return -1;
+		for(;*p==' '||*p=='\t';p++);
+		value=NULL;
+		valueLen=0;
+		if(*p=='=')
 		{
-			printf("\nthe %d layer is: ",layer);
-			lastlayer=layer;
+			for(p++;*p==' '||*p=='\t';p++);
+			if(*p!='"'&&*p!='\'') return -1;
+			quote=*p++;
+			for(value=p;*p!='\0'&&*p!=quote;p++);
+			if(*p=='\0') return -1;
+			valueLen=p-value;
+			for(p++;*p==' '||*p=='\t';p++);
 		}
-		printf("state %d  parent %d;",node->state,node->parent->state);
-		buttom=(buttom+1)%MAX_SIZE;
-		if(node->children!=NULL){
-		for(i=0;i<=stateCount;i++)
+		if(negated==1)
+		{
+			if(*p++!=')') return -1;
+			for(;*p==' '||*p=='\t';p++);
+		}
+		if(*p++!=']') return -1;
+		for(k=0;k<query->predCount;k++)
 		{
-			if(node->children[i]!=NULL)
-		    {
-				element.node=node->children[i];
-				element.layer=layer+1;
-				queue[(top+1)%MAX_SIZE]=element;
-				top=(top+1)%MAX_SIZE;
-		    }
+			if(query->preds[k].nameLen==nameLen&&memcmp(query->preds[k].name,name,nameLen)==0&&(query->preds[k].value==NULL)==(value==NULL)&&query->preds[k].negated==negated
+				&&(value==NULL||(query->preds[k].valueLen==valueLen&&memcmp(query->preds[k].value,value,valueLen)==0))) break;
 		}
+		if(k==query->predCount)
+		{
+			if(query->predCount>=MAX_PRED) return -1;
+			query->preds[k].name=(char*)malloc((nameLen+1)*sizeof(char));
+			memcpy(query->preds[k].name,name,nameLen);
+			query->preds[k].name[nameLen]='\0';
+			query->preds[k].nameLen=nameLen;
+			query->preds[k].value=NULL;
+			query->preds[k].valueLen=0;
+			if(value!=NULL)
+			{
+				query->preds[k].value=(char*)malloc((valueLen+1)*sizeof(char));
+				memcpy(query->preds[k].value,value,valueLen);
+				query->preds[k].value[valueLen]='\0';
+				query->preds[k].valueLen=valueLen;
+			}
+			query->preds[k].negated=negated;
+			if(negated==1) query->negatedPreds|=(PredMask)1<<k;
+			query->predCount++;
+		}
+		*preds|=(PredMask)1<<k;
 	}
+	return 0;
+}
+
+/*************************************************
+Function: int parse_aggregate(char** path);
+Description: take the aggregate function around an XPath, count(), sum(), min() or max(). count() counts the texts the XPath takes, 
+the others take the texts which are numbers(see text_number) and leave out the other texts.
+Called By: int createAutoMachine(Query* query, char* xmlPath);
+Input: path--the XPath as it is written
+Output: path--the XPath inside the parentheses, the close parenthesis is cut off
+Return: the aggregate function(see AGG_NONE); -1--the parenthesis is not closed
+*************************************************/
+int parse_aggregate(char** path)
+{
+	char *p,*close;
+	int k;
+	long len;
+	for(p=*path;*p==' '||*p=='\t';p++);
+	for(k=AGG_COUNT;k<=AGG_MAX;k++)
+	{
+		len=(long)strlen(aggregateNames[k]);
+		if(strncmp(p,aggregateNames[k],len)==0&&p[len]=='(') break;
 	}
-	printf("\n\n");
+	if(k>AGG_MAX) return AGG_NONE;
+	p+=len+1;
+	close=strrchr(p,')');
+	if(close==NULL) return -1;
+	for(len=1;close[len]==' '||close[len]=='\t';len++);
+	if(close[len]!='\0') return -1;   //something follows the function
+	*close='\0';
+	*path=p;
+	return k;
 }
 
 /*************************************************
-Function: void add_node(Node* node, Node* root);
-Description: add a node into the tree. Each tree node has at most one child for each state. 
-If a transition causes two child nodes to have the same symbol, then two nodes would be merged
-Called By: void push(Node* node, Node* root, int nextState);void pop(char * str, Node* root);
-Input: node--the current node would be added into the tree; root--the root of the tree.
+Function: unsigned int tag_hash(char* s, long len, unsigned int seed);
+Description: hash a tag name(FNV-1a started from the seed)
+Called By: void build_tag_table(Query* query); int tag_lookup(Query* query, char* s, long len); long sidecar_name(char* p, long len); 
+void bloom_add(SideBloom* bloom, char* p, long len); int bloom_test(SideBloom* bloom, char* p, long len);
+Input: s--the tag name; len--the length of the name; seed--the seed of the hash
+Return: the hash value
 *************************************************/
-void add_node(Node* node, Node* root) 
+unsigned int tag_hash(char* s, long len, unsigned int seed)
 {
-	Node* rtchild;
-	int i,j;
-    if(root->children[node->state]!=NULL)
-    {
-    	/*merge the children of node into the original node in the tree*/
-         for(i=0;i<=stateCount;i++)
-         {
-         	if(node->children[i]!=NULL ){
-         		rtchild=node->children[i];
-         		node->children[i]=NULL;
-         		rtchild->parent=NULL;
-         		add_node(rtchild,root->children[node->state]);
-		    }
-         }
-    }
-    else {
-    	root->children[node->state]=node;
-    	node->parent=root;
+	unsigned int h=2166136261u^seed;
+	long i;
+	for(i=0;i<len;i++)
+	{
+		h^=(unsigned char)s[i];
+		h*=16777619u;
 	}
-    
+	return h^(h>>15);
 }
 
 /*************************************************
-Function: void push(Node* node, Node* root, int nextState) ;
-Description: push new element into stack tree
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: node--the current node of the tree; root--the root of the tree; 
-nextState--the state for the next node which would be pushed on top of the current node;
+Function: unsigned long long content_hash(const char* p, long len, unsigned long long seed);
+Description: hash a text of any length in 64 bits(FNV-1a), it tells whether a query or a part of a file is the same one as before
+Called By: Query* xml_compile(const char* xpath); long load_state(const char* state_name); int save_state(const char* state_name, long offset); int cache_lookup(int i);
+Input: p--the text; len--the length of the text; seed--the seed of the hash
+Return: the hash value
 *************************************************/
-void push(Node* node, Node* root, int nextState) 
+unsigned long long content_hash(const char* p, long len, unsigned long long seed)
 {
-    Node* n;
-    int i;
-    n=(Node*)malloc(sizeof(Node));
-    n->state=node->state;
-    n->hasOutput=0;
-    n->output=(char*)malloc(MAX_OUTPUT*sizeof(char));
-    n->output=strcpy(n->output,"");
-    n->start_node=NULL;
-    n->finish_node=NULL;
-    node->state=nextState;
-    n->children=node->children;
-    if(node->isLeaf==1)
-    {
-    	node->start_node->finish_node=n;
-    	n->start_node=node->start_node;
-    	n->isLeaf=1;
-    	node->start_node=NULL;
-    	node->isLeaf=0;
+	unsigned long long h=14695981039346656037ull^seed;
+	long i;
+	for(i=0;i<len;i++)
+	{
+		h^=(unsigned char)p[i];
+		h*=1099511628211ull;
 	}
-    for(i=0;i<=stateCount;i++)
-    {
-    	if(n->children[i]!=NULL)
-    	{
-    		n->children[i]->parent=n;
+	return h;
+}
+
+/*************************************************
+Function: int build_tag_table(Query* query);
+Description: intern every tag name of the automata once, and look for a seed which gives each name its own slot in tagTable. 
+A name taken at several places of the prefix tree(in one XPath or in several) gets one id, which is kept for each of its steps. 
+If a step is *, the names not in the XPaths share one more id(otherTag), which is not in tagTable.
+Called By: int createAutoMachine(Query* query, char* xmlPath);
+Input: query--the query being compiled
+Output: tagSymbols, tagCount, tagTable, tagSeed, stepTags, wildcard and otherTag of the query
+Return: 0--success; -1--there are more than MAX_TAG names, otherTag counted
+*************************************************/
+int build_tag_table(Query* query)
+{
+	int s,id;
+	unsigned int h;
+	query->tagCount=0;
+	query->wildcard=0;
+	for(s=2;s<=query->stepCount;s++)
+	{
+		if((query->rootSteps>>s&1)==1)
+		{
+			query->stepTags[s]=-2;   //a root step takes no name
+			continue;
+		}
+		if(strcmp(query->stateMachine[2*s-3].str,"*")==0)
+		{
+			query->stepTags[s]=-1;
+			query->wildcard=1;
+			continue;
+		}
+		for(id=0;id<query->tagCount;id++)
+		{
+			if(strcmp(query->tagSymbols[id].name,query->stateMachine[2*s-3].str)==0) break;
+		}
+		if(id==query->tagCount)
+		{
+			if(query->tagCount>=MAX_TAG) return -1;
+			query->tagSymbols[id].name=query->stateMachine[2*s-3].str;
+			query->tagSymbols[id].len=strlen(query->stateMachine[2*s-3].str);
+			query->tagCount++;
 		}
+		query->stepTags[s]=id;
 	}
-    node->start_node=NULL;
-    node->children=NULL;
-    node->children=(Node**)malloc(stateCount*sizeof(Node*));
-    node->children[n->state]=n;
-    n->parent=node;
- 
-    for(i=0;i<=stateCount;i++ )
-    {
-    	if(i!=n->state)
-    	   node->children[i]=NULL;
+	for(query->tagSeed=0;;query->tagSeed++)
+	{
+		memset(query->tagTable,0,sizeof(query->tagTable));
+		for(id=0;id<query->tagCount;id++)
+		{
+			h=tag_hash(query->tagSymbols[id].name,query->tagSymbols[id].len,query->tagSeed)&(TAG_TABLE-1);
+			if(query->tagTable[h]!=0) break;   //collision, try the next seed
+			query->tagTable[h]=id+1;
+		}
+		if(id==query->tagCount) break;
 	}
-
-    add_node(node,root);
+	query->otherTag=-1;
+	if(query->wildcard==1)
+	{
+		if(query->tagCount>=MAX_TAG) return -1;
+		query->otherTag=query->tagCount++;
+		query->tagSymbols[query->otherTag].name="*";
+		query->tagSymbols[query->otherTag].len=0;   //no name in the XML text is compared with it
+	}
+	return 0;
 }
 
 /*************************************************
-Function: int checkChildren(Node* node);
-Description: check if a node has children
-Called By: void pop(char * str, Node* root);
-Input: node--the original node;
-Return: the number of children; -1--no child
+Function: int build_dfa(Query* query);
+Description: get the deterministic automata run by the stack trees ready. A state is a set of steps: the steps whose element is the current one, 
+and the steps whose descendants are still looked for(the parents of the steps after //). The sets are built on demand from the start state(see dfa_build), 
+so only the sets reached by the tag names become states, and every transition is kept in nextState, each tag costs one look-up as before. 
+The automata does not run on the tag names but on symbols: a name taken by steps with predicates has one symbol for each set of those steps whose predicates 
+hold(see tag_symbol), so the predicates are decided while the start tag is lexed and cost nothing more once the tag is pushed. A name with no such step has one symbol. 
+A tag leaves the steps of the classes which do not hold its name(see path_class) as they are, so each XPath sees the tags it would see run alone. 
+Every state reached from state 1 is built here if they all fit, so such a query runs without building any. Otherwise, as with many XPaths after //, 
+only the first COMPILED_STATES states are built, and each run builds the ones its input reaches(see tag_move). Without //, every state holds one step and takes its number.
+Called By: int createAutoMachine(Query* query, char* xmlPath);
+Input: query--the query being compiled
+Output: the symbols and the automata(dfa) of the query
+Return: 0--success; -1--there are more symbols than the automata could take
 *************************************************/
-int checkChildren(Node* node) 
+int build_dfa(Query* query)
 {
-	int i;
-	for(i=0;i<=stateCount;i++)
+	ChildMask m;
+	int t,s,c,n,d,limit;
+	query->symbolCount=0;
+	for(t=0;t<query->tagCount;t++)
 	{
-		if(node->children[i]!=NULL)
+		query->tagSymbols[t].predSteps=0;
+		query->tagSymbols[t].preds=0;
+		for(s=2;s<=query->stepCount;s++)
 		{
-			break;
+			if(query->stepPreds[s]==0||(query->stepTags[s]!=t&&query->stepTags[s]!=-1)) continue;
+			query->tagSymbols[t].predSteps|=(ChildMask)1<<s;
+			query->tagSymbols[t].preds|=query->stepPreds[s];
+		}
+		/*a class with no step taking the name leaves its steps as they are below the tag*/
+		query->tagSymbols[t].passSteps=0;
+		for(c=0;c<query->classCount;c++)
+		{
+			for(m=query->classSteps[c]&~query->rootSteps;m!=0&&query->stepTags[mask_low(m)]!=t&&query->stepTags[mask_low(m)]!=-1;m&=m-1);
+			if(m==0) query->tagSymbols[t].passSteps|=query->classSteps[c];
+		}
+		n=mask_count(query->tagSymbols[t].predSteps);
+		if(n>=8||query->symbolCount+(1<<n)>MAX_SYMBOL) return -1;
+		query->tagSymbols[t].symbol=query->symbolCount;
+		for(c=0;c<1<<n;c++)
+		{
+			query->symbolTags[query->symbolCount+c]=t;
 		}
+		query->symbolCount+=1<<n;
 	}
-	if(i<=stateCount)  return i;
-	else return -1;
+	/*all the states are tried first, and if they do not fit, the first ones are built again in the same order*/
+	for(limit=MAX_STATE;;limit=COMPILED_STATES)
+	{
+		memset(&query->dfa,0,sizeof(Dfa));
+		query->dfa.complete=1;
+		dfa_add(query,&query->dfa,query->rootSteps,0);   //state 1 is outside the root element, state 0 holds no step
+		for(d=1;d<=query->dfa.stateCount;d++)
+		{
+			for(s=0;s<query->symbolCount;s++)
+			{
+				if(dfa_build(query,&query->dfa,d,s,limit)==-1) query->dfa.complete=0;
+			}
+		}
+		if(query->dfa.complete==1||limit==COMPILED_STATES) break;
+	}
+	return 0;
 }
 
 /*************************************************
-Function: void pop(char * str, Node* root);
-Description: if type of the xml element is End Tag(e.g </xxx>) and the content of the tag could be found in the automata, 
-then this function would delete the related node from the finishing stack tree. If no such node exists, a new node is created 
-in the start tree, thus pushing the next state on the starting stack tree.
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: str-the content of the xml element; root-the root of the tree;
+Function: int dfa_add(Query* query, Dfa* dfa, ChildMask steps, ChildMask carry);
+Description: add a state to an automata, none of its transitions is built yet. The state is filled before stateCount is raised, 
+so a thread which finds the state through stateCount or nextState sees it whole.
+Called By: int build_dfa(Query* query); int dfa_build(Query* query, Dfa* dfa, int state, int symbol, int limit);
+Input: query--the compiled query; dfa--the automata; steps--the steps whose element is the current one; carry--the steps whose descendants are still looked for
+Return: the new state
 *************************************************/
-void pop(char * str, Node* root) //pop element due to end_tag e.g</d>
+int dfa_add(Query* query, Dfa* dfa, ChildMask steps, ChildMask carry)
 {
-    int i,j,begin,next;
-    int flag=0;
-    Node * n;
-    int isoutput=0;
-    int k;
-    for(j=machineCount;j>=1;j=j-2)
-    {
-        if(strcmp(str,stateMachine[j].str)==0)
-        {
-            break;
-		}
+	ChildMask m;
+	int k=dfa->stateCount+1;
+	int s;
+	dfa->stateSteps[k]=steps;
+	dfa->stateCarry[k]=carry;
+	memset(dfa->nextState[k],0xff,sizeof(dfa->nextState[k]));   //-1 for every symbol
+	dfa->stateTags[k]=0;
+	dfa->stateQueries[k]=0;
+	for(m=steps;m!=0;m&=m-1)
+	{
+		s=mask_low(m);
+		if(s>1) dfa->stateQueries[k]|=query->stateMachine[2*s-2].queries;
+	}
+	if(dfa->stateQueries[k]!=0) __atomic_or_fetch(&dfa->acceptWords[k/64],1ULL<<(k%64),__ATOMIC_RELAXED);
+	if((dfa->stateQueries[k]&~query->aggregateMask)!=0) __atomic_or_fetch(&dfa->spanWords[k/64],1ULL<<(k%64),__ATOMIC_RELAXED);
+	__atomic_store_n(&dfa->stateCount,k,__ATOMIC_RELEASE);
+	return k;
+}
+
+/*************************************************
+Function: void dfa_next(Query* query, Dfa* dfa, int state, int symbol, ChildMask* steps, ChildMask* carry);
+Description: find the steps of the state a symbol enters from a state, nothing is built
+Called By: int dfa_build(Query* query, Dfa* dfa, int state, int symbol, int limit); int tag_from(int id, int from, int to);
+Input: query--the compiled query; dfa--the automata; state--the state before the tag; symbol--the symbol of the tag(see tag_symbol)
+Output: steps--the steps whose element is the tag; carry--the steps whose descendants are still looked for, both 0--the symbol is not taken in this state
+*************************************************/
+void dfa_next(Query* query, Dfa* dfa, int state, int symbol, ChildMask* steps, ChildMask* carry)
+{
+	ChildMask m,met;
+	int t,s,c,i;
+	t=query->symbolTags[symbol];
+	c=symbol-query->tagSymbols[t].symbol;
+	/*bit i of c tells if the predicates of the i-th step in predSteps hold*/
+	met=0;
+	for(m=query->tagSymbols[t].predSteps,i=0;m!=0;m&=m-1,i++)
+	{
+		if((c>>i&1)==1) met|=m&(~m+1);
+	}
+	*carry=dfa->stateCarry[state]|(dfa->stateSteps[state]&query->descendParents&~query->tagSymbols[t].passSteps);
+	*steps=dfa->stateSteps[state]&query->tagSymbols[t].passSteps;
+	for(s=2;s<=query->stepCount;s++)
+	{
+		if(query->stepTags[s]!=t&&query->stepTags[s]!=-1) continue;
+		if(query->stepPreds[s]!=0&&(met>>s&1)==0) continue;
+		m=(query->stateMachine[2*s-3].descendant==1)?*carry:dfa->stateSteps[state];
+		if((m>>query->stateMachine[2*s-3].start&1)==1) *steps|=(ChildMask)1<<s;
 	}
-	if(j>=1)
+}
+
+/*************************************************
+Function: int dfa_build(Query* query, Dfa* dfa, int state, int symbol, int limit);
+Description: build the transition of a symbol from a state, and the state it enters if it is a new set of steps. 
+The tag records that it enters the state(see tag_from), and a state entered by the same tag from two states makes the mapping of a part 
+depend on the stack below its start state(see stackMapping). A run calls it with dfaLock taken.
+Called By: int build_dfa(Query* query); int tag_move(int symbol, int state, int build);
+Input: query--the compiled query; dfa--the automata; state--the state before the tag; symbol--the symbol of the tag(see tag_symbol); limit--the states may be numbered up to limit-1
+Return: the state entered by the symbol; 0--the symbol is not taken in this state; -1--the state would be numbered limit or more, it is not built
+*************************************************/
+int dfa_build(Query* query, Dfa* dfa, int state, int symbol, int limit)
+{
+	ChildMask steps,carry;
+	int t,k,d,j;
+	if(dfa->nextState[state][symbol]!=-1) return dfa->nextState[state][symbol];
+	dfa_next(query,dfa,state,symbol,&steps,&carry);
+	t=query->symbolTags[symbol];
+	k=0;
+	if(steps!=0||carry!=0)
 	{
-		begin=stateMachine[j].start;
-		next=stateMachine[j].end;
-		j=begin;
-		if(j<=stateCount)
+		for(k=2;k<=dfa->stateCount;k++)
+		{
+			if(dfa->stateSteps[k]==steps&&dfa->stateCarry[k]==carry) break;
+		}
+		if(k>dfa->stateCount)
 		{
-			n=root->children[j]->children[next];  //for state j
-			if(n!=NULL&&n->state==next)
+			if(dfa->stateCount+1>=limit) return -1;
+			k=dfa_add(query,dfa,steps,carry);
+		}
+		/*the end tag does not tell which symbol its start tag was, so the other states the name enters k from are looked for*/
+		for(d=1;d<=dfa->stateCount&&dfa->stackMapping==0;d++)
+		{
+			if(d==state) continue;
+			for(j=query->tagSymbols[t].symbol;j<query->tagSymbols[t].symbol+(1<<mask_count(query->tagSymbols[t].predSteps));j++)
 			{
-				if(root->children[j]->hasOutput==1)
-				{					
-					if(n->hasOutput==1)
-					    n->output=strcat(n->output," ");
-					else n->hasOutput=1;					
-					n->output=strcat(n->output,root->children[j]->output);
-					if(root->children[j]->output!=NULL) free(root->children[j]->output);
-					root->children[j]->output=NULL;
-					root->children[j]->hasOutput=0;
-				}
-				n->parent=NULL;
-				root->children[j]->children[next]=NULL;
-				add_node(n,root);
-
-				if(checkChildren(root->children[j])==-1)
-				{
-					if(root->children[j]!=NULL) free(root->children[j]);
-					root->children[j]=NULL;
-					flag=1;
-				}
-				if(root->children[0]!=NULL)
-				{
-					for(i=stateCount;i>=0;i--)  //for state0
-				    {
-				        	
-					    if(root->children[0]->children[i]!=NULL)
-					    {
-
-					        n=root->children[0]->children[i];
-					        n->parent=NULL;
-					        root->children[0]->children[i]=NULL;
-					        if(i==0){
-					            if(root->children[0]!=NULL) {
-								    free(root->children[0]);
-								}
-					            root->children[0]=NULL;
-							}
-					        add_node(n,root);
-						}
-			     	}
-			   } 
+				if(dfa->nextState[d][j]==k) dfa->stackMapping=1;
 			}
-			else if(flag==0) //not in final tree, add it into the start tree
-			   {
-			   	    n=root->children[begin]->start_node;
-			   	    if(n!=NULL)
-				    {
-				    	if(root->children[next]->start_node!=NULL)
-				    	{
-				            Node* ns=(Node*)malloc(sizeof(Node));
-                            ns->state=begin;
-                            ns->parent=n->parent;
-                            ns->children=NULL;
-                            ns->start_node=NULL;
-				    		n->children[next]=root->children[next]->start_node;  //for pop node
-				    		root->children[next]->start_node->parent->children[next]=NULL;
-                            root->children[next]->start_node->parent=n;
-                            ns->finish_node=root->children[begin];
-                            if(root->children[begin]->hasOutput==1)
-				            {
-					            root->children[next]->hasOutput=1;
-					            root->children[next]->output=strcpy(ns->finish_node->output,root->children[begin]->output);
-					            
-					            root->children[begin]->hasOutput=0;
-				            }
-                            root->children[begin]->start_node=ns;
-                            //for pop node 0
-                            n=root->children[0]->start_node;
-                            n->children=(Node**)malloc(sizeof(Node));
-                            for(k=0;k<=stateCount;k++)
-                            {
-                            	n->children[k]=NULL;
-							}
-                            ns=NULL;
-                            
-                            if(n!=NULL)
-                            {
-                            	for(i=0;i<=stateCount;i++)
-                            	{
-                            		if(i==next)
-									{
-										continue;
-									} 
-                            		if(i==0)
-                            		{
-                            			ns=(Node*)malloc(sizeof(Node));
-                                        ns->state=i;
-                                        ns->parent=n;
-                                        ns->children=NULL;
-                                        ns->start_node=NULL;
-                                        n->children[i]=ns;
-                                        ns->finish_node=root->children[0];
-                                        root->children[0]->start_node=ns;
-									}
-										
-									if(i!=0){
-                                        if(i!=begin)
-										{
-                                        	root->children[i]->start_node->parent->children[i]=NULL;
-										}
-                                        root->children[i]->start_node->parent=n;
-										n->children[i]=root->children[i]->start_node;  //for next state
-                                    }
-								}
-							}
-						}
-					}
-				}
 		}
-	}      
+		__atomic_or_fetch(&dfa->stateTags[k],(TagMask)1<<t,__ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&dfa->nextState[state][symbol],k,__ATOMIC_RELEASE);
+	return k;
 }
 
 /*************************************************
-Function: char * convertTokenTypeToStr(xml_TokenType type);
-Description: convert the XML token type from digit to the real string for output
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: type--the enumeration for the type of XML
-Return: the output string for this type
+Function: int tag_lookup(Query* query, char* s, long len);
+Description: find the id of a tag name with one hash and one comparison, the name is not copied
+Called By: int tag_id(Query* query, char* s, long len);
+Input: query--the compiled query; s--the tag name in the XML text; len--the length of the name
+Return: the tag id; -1--the name is not in the XPath
 *************************************************/
-char * convertTokenTypeToStr(xml_TokenType type)
+int tag_lookup(Query* query, char* s, long len)
 {
+	int id;
+	if(len<=0) return -1;
+	id=query->tagTable[tag_hash(s,len,query->tagSeed)&(TAG_TABLE-1)]-1;
+	if(id<0||query->tagSymbols[id].len!=len||memcmp(query->tagSymbols[id].name,s,len)!=0) return -1;
+	return id;
+}
 
-	if(type<MAX_ATT_NUM) return tokenValue[type];
-	else return defaultToken;
+/*************************************************
+Function: int tag_id(Query* query, char* s, long len);
+Description: find the id of a start or end tag, the slash of an end tag is skipped. 
+If a step is *, a name not in the XPaths takes otherTag instead of being skipped, as the * step takes it.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); 
+int walk_index(ResultSet* set); int open_sidecar(char* file_name);
+Input: query--the compiled query; s--the tag name in the XML text(with the slash for an end tag); len--the length of the name
+Return: the tag id; -1--the name is not in the XPath
+*************************************************/
+int tag_id(Query* query, char* s, long len)
+{
+	int id;
+	if(len>0&&s[0]=='/') id=tag_lookup(query,s+1,len-1);
+	else id=tag_lookup(query,s,len);
+	if(id==-1&&query->wildcard==1&&len>0&&!(s[0]=='/'&&len==1)) return query->otherTag;
+	return id;
 }
 
 /*************************************************
-Function: int xml_initText(xml_Text *pText, char *s);
-Description: initiate a xml_Text for a string loading from original XML file
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--the xml_Text element waiting to be initialized; s--the XML string;
-Output: pText--the initialized xml_Text
-Return: 0--success
+Function: PredMask attr_match(Query* query, int id, char* name, long nameLen, char* value, long valueLen);
+Description: compare an attribute of a start tag with the predicates of the steps which could take the tag(see parse_predicates), 
+the attribute is not copied, and a tag whose steps hold no predicate is not compared at all
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); PredMask index_attrs(int id, char* p, char* end);
+Input: query--the compiled query; id--the tag id; name--the name of the attribute; nameLen--the length of the name; value--the value without the quotes; valueLen--the length of the value
+Return: the predicates met by the attribute, bit k for query->preds[k]
 *************************************************/
-int xml_initText(xml_Text *pText, char *s)
+PredMask attr_match(Query* query, int id, char* name, long nameLen, char* value, long valueLen)
 {
-    pText->p = s;
-    pText->len = strlen(s);
-    return 0;
+	PredMask m,met=0;
+	Predicate* pred;
+	int k;
+	for(m=query->tagSymbols[id].preds;m!=0;m&=m-1)
+	{
+		k=__builtin_ctzll(m);
+		pred=&query->preds[k];
+		if(pred->nameLen!=nameLen||memcmp(pred->name,name,nameLen)!=0) continue;
+		if(pred->value==NULL||(pred->valueLen==valueLen&&memcmp(pred->value,value,valueLen)==0)) met|=(PredMask)1<<k;
+	}
+	return met;
 }
 
 /*************************************************
-Function: xml_initToken(xml_Token *pToken, xml_Text *pText);
-Description: initiate a xml_Token for a initialized xml_Text
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pToken--the xml_Token element waiting to be initialized; pText--input xml_Text;
-Output: pToken--the initialized xml_Token
-Return: 0--success
+Function: int tag_symbol(Query* query, int id, PredMask met);
+Description: find the symbol of a start tag once its attributes are compared with the predicates(see build_dfa), 
+a predicate in not() holds if its attribute is not met, so its bit is turned over here
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); int walk_index(ResultSet* set);
+Input: query--the compiled query; id--the tag id; met--the predicates met by the attributes of the tag(see attr_match)
+Return: the symbol
 *************************************************/
-int xml_initToken(xml_Token *pToken, xml_Text *pText)
+int tag_symbol(Query* query, int id, PredMask met)
 {
-    pToken->text.p = pText->p;
-    pToken->text.len = 0;
-    pToken->type = xml_tt_U;
-    return 0;
+	TagSymbol* tag=&query->tagSymbols[id];
+	ChildMask m;
+	int i,c=0;
+	met^=query->negatedPreds;
+	for(m=tag->predSteps,i=0;m!=0;m&=m-1,i++)
+	{
+		if((query->stepPreds[mask_low(m)]&~met)==0) c|=1<<i;   //every predicate of the step holds
+	}
+	return tag->symbol+c;
 }
 
 /*************************************************
-Function: int xml_print(xml_Text *pText, int begin, int end);
-Description: print the substring of a xml_Text
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--input xml_Text; begin--start position; end--end position;
-Output: the substring of a xml_Text
-Return: 0--success
+Function: int tag_move(int symbol, int state, int build);
+Description: run the automata of the run for a start tag. A transition not built yet is built under dfaLock(see dfa_build), 
+so a run builds only the states its input reaches, and each of them once whichever part reaches it first. A new state is built only 
+where the state before the tag is known to be right, otherwise the states assumed by a part would build states the input never reaches. 
+If the run would need more than MAX_STATE-1 states the tag is not taken, and the run fails(see full).
+Called By: void start_tag(int symbol, int thread_num); void index_push(int symbol); int tag_from(int id, int from, int to);
+Input: symbol--the symbol of the tag(see tag_symbol); state--the state before the tag; build--1 if a new state may be built
+Return: the state entered by the tag; 0--the tag is not taken in this state; -1--the tag enters a state not built yet and build is 0
 *************************************************/
-int xml_print(xml_Text *pText, int begin, int end)
+int tag_move(int symbol, int state, int build)
 {
-    int i;
-    char * temp=pText->p;
-    temp = ltrim(pText->p);
-    int j=0;
-    for (i = begin; i < end; i++)
-    {
-        putchar(temp[i]);
-    }
-    return 0;
+	int next=__atomic_load_n(&ctx->dfa.nextState[state][symbol],__ATOMIC_ACQUIRE);
+	if(next!=-1) return next;
+	pthread_mutex_lock(&ctx->dfaLock);
+	next=dfa_build(ctx->query,&ctx->dfa,state,symbol,(build==1)?MAX_STATE:ctx->dfa.stateCount+1);
+	if(next==-1&&build==1)
+	{
+		ctx->dfa.full=1;
+		next=0;
+	}
+	pthread_mutex_unlock(&ctx->dfaLock);
+	return next;
 }
 
 /*************************************************
-Function: char* substring(char *pText, int begin, int end);
-Description: print the substring of the original string
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--the original string; begin--start position; end--end position;
-Return: the final string
+Function: int tag_from(int id, int from, int to);
+Description: tell how a tag moves the automata from a state. The end tag does not tell which symbol its start tag was, so every symbol of the name is tried. 
+A transition not built yet is built only if it enters to or state 0, so a pop builds no state(see dfa_next).
+Called By: void pop(int id, Node* root, int thread_num); void index_pop(int id);
+Input: id--the tag id; from--the state before the tag; to--the state looked for
+Return: bit 0--a symbol of the tag enters to from from; bit 1--a symbol is not taken in from(the tag pushes state 0 there)
 *************************************************/
-char* substring(char *pText, int begin, int end)
+int tag_from(int id, int from, int to)
 {
-    int i,j;
-    char * temp=pText;
-    temp = ltrim(pText);
-    char* temp1=(char*)malloc((end-begin+1)*sizeof(char));
-    for (j = 0,i = begin; i < end; i++,j++)
-    {
-        temp1[j]=temp[i];
-    }
-    temp1[j]='\0';
-    return temp1;
+	TagSymbol* tag=&ctx->query->tagSymbols[id];
+	ChildMask steps,carry;
+	int c,next,ret=0;
+	for(c=tag->symbol;c<tag->symbol+(1<<mask_count(tag->predSteps));c++)
+	{
+		next=__atomic_load_n(&ctx->dfa.nextState[from][c],__ATOMIC_ACQUIRE);
+		if(next==-1)
+		{
+			dfa_next(ctx->query,&ctx->dfa,from,c,&steps,&carry);
+			if((steps|carry)==0||(to>1&&steps==ctx->dfa.stateSteps[to]&&carry==ctx->dfa.stateCarry[to])) next=tag_move(c,from,0);
+		}
+		if(next==to) ret|=1;
+		if(next==0) ret|=2;
+	}
+	return ret;
 }
 
 /*************************************************
-Function: char * ltrim(char *s);
-Description: remove the left blankets of a string
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: s--the original string; 
-Return: the final substring
+Function: ChildMask mask_words(unsigned long long* words);
+Description: read a mask of states kept in words(see acceptWords), a state built meanwhile is either in it or not, and a state in a tree is always in it
+Called By: void text_output(Node* root, int thread_num, long offset, long len); the functions which look at the states holding the last step of an XPath
+Input: words--the words of the mask
+Return: the mask
 *************************************************/
-char * ltrim(char *s)
+ChildMask mask_words(unsigned long long* words)
 {
-     char *temp;
-     temp = s;
-     while((*temp == ' ' || *temp=='\t' )&&temp){*temp++;}
-     return temp;
+	ChildMask m=0;
+	int i;
+	for(i=MASK_WORDS-1;i>=0;i--)
+	{
+		m=(m<<32<<32)|__atomic_load_n(&words[i],__ATOMIC_RELAXED);   //two shifts, as ChildMask may be only 64 bits
+	}
+	return m;
 }
 
 /*************************************************
-Function: int left_null_count(char *s);
-Description: calculate the number of blanket for each string
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: s--the original string; 
-Return: the number of blanket for each string
+Function: void* arena_alloc(int slot, long size);
+Description: carve zeroed memory out of the arena of a slot. Only the thread which owns the slot allocates from it, so no lock is taken, 
+and a new block is taken from the spare blocks or malloc only when the current one is used up.
+Called By: Node* node_alloc(int slot); Node** children_alloc(int slot, int cap);
+Input: slot--the slot of the stack tree; size--the number of bytes
+Return: the memory, which is freed only by arena_reset
 *************************************************/
-int left_null_count(char *s)  
+void* arena_alloc(int slot, long size)
 {
-	 int count=0;
-     char *temp;
-     temp = s;
-     while((*temp == ' ' || *temp=='\t' )&&temp){*temp++; count++;}
-     return count;
+	Arena* arena=&ctx->arenas[slot];
+	ArenaBlock* block=arena->head;
+	long bsize;
+	void* p;
+	size=(size+15)&~15L;
+	if(block==NULL||block->used+size>block->size)
+	{
+		if(arena->spare!=NULL&&arena->spare->size>=size)
+		{
+			block=arena->spare;
+			arena->spare=block->next;
+		}
+		else
+		{
+			bsize=(size>ARENA_BLOCK)?size:ARENA_BLOCK;
+			block=(ArenaBlock*)malloc(sizeof(ArenaBlock)+bsize);
+			block->size=bsize;
+		}
+		block->used=0;
+		block->next=arena->head;
+		arena->head=block;
+	}
+	p=block->data+block->used;
+	block->used+=size;
+	memset(p,0,size);
+	return p;
 }
 
 /*************************************************
-Function: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Description: the function could be called by each thread, dealing with each line of the file. Besides, this function could identify the following elements, 
-which include XML head, Start Tag(e.g <xxx>), End Tag(e.g </xxx>), Tag(e.g <xxx/>), Content for the Tag, XML Explanation, Attribute Name for Tag, 
-Attribute Value for Tag, Content for CDATA element. Each element would be processed according to its type. 
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText-the content of the xml file; pToken-the type of the current xml element; multilineExp-whether the current line of the xml file is the multiline explanation; 
-multilineCDATA-- whether the current line of the xml file is the multiline CDATA; thread_num-the number of the thread; 
-Return: 0--success -1--error 1--multiline explantion 2--multiline CDATA
+Function: void arena_reset(int slot);
+Description: give back all the nodes, children arrays and output spans of a slot in one shot, the blocks are kept as spare blocks for the next stack tree of the slot
+Called By: void free_tree(int thread_num); int walk_index(ResultSet* set); int load_tree(int i, char* blob, long size);
+Input: slot--the slot of the stack tree
 *************************************************/
-int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num)  
+void arena_reset(int slot)
 {
-	Node * tempnode=finish_root[thread_num];
-    char *start = pToken->text.p + pToken->text.len;
-    char *p = start;
-    char *end = pText->p + pText->len;
-    int state = 0;
-    int templen = 0;
-    if(multilineExp == 1) state = 10;   //1--multiline explantion  0--single line explantion
-    if(multilineCDATA == 1) state = 17; //1--multiline CDATA 0--single CDATA
-    int j,a;
-    Node* node;
+	Arena* arena=&ctx->arenas[slot];
+	ArenaBlock* block;
+	while(arena->head!=NULL)
+	{
+		block=arena->head;
+		arena->head=block->next;
+		block->next=arena->spare;
+		arena->spare=block;
+	}
+}
 
-    pToken->text.p = p;
-    pToken->type = xml_tt_U;
-    
-    for (; p < end; p++)
-    {
-        switch(state)
-        {
-            case 0:
-               switch(*p)
-               {
-                   case '<':
-                   	   
-                       state = 1;
-                       break;
-                   case ' ':
-                   	   state = 0;
-                   	   break;
-                   default:
-                       state = 7;
-                       break; 
-               }
-            break;
-            case 1:
-               switch(*p)
-               {
-                   case '?':
-                       state = 2;
-                       break;
-                   case '/':
-                       state = 4;
-                       break;
-                   case '!':
-                   	   state = 8;
-                   	   break;
-                   case ' ':
-                   	   state = -1;
-                   	   break;
-                   default:
-                       state = 5;
-                       break;
-               }
-            break;
-            case 2:
-               switch(*p)
-               {
-                   case '?':
-                       state = 3;
-                       break;
-                   default:
-                       state = 2;
-                       break;
-               }
-            break;
-            case 3:
-               switch(*p)
-               {
-               	   putchar(*p);
-                   case '>':                        /* Head <?xxx?>*/
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_H;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       templen = pToken->text.len;
-                       //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       //xml_print(&pToken->text, 0 ,pToken->text.len);
-                       //printf(";\n\n");
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   default:
-                       state = -1;
-                       break;
-               }
-               break;
-            case 4:
-                switch(*p)
-                {
-                   case '>':              /* End </xxx> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_E;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       //xml_print(&pToken->text, 2 , pToken->text.len-1);
-                       //printf(";\n\n");
-                       
-                       char* subs=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));
-					   if(subs!=NULL){
-					       for(j=machineCount;j>=1;j=j-2)
-                           {
-                               if(strcmp(subs,stateMachine[j].str)==0)
-                                  break;
-	                       }
-	                       if(j>=1){
-                               pop(subs,finish_root[thread_num]);
-                           }
-                           free(subs);
-                       }
-                       pToken->text.p = start + pToken->text.len;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   case ' ':
-                   	   state = -1;
-                   	   break;
-                   default:
-                       state = 4;
-                       break;
-                }
-                break;
-            case 5:
-                switch(*p)
-                {
-                   case '>':               /* Begin <xxx> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_B;
-                       if(pToken->text.len-1 >= 1){
-                       	   //layer++;
-                       	   //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                           //printf("%s","content=");
-                           templen = pToken->text.len;
-                           //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                           
-                       	   //xml_print(&pToken->text , 1 , pToken->text.len-1);
-                       	   
-                           //printf(";\n\n");
-                           char* sub=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));
-                           
-                           for(j=machineCount-1;j>=1;j=j-2)
-                           {
-                           	   if(strcmp(sub,stateMachine[j].str)==0)
-                           	   {
-                           	      break;
-							   }
-						   }
-                            if(sub!=NULL)  free(sub);
-						   if(j>=1)  
-						   {
-						   	    int a;
-						   	    for(a=0;a<=stateCount;a++)  //for state0
-						   	    {
-						   	    	if(a!=stateMachine[j].start&&finish_root[thread_num]->children[a]!=NULL)
-						   	    	{
-						   	    		node=finish_root[thread_num]->children[a];
-                                        finish_root[thread_num]->children[a]=NULL;
-                                        push(node,finish_root[thread_num],0);
-									}
-								}
-								int begin=stateMachine[j].start;
-								int end=stateMachine[j].end;
-								node=finish_root[thread_num]->children[begin];
-								finish_root[thread_num]->children[begin]=NULL;
-								push(node,finish_root[thread_num],end);   //for state j								
-						   }
-					   }
-					   else templen = 1;
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       
-                       state = 0;
-                       break;
-                   case '/':
-                       state = 6;
-                       break;
-                   case ' ':                 /* Begin <xxx> */
-                   	   pToken->text.len = p - start + 1;
-                   	   templen = 0;
-                      // pToken->type = xml_tt_B;
-                       if(pToken->text.len-1 >= 1)
-                       {
-                       	   //layer++;
-                       	   //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       	   //printf("%s","content=");
-                       	   templen = pToken->text.len;
-                       	   //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       	   //xml_print(&pToken->text , 1 , pToken->text.len-1);
-                       	   //printf(";\n\n");
-                       	   char* sub=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));  
-                           for(j=machineCount-1;j>=1;j=j-2)
-                           {
-                           	   if(strcmp(sub,stateMachine[j].str)==0)
-                           	   {
-                           	      break;
-							   }
-						   }
-						   if(sub) free(sub);
-						   if(j>=1)   
-						   {
-						   	    int a;
-						   	    for(a=0;a<=stateCount;a++)  //for state0
-						   	    {
-						   	    	if(a!=stateMachine[j].start&&finish_root[thread_num]->children[a]!=NULL)
-						   	    	{
-						   	    		node=finish_root[thread_num]->children[a];
-                                        finish_root[thread_num]->children[a]=NULL;
-                                        push(node,finish_root[thread_num],0);
-									}
-								}
-								int begin=stateMachine[j].start;
-								int end=stateMachine[j].end;
-								node=finish_root[thread_num]->children[stateMachine[j].start];
-								finish_root[thread_num]->children[stateMachine[j].start]=NULL;
-								push(node,finish_root[thread_num],stateMachine[j].end);   //for state j
-						   }
-					   }
-					    
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                   	   state = 13;
-                   	   break;
-                   default:
-                       state = 5;
-                   break;
-                }
-                break;
-            case 6:
-                switch(*p)
-                {
-                   case '>':   /* Begin End <xxx/> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_BE;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer+1);
-                       //printf("%s","content=");
-                       templen = pToken->text.len;
-                       //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       //xml_print(&pToken->text , 1 , pToken->text.len-2);
-                       //printf(";\n\n");
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   default:
-                       state = -1;
-                   break;
-                } 
-                break;
-            case 7:
-                switch(*p)
-                {
-                   case '<':     /* Text xxx */
-                       p--;
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_T;
-                       
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       
-                       templen = pToken->text.len;
-                       //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       
-                       //xml_print(&pToken->text, 0 , pToken->text.len);
-                       //printf(";\n\n");
-                       for(j=1;j<stateCount;j++)
-                       {
-                       	   if(finish_root[thread_num]->children[j]!=NULL)
-                       	   {
-							    break;
-					       }
-					   }
-					   if(tempnode->children[j]->state>1){
-					       Node *childnode=tempnode->children[j];
-					       
-					       if(stateMachine[2*(finish_root[thread_num]->children[j]->state-1)].isoutput==1)
-					       {
-					       	   if(childnode->hasOutput==1)
-								  childnode->output=strcat(childnode->output," ");
-					           else childnode->hasOutput=1;
-					           char* sub=substring(pToken->text.p , 0 , pToken->text.len-left_null_count(pToken->text.p));
-					           childnode->output=strcat(childnode->output,sub);
-					            if(sub!=NULL) free(sub);
-					       }
-				       }
-				       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-				       
-                       break;
-                   
-                   default:
-                       state = 7;
-                       break;
-                }
-                break;
-            case 8:
-            	switch(*p)
-            	{
-            		case '-':
-            			state = 9;
-            			break;
-            		case '[':
-            			if(*(p+1)=='C'&&*(p+2)=='D'&&*(p+3)=='A'&&*(p+4)=='T'&&*(p+5)=='A')
-            			{
-            				state = 16;
-            				p += 5;
-            				break;
-						}
-						else
-						{
-							state = -1;
-							break;
-						}
-            		default:
-            			state = -1;
-            			break;
-				}
-			    break;
-			case 9:
-				switch(*p)
-				{
-					case '-':
-						state = 10;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 10:
-				switch(*p)
-				{
-					case '-':
-						state = 11;
-						break;
-					default:
-						state = 10;
-						break;
-				}
-			    break;
-			case 11:
-				switch(*p)
-				{
-					case '-':
-						state = 12;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 12:
-				switch(*p)
-				{
-					case '>':                            /* Comment <!--xx-->*/
-					    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_C;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        if(multilineExp == 1)
-                        {
-                        	strcat(multiExpContent[thread_num],pToken->text.p);
-                            //printf("%s",ltrim(multiExpContent[thread_num]));
-                            //printf("\n");
-                            memset(multiExpContent[thread_num], 0 , sizeof(multiExpContent[thread_num]));
-						}
-						/*else{
-							xml_print(&pToken->text , 0 , pToken->text.len);
-                            printf(";\n\n");
-						}*/
-						
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 0;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 13:
-				switch(*p)
-				{
-					case '>':
-						state = -1;
-						break;
-					case '=':                       /*attribute name*/
-					    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_ATN;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        //xml_print(&pToken->text, 0 , pToken->text.len-1);
-                        //printf(";\n\n");
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-						state = 14;
-						break;
-					default:
-						state = 13;
-						break;
-				}
-			    break;
-			case 14:
-				switch(*p)
-				{
-					case '"':                                       
-                   	    state = 15;
-						break;
-					case ' ':
-						state = 14;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 15:
-				switch(*p)
-				{
-					case '"':                        /*attribute value*/
-						pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_ATV;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        //xml_print(&pToken->text, 1 , pToken->text.len-1);
-                        //printf(";\n\n");
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 5;
-						break;
-					default:
-						state = 15;
-						break;
-				}
-			    break;
-			case 16:
-				switch(*p)
-				{
-					case '[':                                       
-                   	    state = 17;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 17:
-				switch(*p)
-				{
-					case ']':                                       
-                   	    state = 18;
-						break;
-					default:
-						state = 17;
-						break;
-				}
-			    break;	
-			case 18:
-				switch(*p)
-				{
-					case ']':                                       
-                   	    state = 19;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 19:
-				switch(*p)
-				{
-					case '>':                                       
-                   	    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_CDATA;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        if(multilineCDATA == 1)
-                        {
-                        	strcat(multiCDATAContent[thread_num],pToken->text.p);
-                        	/*for( j = 10;j < strlen(multiCDATAContent[thread_num]) - 3;j++)
-                        	{
-                        		if(multiCDATAContent[thread_num][j] == ']' && multiCDATAContent[thread_num][j+1] == ']') break;
-                        		putchar(multiCDATAContent[thread_num][j]);
-							}
-                            printf("\n");*/
-                            memset(multiCDATAContent[thread_num], 0 , sizeof(multiCDATAContent[thread_num]));
-						}
-						/*else{
-							xml_print(&pToken->text , 9 , pToken->text.len-3);
-                            printf(";\n\n");
-						}*/
-						
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 0;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-				
-            default:  
-                state = -1;
-                break;
-        }
-    }
-    if(state==-1) {return -1;}
-    /*else if(state == 10)
+/*************************************************
+Function: void arena_free(int slot);
+Description: free all the blocks of the arena of a slot, the ones in use and the spare ones
+Called By: void free_chunks();
+Input: slot--the slot of the stack tree
+*************************************************/
+void arena_free(int slot)
+{
+	Arena* arena=&ctx->arenas[slot];
+	ArenaBlock* block;
+	arena_reset(slot);
+	while(arena->spare!=NULL)
+	{
+		block=arena->spare;
+		arena->spare=block->next;
+		free(block);
+	}
+}
+
+/*************************************************
+Function: Node* node_alloc(int slot);
+Description: allocate a zeroed node in the arena of a slot
+Called By: createTree, createTree_first, createTree_merge, push and pop, load_tree
+Input: slot--the slot of the stack tree
+Return: the node
+*************************************************/
+Node* node_alloc(int slot)
+{
+	return (Node*)arena_alloc(slot,sizeof(Node));
+}
+
+/*************************************************
+Function: Node** children_alloc(int slot, int cap);
+Description: allocate a children array in the arena of a slot
+Called By: void child_set(Node* node, int state, Node* child, int slot); int load_tree(int i, char* blob, long size);
+Input: slot--the slot of the stack tree; cap--the number of children the array could hold
+Return: the children array
+*************************************************/
+Node** children_alloc(int slot, int cap)
+{
+	return (Node**)arena_alloc(slot,cap*sizeof(Node*));
+}
+
+/*************************************************
+Function: int mask_low(ChildMask m);
+Description: find the smallest state(or step) in a mask, the mask may be wider than the builtins of the compiler
+Called By: the functions of the stack trees and of the automata
+Input: m--the mask, it is not 0
+Return: the number of the lowest bit set
+*************************************************/
+int mask_low(ChildMask m)
+{
+#if defined(__SIZEOF_INT128__)
+	if((unsigned long long)m==0) return 64+__builtin_ctzll((unsigned long long)(m>>64));
+#endif
+	return __builtin_ctzll((unsigned long long)m);
+}
+
+/*************************************************
+Function: int mask_high(ChildMask m);
+Description: find the largest state in a mask
+Called By: void pop(int id, Node* root, int thread_num);
+Input: m--the mask, it is not 0
+Return: the number of the highest bit set
+*************************************************/
+int mask_high(ChildMask m)
+{
+#if defined(__SIZEOF_INT128__)
+	if((m>>64)!=0) return 127-__builtin_clzll((unsigned long long)(m>>64));
+#endif
+	return 63-__builtin_clzll((unsigned long long)m);
+}
+
+/*************************************************
+Function: int mask_count(ChildMask m);
+Description: count the states(or steps) in a mask
+Called By: the functions of the stack trees; int build_dfa(Query* query); int tag_symbol(Query* query, int id, PredMask met);
+Input: m--the mask
+Return: the number of bits set
+*************************************************/
+int mask_count(ChildMask m)
+{
+#if defined(__SIZEOF_INT128__)
+	return __builtin_popcountll((unsigned long long)m)+__builtin_popcountll((unsigned long long)(m>>64));
+#else
+	return __builtin_popcountll(m);
+#endif
+}
+
+/*************************************************
+Function: int child_count(Node* node);
+Description: count the children of a node, they are node->children[0] to node->children[count-1] in the order of their states
+Called By: print_tree, add_node, push, child_set and child_remove
+Input: node--the node
+Return: the number of children
+*************************************************/
+int child_count(Node* node)
+{
+	return mask_count(node->childMask);
+}
+
+/*************************************************
+Function: Node* child_get(Node* node, int state);
+Description: find the child of a node for a state, the child is placed after the children of the smaller states
+Called By: the functions of the stack trees; int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); ResultSet get_mapping(int thread_num, int start, ResultSet* before);
+Input: node--the node; state--the state of the child
+Return: the child; NULL--the node has no child for the state
+*************************************************/
+Node* child_get(Node* node, int state)
+{
+	ChildMask bit=(ChildMask)1<<state;
+	if((node->childMask&bit)==0) return NULL;
+	return node->children[mask_count(node->childMask&(bit-1))];
+}
+
+/*************************************************
+Function: void child_set(Node* node, int state, Node* child, int slot);
+Description: set the child of a node for a state, the children after it are moved up by one if it is a new child. 
+The array grows by doubling in the arena of the slot.
+Called By: the functions of the stack trees
+Input: node--the node; state--the state of the child; child--the child, NULL removes the child; slot--the slot of the tree(for its arena)
+*************************************************/
+void child_set(Node* node, int state, Node* child, int slot)
+{
+	ChildMask bit=(ChildMask)1<<state;
+	int k=mask_count(node->childMask&(bit-1));
+	int count=child_count(node);
+	Node** old;
+	if(child==NULL)
+	{
+		child_remove(node,state);
+		return;
+	}
+	if((node->childMask&bit)!=0)
+	{
+		node->children[k]=child;
+		return;
+	}
+	if(count>=node->childCap)
+	{
+		old=node->children;
+		node->childCap=(node->childCap==0)?2:2*node->childCap;
+		node->children=children_alloc(slot,node->childCap);   //the old array stays in the arena until the tree is released
+		if(count>0) memcpy(node->children,old,count*sizeof(Node*));
+	}
+	memmove(node->children+k+1,node->children+k,(count-k)*sizeof(Node*));
+	node->children[k]=child;
+	node->childMask|=bit;
+}
+
+/*************************************************
+Function: void child_remove(Node* node, int state);
+Description: remove the child of a node for a state, the children after it are moved down by one
+Called By: the functions of the stack trees; void child_set(Node* node, int state, Node* child, int slot);
+Input: node--the node; state--the state of the child
+*************************************************/
+void child_remove(Node* node, int state)
+{
+	ChildMask bit=(ChildMask)1<<state;
+	int k,count;
+	if((node->childMask&bit)==0) return;
+	k=mask_count(node->childMask&(bit-1));
+	count=child_count(node);
+	memmove(node->children+k,node->children+k+1,(count-k-1)*sizeof(Node*));
+	node->childMask&=~bit;
+}
+
+/*************************************************
+Function: void span_add(SpanList* list, int slot, long offset, long len, int state);
+Description: append a text to an output, the text is not copied but kept as a span of the input of the slot(see spanBase)
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); void index_output(IndexFrame* frame, long offset, long len); 
+void span_copy(SpanList* to, SpanList* from, int slot); int load_tree(int i, char* blob, long size);
+Input: list--the output; slot--the slot whose arena keeps the span; offset--the offset of the text from spanBase[slot]; len--the length of the text; 
+state--the state the text is found in
+*************************************************/
+void span_add(SpanList* list, int slot, long offset, long len, int state)
+{
+	Span* span=(Span*)arena_alloc(slot,sizeof(Span));
+	span->offset=offset;
+	span->len=len;
+	span->state=state;
+	span->next=NULL;
+	if(list->tail!=NULL) list->tail->next=span;
+	else list->head=span;
+	list->tail=span;
+}
+
+/*************************************************
+Function: void span_join(SpanList* to, SpanList* from);
+Description: hand all the texts of an output over to the end of another output without copying them, the first output becomes empty
+Called By: void pop(int id, Node* root, int thread_num); void index_pop(int j);
+Input: to--the output which takes the texts; from--the output which gives them
+*************************************************/
+void span_join(SpanList* to, SpanList* from)
+{
+	if(from->head==NULL) return;
+	if(to->tail!=NULL) to->tail->next=from->head;
+	else to->head=from->head;
+	to->tail=from->tail;
+	from->head=NULL;
+	from->tail=NULL;
+}
+
+/*************************************************
+Function: void span_copy(SpanList* to, SpanList* from, int slot);
+Description: append a copy of every text of an output to another output, the texts themselves are not copied
+Called By: void pop(int id, Node* root, int thread_num);
+Input: to--the output which takes the copies; from--the output which is copied; slot--the slot whose arena keeps the copies
+*************************************************/
+void span_copy(SpanList* to, SpanList* from, int slot)
+{
+	Span* span;
+	for(span=from->head;span!=NULL;span=span->next)
+	{
+		span_add(to,slot,span->offset,span->len,span->state);
+	}
+}
+
+/*************************************************
+Function: void hand_down(Node* node, int slot);
+Description: hand the output of a node down to each of its children, the node is shared by the stacks of its children, so each of them takes the texts. 
+The last child takes the output itself and the others take copies, the texts are appended after the older ones of the children.
+Called By: void add_node(Node* node, Node* root, int thread_num); void pop(int id, Node* root, int thread_num);
+Input: node--the node with children; slot--the slot whose arena keeps the copies
+*************************************************/
+void hand_down(Node* node, int slot)
+{
+	Node* child;
+	int i,count=child_count(node);
+	for(i=0;i<count;i++)
+	{
+		child=node->children[i];
+		child->hasOutput=1;
+		if(i<count-1) span_copy(&child->output,&node->output,slot);
+		else span_join(&child->output,&node->output);
+	}
+	node->hasOutput=0;
+}
+
+/*************************************************
+Function: Node* start_child(Node* node, int state);
+Description: get the child of a node of the start tree for a state. A child shared by several states(see pop) is kept under the first of them, 
+the others hold a node whose start_node is the shared child and whose finish_node is the node it was put under, so the child is followed 
+while it is still there and is gone with the assumption once it is moved.
+Called By: Node* map_stacks(int thread_num, int start, ResultSet* before, ResultSet* set); ResultSet get_mapping(int thread_num, int start, ResultSet* before);
+Input: node--the node of the start tree; state--the state of the child
+Return: the child; NULL--no such child or the shared child has been moved
+*************************************************/
+Node* start_child(Node* node, int state)
+{
+	Node* child=child_get(node,state);
+	if(child!=NULL&&child->start_node!=NULL)
+	{
+		child=(child_get(child->finish_node,state)==child->start_node)?child->start_node:NULL;
+	}
+	return child;
+}
+
+/*************************************************
+Function: void createTree(int thread_num);
+Description: initiate a stack tree for other thread other than the first thread
+Called By: void main_task(int i);for sequential version, called by void main_function();
+Input: thread_num--the number of the thread
+*************************************************/
+void createTree(int thread_num)
+{
+	Node* s;
+	Node* f;
+	int i,count;
+	ctx->start_root[thread_num]=node_alloc(thread_num);
+	ctx->finish_root[thread_num]=node_alloc(thread_num);
+	ctx->finish_root[thread_num]->state=-1;
+	count=__atomic_load_n(&ctx->dfa.stateCount,__ATOMIC_ACQUIRE);   //the states built later are not assumed(see tree_stale)
+	ctx->treeStates[thread_num]=count+1;
+	ctx->treeBelow[thread_num]=0;
+	ctx->treeMissed[thread_num]=0;
+	for(i=0;i<=count;i++)
+	{
+		s=node_alloc(thread_num);
+		f=node_alloc(thread_num);
+		child_set(ctx->start_root[thread_num],i,s,thread_num);
+		child_set(ctx->finish_root[thread_num],i,f,thread_num);
+		f->hasOutput=0;
+		s->state=i;
+		s->parent=ctx->start_root[thread_num];
+		f->state=i;
+		f->parent=ctx->finish_root[thread_num];
+		s->finish_node=f;
+		f->start_node=s;
+		s->isLeaf=1;
+		f->isLeaf=1;
+	}
+}
+
+/*************************************************
+Function: void createTree_first(int start_state);
+Description: initiate a stack tree for the first thread, the start_state is 1
+Called By: void main_task(int i);for sequential version, called by void main_function();
+Input: start_state is 1
+*************************************************/
+void createTree_first(int start_state)
+{
+	int thread_num=0;
+	Node* s;
+	Node* f;
+	ctx->start_root[thread_num]=node_alloc(thread_num);
+	ctx->finish_root[thread_num]=node_alloc(thread_num);
+	ctx->start_root[thread_num]->isLeaf=0;
+	ctx->finish_root[thread_num]->isLeaf=0;
+	ctx->treeStates[thread_num]=__atomic_load_n(&ctx->dfa.stateCount,__ATOMIC_ACQUIRE)+1;   //the part starts with state 1, the tree needs no other state
+	ctx->treeBelow[thread_num]=0;
+	ctx->treeMissed[thread_num]=0;
+	ctx->treeExact[thread_num]=1;
+	s=node_alloc(thread_num);
+	f=node_alloc(thread_num);
+	child_set(ctx->start_root[thread_num],start_state,s,thread_num);
+	child_set(ctx->finish_root[thread_num],start_state,f,thread_num);
+	f->hasOutput=0;
+	s->state=start_state;
+	s->parent=ctx->start_root[thread_num];
+	f->state=start_state;
+	f->parent=ctx->finish_root[thread_num];
+	s->finish_node=f;
+	f->start_node=s;
+	s->isLeaf=1;
+	f->isLeaf=1;
+}
+
+/*************************************************
+Function: void createTree_merge(int thread_num);
+Description: initiate a stack tree for a part dealt with again at the merge(see refresh_part). The tree starts at the bottom of the stack of mergeSet, 
+and the rest of the stack is pushed onto it, so the tree has one branch, from the states the part really starts with, and an end tag pops that stack.
+Called By: void prepare_part(int slot, char* from, char* limit, int first);
+Input: thread_num--the slot of the tree
+*************************************************/
+void createTree_merge(int thread_num)
+{
+	ResultSet* set=ctx->mergeSet;
+	Node* root;
+	Node* s;
+	Node* f;
+	int k;
+	ctx->start_root[thread_num]=node_alloc(thread_num);
+	ctx->finish_root[thread_num]=node_alloc(thread_num);
+	root=ctx->finish_root[thread_num];
+	ctx->start_root[thread_num]->isLeaf=0;
+	root->isLeaf=0;
+	ctx->treeStates[thread_num]=__atomic_load_n(&ctx->dfa.stateCount,__ATOMIC_ACQUIRE)+1;
+	ctx->treeBelow[thread_num]=0;
+	ctx->treeMissed[thread_num]=0;
+	s=node_alloc(thread_num);
+	f=node_alloc(thread_num);
+	s->state=(set->topend>0)?set->end_stack[0]:set->end;
+	f->state=s->state;
+	child_set(ctx->start_root[thread_num],s->state,s,thread_num);
+	child_set(root,f->state,f,thread_num);
+	f->hasOutput=0;
+	s->parent=ctx->start_root[thread_num];
+	f->parent=root;
+	s->finish_node=f;
+	f->start_node=s;
+	s->isLeaf=1;
+	f->isLeaf=1;
+	for(k=1;k<=set->topend;k++)
+	{
+		f=child_get(root,mask_low(root->childMask));   //the only node on the top
+		child_remove(root,f->state);
+		push(f,root,(k<set->topend)?set->end_stack[k]:set->end,thread_num);
+	}
+}
+
+/*************************************************
+Function: void print_tree(Node* tree,int layer);
+Description: print the structure of the tree for each layer
+Called By: void main_task(int i); for sequential version, called by void main_function();
+Input: tree--the start or finish stack tree; layer--the initial layer of the tree, default is 0
+*************************************************/
+void print_tree(Node* tree,int layer)
+{
+	QueueEle element;
+	Node* node=tree;
+	int i=0;
+	layer++;
+	QueueEle queue[MAX_SIZE];
+	int top=-1;
+	int buttom=-1;
+	int lastlayer=0;
+	printf("the 0th layer only includes the root node and its state is -1;");
+	for(i=0;i<child_count(node);i++)
+	{
+		element.node=node->children[i];
+		element.layer=layer;
+		queue[(top+1)%MAX_SIZE]=element;
+		top=(top+1)%MAX_SIZE;
+	}
+	while((top-buttom)%MAX_SIZE>0)
+	{
+		element=queue[(buttom+1)%MAX_SIZE];
+		node=element.node;
+		layer=element.layer;
+		if(layer>lastlayer)
+		{
+			printf("\nthe %d layer is: ",layer);
+			lastlayer=layer;
+		}
+		printf("state %d  parent %d;",node->state,node->parent->state);
+		buttom=(buttom+1)%MAX_SIZE;
+		for(i=0;i<child_count(node);i++)
+		{
+			element.node=node->children[i];
+			element.layer=layer+1;
+			queue[(top+1)%MAX_SIZE]=element;
+			top=(top+1)%MAX_SIZE;
+		}
+	}
+	printf("\n\n");
+}
+
+/*************************************************
+Function: void add_node(Node* node, Node* root, int thread_num);
+Description: add a node into the tree. Each tree node has at most one child for each state.
+If a transition causes two child nodes to have the same symbol, then two nodes would be merged, 
+the output of the node is handed down to its children first so that it stays with the stacks which took it(see hand_down)
+Called By: void push(Node* node, Node* root, int nextState, int thread_num);void pop(int id, Node* root, int thread_num);
+Input: node--the current node would be added into the tree; root--the root of the tree; thread_num--the slot of the tree(for its arena)
+*************************************************/
+void add_node(Node* node, Node* root, int thread_num)
+{
+	Node* rtchild;
+	Node* same=child_get(root,node->state);
+	int i,count;
+    if(same!=NULL)
+    {
+    	/*merge the children of node into the original node in the tree, only the children which exist are visited.
+    	The outputs of both nodes belong to their own children only, so they are handed down before the children meet*/
+    	if(same->hasOutput==1&&child_count(same)>0&&child_count(node)>0) hand_down(same,thread_num);
+    	if(node->hasOutput==1)
+    	{
+    		if(child_count(node)>0) hand_down(node,thread_num);
+    		else
+    		{
+    			same->hasOutput=1;
+    			span_join(&same->output,&node->output);
+    			node->hasOutput=0;
+    		}
+    	}
+    	count=child_count(node);
+    	node->childMask=0;
+         for(i=0;i<count;i++)
+         {
+         	rtchild=node->children[i];
+         	rtchild->parent=NULL;
+         	add_node(rtchild,same,thread_num);
+         }
+    }
+    else {
+    	child_set(root,node->state,node,thread_num);
+    	node->parent=root;
+	}
+
+}
+
+/*************************************************
+Function: void push(Node* node, Node* root, int nextState, int thread_num);
+Description: push new element into stack tree
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: node--the current node of the tree; root--the root of the tree;
+nextState--the state for the next node which would be pushed on top of the current node; thread_num--the slot of the tree(for its arena)
+*************************************************/
+void push(Node* node, Node* root, int nextState, int thread_num)
+{
+    Node* n;
+    int i;
+    n=node_alloc(thread_num);
+    n->state=node->state;
+    n->hasOutput=0;
+    n->start_node=NULL;
+    n->finish_node=NULL;
+    node->state=nextState;
+    /*the children are handed over to the new node*/
+    n->childMask=node->childMask;
+    n->children=node->children;
+    n->childCap=node->childCap;
+    if(node->isLeaf==1)
+    {
+    	node->start_node->finish_node=n;
+    	n->start_node=node->start_node;
+    	n->isLeaf=1;
+    	node->start_node=NULL;
+    	node->isLeaf=0;
+	}
+    for(i=0;i<child_count(n);i++)
+    {
+    	n->children[i]->parent=n;
+	}
+    node->start_node=NULL;
+    node->childMask=0;
+    node->children=NULL;
+    node->childCap=0;
+    child_set(node,n->state,n,thread_num);
+    n->parent=node;
+
+    add_node(node,root,thread_num);
+}
+
+/*************************************************
+Function: void start_tag(int symbol, int thread_num);
+Description: if type of the xml element is Start Tag(e.g <xxx>) and the content of the tag could be found in the automata,
+every node of the finishing stack tree which could not take the tag is pushed to state 0, and the nodes which could are pushed to the states they enter
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); int replay_part(int i);
+Input: symbol-the symbol of the tag(see tag_symbol); thread_num-the number of the thread(the slot of its stack tree)
+*************************************************/
+void start_tag(int symbol, int thread_num)
+{
+	Node* root=ctx->finish_root[thread_num];
+	Node* node;
+	Node* taken[MAX_STATE];
+	int next[MAX_STATE];
+	ChildMask m;
+	int a,k,count=0;
+	/*only state 0 is added back while the others are taken out, and it is visited first, so the mask taken here stays right. 
+	The nodes which take the tag are pushed after the loop, so none of them is merged into a node which has not been visited*/
+	for(m=root->childMask;m!=0;m&=m-1)
+	{
+		a=mask_low(m);
+		node=child_get(root,a);
+		child_remove(root,a);
+		next[count]=tag_move(symbol,a,ctx->treeExact[thread_num]);
+		if(next[count]==-1)
+		{
+			ctx->treeMissed[thread_num]=1;   //the part is dealt with again once its start state is known(see tree_stale)
+			next[count]=0;
+		}
+		if(next[count]==0) push(node,root,0,thread_num);   //for state0
+		else taken[count++]=node;
+	}
+	for(k=0;k<count;k++)
+	{
+		push(taken[k],root,next[k],thread_num);   //for state j
+	}
+}
+
+/*************************************************
+Function: int checkChildren(Node* node);
+Description: check if a node has children
+Called By: void pop(int id, Node* root, int thread_num);
+Input: node--the original node;
+Return: the smallest state of the children; -1--no child
+*************************************************/
+int checkChildren(Node* node)
+{
+	if(node->childMask==0) return -1;
+	return mask_low(node->childMask);
+}
+
+/*************************************************
+Function: void pop(int id, Node* root, int thread_num);
+Description: if type of the xml element is End Tag(e.g </xxx>) and the content of the tag could be found in the automata,
+then this function would delete the related nodes from the finishing stack tree, one for each state the tag enters. If no such node exists, 
+new nodes are created in the start tree, thus pushing the states the tag comes from(see tag_from) on the starting stack tree.
+The nodes closed are all taken out of the tree before any node under them is put back, as the state uncovered by a pop may be one still to be closed(after //).
+The texts of a state popped in the start tree stay with its start node, as the state uncovered may be shared by several states the tag enters(after a predicate).
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); int replay_part(int i);
+Input: id-the id of the tag(see tag_id); root-the root of the tree; thread_num-the slot of the tree(for its arena)
+*************************************************/
+void pop(int id, Node* root, int thread_num) //pop element due to end_tag e.g</d>
+{
+    int i,begin,next;
+    int popped=0;
+    Node * n;
+    Node * ns;
+    Node * top;
+    Node * child;
+    Node * starts[MAX_STATE];
+    Node * closed[MAX_STATE];
+    Node * shared[MAX_STATE];   //the start node given to each state uncovered, for the other states popped to it
+    SpanList outputs[MAX_STATE];
+    int hasOutputs[MAX_STATE];
+    ChildMask m,k;
+    ChildMask begins=0,nexts=0,pops=0,assumed=0;
+    ChildMask pairs[MAX_STATE];   //the states each begin is popped to in the start tree
+    for(m=root->childMask&~(ChildMask)1;m!=0;m&=m-1)
+    {
+    	begin=mask_low(m);
+    	top=child_get(root,begin);
+    	if(top->childMask!=0)
+    	{
+    		if((__atomic_load_n(&ctx->dfa.stateTags[begin],__ATOMIC_RELAXED)>>id&1)==0) continue;   //the tag does not enter begin
+    		closed[begin]=top;   //for state begin
+    		child_remove(root,begin);   //the node stays in the arena until the tree is released
+    		pops|=(ChildMask)1<<begin;
+    		popped=1;
+    	}
+    	else if(top->start_node!=NULL) assumed|=(ChildMask)1<<begin;
+    }
+    if(assumed!=0) ctx->treeBelow[thread_num]=1;   //the tag closes an element opened before the part
+    for(m=assumed;m!=0;m&=m-1)
+    {
+    	begin=mask_low(m);
+    	pairs[begin]=0;
+    	for(k=assumed;k!=0;k&=k-1)
+    	{
+    		next=mask_low(k);
+    		if((tag_from(id,next,begin)&1)==1) pairs[begin]|=(ChildMask)1<<next;
+    	}
+    	if(pairs[begin]==0) continue;
+    	begins|=(ChildMask)1<<begin;   //not in final tree, it is added into the start tree below
+    	nexts|=pairs[begin];
+    }
+    for(m=pops;m!=0;m&=m-1)
+    {
+    	begin=mask_low(m);
+    	top=closed[begin];
+    	if(top->hasOutput==1) hand_down(top,thread_num);   //the output goes with every state the top was pushed from
+    	for(k=top->childMask;k!=0;k&=~((ChildMask)1<<i))
+    	{
+    		i=mask_high(k);
+    		n=child_get(top,i);
+    		n->parent=NULL;
+    		child_remove(top,i);
+    		add_node(n,root,thread_num);
+    	}
+    }
+    /*state 0 is popped with the states the tag closes, or alone if the tag closes none of them but state 0 has been pushed in this part, 
+    as a tag of the XPaths may be found where no XPath takes it*/
+    top=child_get(root,0);
+    if(popped==1||(begins==0&&top!=NULL&&top->childMask!=0))
+    {
+    	if(top!=NULL)
+    	{
+    		if(top->hasOutput==1&&top->childMask!=0) hand_down(top,thread_num);   //the output is carried by the top, it goes with every state pushed to state 0
+    		for(m=top->childMask;m!=0;m&=~((ChildMask)1<<i))  //for state0, from the largest state down
+    		{
+    			i=mask_high(m);
+    			n=child_get(top,i);
+    			n->parent=NULL;
+    			child_remove(top,i);
+    			if(i==0){
+    				child_remove(root,0);
+    			}
+    			add_node(n,root,thread_num);
+    		}
+    		if(top->isLeaf==0&&checkChildren(top)==-1&&child_get(root,0)==top)
+    		{
+    			child_remove(root,0);   //an empty state 0 left on the top would take the outputs of the states pushed onto it later
+    		}
+    	}
+    	return;
+    }
+    /*with no state the tag enters from another one, the tag still closes state 0 where the part starts in it, 
+    e.g. as the states it enters have not been built yet, so the states assumed are put below state 0 as below*/
+    if(begins==0&&(child_get(root,0)==NULL||child_get(root,0)->start_node==NULL)) return;
+    /*the start nodes and the outputs are taken before any of them is moved, a state may be both closed and uncovered by the tag*/
+    for(m=begins|nexts;m!=0;m&=m-1)
+    {
+    	i=mask_low(m);
+    	starts[i]=child_get(root,i)->start_node;
+    	shared[i]=NULL;
+    }
+    for(m=begins;m!=0;m&=m-1)
+    {
+    	i=mask_low(m);
+    	child=child_get(root,i);
+    	outputs[i]=child->output;
+    	hasOutputs[i]=child->hasOutput;
+    	child->output.head=NULL;
+    	child->output.tail=NULL;
+    	child->hasOutput=0;
+    }
+    /*the start node of a state uncovered by the tag is moved below the state it is popped from, so the output left on the state by the assumption 
+    which reached it before is given up with that assumption*/
+    for(m=nexts&~begins;m!=0;m&=m-1)
+    {
+    	child=child_get(root,mask_low(m));
+    	child->output.head=NULL;
+    	child->output.tail=NULL;
+    	child->hasOutput=0;
+    }
+    for(m=begins;m!=0;m&=m-1)
+    {
+    	begin=mask_low(m);
+    	n=starts[begin];
+    	ns=node_alloc(thread_num);
+    	ns->state=begin;
+    	ns->parent=n->parent;
+    	ns->start_node=NULL;
+    	/*a state may be entered by the tag from several states, each of them is an assumption below begin in the start tree*/
+    	for(k=pairs[begin];k!=0;k&=k-1)
+    	{
+    		next=mask_low(k);
+    		if(shared[next]!=NULL)
+    		{
+    			/*next is below another state the tag enters, its start node is shared(see start_child)*/
+    			child=node_alloc(thread_num);
+    			child->state=next;
+    			child->start_node=shared[next];
+    			child->finish_node=shared[next]->parent;
+    			child_set(n,next,child,thread_num);
+    			child->parent=n;
+    			continue;
+    		}
+    		if((begins>>next&1)==1)
+    		{
+    			/*the start node of next is the one of its own pop, so a new one is taken*/
+    			child=node_alloc(thread_num);
+    			child->state=next;
+    			child->finish_node=child_get(root,next);
+    			child_get(root,next)->start_node=child;
+    			child_set(n,next,child,thread_num);  //for pop node
+    		}
+    		else
+    		{
+    			child=starts[next];
+    			child_set(n,next,child,thread_num);  //for pop node
+    			child_remove(child->parent,next);
+    		}
+    		child->parent=n;
+    		shared[next]=child;
+    	}
+    	n->output=outputs[begin];   //the texts before the pop are older than any text of the states below, they are taken first(see get_mapping)
+    	n->hasOutput=hasOutputs[begin];
+    	ns->finish_node=child_get(root,begin);
+    	if((nexts>>begin&1)==0) child_get(root,begin)->start_node=ns;
+    }
+    //for pop node 0
+    n=(child_get(root,0)!=NULL)?child_get(root,0)->start_node:NULL;
+    if(n!=NULL)
+    {
+    	n->childMask=0;   //the former children are dropped
+    	for(m=root->childMask;m!=0;m&=m-1)
+    	{
+    		i=mask_low(m);
+    		if((nexts>>i&1)==1)
+    		{
+    			/*i is uncovered by a state the tag enters, but if the predicates of the tag fail in i, state 0 is above it instead, 
+    			so it is also below state 0 with the start node shared(see start_child)*/
+    			if(shared[i]!=NULL&&(tag_from(id,i,0)&2)==2)
+    			{
+    				child=node_alloc(thread_num);
+    				child->state=i;
+    				child->start_node=shared[i];
+    				child->finish_node=shared[i]->parent;
+    				child_set(n,i,child,thread_num);
+    				child->parent=n;
+    			}
+    			continue;
+    		}
+    		child=child_get(root,i);
+    		if(i==0)
+    		{
+    			ns=node_alloc(thread_num);
+    			ns->state=i;
+    			ns->parent=n;
+    			ns->start_node=NULL;
+    			child_set(n,i,ns,thread_num);
+    			ns->finish_node=child;
+    			child->start_node=ns;
+    		}
+    		if(i!=0&&child->start_node!=NULL){
+    			if((begins>>i&1)==0&&child->start_node->parent!=NULL)
+    			{
+    				child_remove(child->start_node->parent,i);
+    			}
+    			child->start_node->parent=n;
+    			child_set(n,i,child->start_node,thread_num);  //for next state
+    		}
+    	}
+    }
+}
+
+/*************************************************
+Function: char * convertTokenTypeToStr(xml_TokenType type);
+Description: convert the XML token type from digit to the real string for output
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: type--the enumeration for the type of XML
+Return: the output string for this type
+*************************************************/
+char * convertTokenTypeToStr(xml_TokenType type)
+{
+
+	if(type<MAX_ATT_NUM) return tokenValue[type];
+	else return defaultToken;
+}
+
+/*************************************************
+Function: int xml_initText(xml_Text *pText, char *s);
+Description: initiate a xml_Text for a string loading from original XML file
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--the xml_Text element waiting to be initialized; s--the XML string;
+Output: pText--the initialized xml_Text
+Return: 0--success
+*************************************************/
+int xml_initText(xml_Text *pText, char *s)
+{
+    pText->p = s;
+    pText->len = strlen(s);
+    return 0;
+}
+
+/*************************************************
+Function: int xml_initTextLen(xml_Text *pText, char *s, long len);
+Description: initiate a xml_Text for a part of the XML file which is not '\0' terminated(e.g. a view of the mapping)
+Called By: void main_task(int i);
+Input: pText--the xml_Text element waiting to be initialized; s--the XML string; len--the length of the string
+Output: pText--the initialized xml_Text
+Return: 0--success
+*************************************************/
+int xml_initTextLen(xml_Text *pText, char *s, long len)
+{
+    pText->p = s;
+    pText->len = len;
+    return 0;
+}
+
+/*************************************************
+Function: xml_initToken(xml_Token *pToken, xml_Text *pText);
+Description: initiate a xml_Token for a initialized xml_Text
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pToken--the xml_Token element waiting to be initialized; pText--input xml_Text;
+Output: pToken--the initialized xml_Token
+Return: 0--success
+*************************************************/
+int xml_initToken(xml_Token *pToken, xml_Text *pText)
+{
+    pToken->text.p = pText->p;
+    pToken->text.len = 0;
+    pToken->type = xml_tt_U;
+    return 0;
+}
+
+/*************************************************
+Function: int xml_print(xml_Text *pText, int begin, int end);
+Description: print the substring of a xml_Text
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--input xml_Text; begin--start position; end--end position;
+Output: the substring of a xml_Text
+Return: 0--success
+*************************************************/
+int xml_print(xml_Text *pText, int begin, int end)
+{
+    int i;
+    char * temp=pText->p;
+    temp = ltrim(pText->p);
+    int j=0;
+    for (i = begin; i < end; i++)
+    {
+        putchar(temp[i]);
+    }
+    return 0;
+}
+
+/*************************************************
+Function: char* substring(char *pText, int begin, int end);
+Description: print the substring of the original string
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--the original string; begin--start position; end--end position;
+Return: the final string
+*************************************************/
+char* substring(char *pText, int begin, int end)
+{
+    int i,j;
+    char * temp=pText;
+    temp = ltrim(pText);
+    char* temp1=(char*)malloc((end-begin+1)*sizeof(char));
+    for (j = 0,i = begin; i < end; i++,j++)
+    {
+        temp1[j]=temp[i];
+    }
+    temp1[j]='\0';
+    return temp1;
+}
+
+/*************************************************
+Function: char * ltrim(char *s);
+Description: remove the left blankets of a string
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: s--the original string; 
+Return: the final substring
+*************************************************/
+char * ltrim(char *s)
+{
+     char *temp;
+     temp = s;
+     while((*temp == ' ' || *temp=='\t' )&&temp){*temp++;}
+     return temp;
+}
+
+/*************************************************
+Function: int left_null_count(char *s);
+Description: calculate the number of blanket for each string
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: s--the original string; 
+Return: the number of blanket for each string
+*************************************************/
+int left_null_count(char *s)  
+{
+	 int count=0;
+     char *temp;
+     temp = s;
+     while((*temp == ' ' || *temp=='\t' )&&temp){*temp++; count++;}
+     return count;
+}
+
+/*************************************************
+Function: char* scan_byte(char* p, char* end, char c);
+Description: find the first byte c in [p,end) one byte at a time, it is used for the tail of the SIMD scanners and on the CPUs without them
+Called By: void init_scanner(); the SIMD scanners
+Input: p--the beginning of the text; end--the end of the text; c--the byte to look for
+Return: the position of the first c; end--there is no c in the text
+*************************************************/
+char* scan_byte(char* p, char* end, char c)
+{
+	while(p<end&&*p!=c) p++;
+	return p;
+}
+
+#ifdef XML_SCAN_X86
+/*************************************************
+Function: char* scan_sse2(char* p, char* end, char c);
+Description: find the first byte c in [p,end), 16 bytes are compared at a time
+Called By: xml_scan(chosen by init_scanner)
+Input: p--the beginning of the text; end--the end of the text; c--the byte to look for
+Return: the position of the first c; end--there is no c in the text
+*************************************************/
+__attribute__((target("sse2"))) char* scan_sse2(char* p, char* end, char c)
+{
+	__m128i target=_mm_set1_epi8(c);
+	int mask;
+	for(;end-p>=16;p+=16)
+	{
+		mask=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p),target));
+		if(mask!=0) return p+__builtin_ctz(mask);
+	}
+	return scan_byte(p,end,c);
+}
+
+/*************************************************
+Function: char* scan_avx2(char* p, char* end, char c);
+Description: find the first byte c in [p,end), 32 bytes are compared at a time
+Called By: xml_scan(chosen by init_scanner)
+Input: p--the beginning of the text; end--the end of the text; c--the byte to look for
+Return: the position of the first c; end--there is no c in the text
+*************************************************/
+__attribute__((target("avx2"))) char* scan_avx2(char* p, char* end, char c)
+{
+	__m256i target=_mm256_set1_epi8(c);
+	unsigned int mask;
+	for(;end-p>=32;p+=32)
+	{
+		mask=(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p),target));
+		if(mask!=0) return p+__builtin_ctz(mask);
+	}
+	return scan_sse2(p,end,c);
+}
+#endif
+
+#ifdef XML_SCAN_NEON
+/*************************************************
+Function: char* scan_neon(char* p, char* end, char c);
+Description: find the first byte c in [p,end), 16 bytes are compared at a time
+Called By: xml_scan(chosen by init_scanner)
+Input: p--the beginning of the text; end--the end of the text; c--the byte to look for
+Return: the position of the first c; end--there is no c in the text
+*************************************************/
+char* scan_neon(char* p, char* end, char c)
+{
+	uint8x16_t target=vdupq_n_u8((uint8_t)c);
+	uint8x16_t eq;
+	for(;end-p>=16;p+=16)
+	{
+		eq=vceqq_u8(vld1q_u8((const uint8_t*)p),target);
+		if(vmaxvq_u8(eq)!=0) return scan_byte(p,p+16,c);
+	}
+	return scan_byte(p,end,c);
+}
+#endif
+
+/*************************************************
+Function: void init_scanner();
+Description: choose the fastest scanner for the skipping states of xml_process and the fastest kernel for the structural index by the features of the CPU. 
+It is called once through scannerOnce, by xml_init or by the first run, so the library also works without xml_init
+Called By: int xml_init(int workers); RunContext* run_create(Query* query, int mode);
+Output: xml_scan--the scanner chosen; index_block--the kernel chosen
+*************************************************/
+void init_scanner()
+{
+	xml_scan=scan_byte;
+	index_block=index_byte;
+#ifdef XML_SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+	{
+		xml_scan=scan_sse2;
+		index_block=index_sse2;
+	}
+	if(__builtin_cpu_supports("avx2"))
+	{
+		xml_scan=scan_avx2;
+		index_block=index_avx2;
+	}
+#endif
+#ifdef XML_SCAN_NEON
+	xml_scan=scan_neon;   //NEON is always there on aarch64
+	index_block=index_neon;
+#endif
+}
+
+/*************************************************
+Function: void text_output(Node* root, int thread_num, long offset, long len);
+Description: add a text to the outputs of a stack tree. The text is added with its state to each node at the top of the tree which is in a state 
+holding the last step of an XPath, so the assumed start states of the part are not mixed up. The other nodes at the top do not take it, 
+after // most of the assumed start states are still looking for a step. The texts of the first part of the file are counted for the limit of the run.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); int replay_part(int i);
+Input: root--the root of the finish tree; thread_num--the slot of the tree; offset--the offset of the text from spanBase[thread_num]; len--the length of the text
+*************************************************/
+void text_output(Node* root, int thread_num, long offset, long len)
+{
+	ChildMask m=root->childMask&~(ChildMask)1;
+	Node* node;
+	int s;
+	m&=mask_words(ctx->dfa.acceptWords);
+	for(;m!=0;m&=m-1)
+	{
+		s=mask_low(m);
+		node=child_get(root,s);
+		node->hasOutput=1;
+		span_add(&node->output,thread_num,offset,len,s);
+	}
+	/*the first part of the file has one stack, so its texts are in the result and the run is cancelled once the first limit texts are taken*/
+	if(thread_num==0&&ctx->windowBase==0&&ctx->limit>0&&(root->childMask&mask_words(ctx->dfa.spanWords))!=0&&++ctx->firstTexts>=ctx->limit)
+	{
+		__atomic_store_n(&ctx->cancelled,1,__ATOMIC_RELAXED);
+	}
+}
+
+/*************************************************
+Function: char* skip_subtree(char* p, char* end);
+Description: find the end tag which closes the element whose start tag ends just before p, nothing in the element is dealt with. 
+The open angle brackets are found by xml_scan, and the depth of the elements is counted by the start tags and the end tags between them, 
+while the tags closing themselves, the comments, the heads and CDATA are stepped over. The tags are cut as xml_process cuts them, 
+a close angle bracket in a quoted value does not end its tag.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: p--the first byte after the start tag; end--the end of the part
+Return: the open angle bracket of the end tag; NULL--the element is not closed before the end of the part
+*************************************************/
+char* skip_subtree(char* p, char* end)
+{
+	char* q;
+	int depth=1;
+	int quoted;
+	if(p>=end) return NULL;   //the start tag goes beyond the part
+	while(1)
+	{
+		p=xml_scan(p,end,'<');
+		if(p+1>=end) return NULL;
+		if(p[1]=='/')
+		{
+			if(--depth==0) return p;
+			q=xml_scan(p+2,end,'>');
+		}
+		else if(p[1]=='!'||p[1]=='?')   /*comment <!--xx-->, CDATA <![CDATA[xx]]> or head <?xx?>, up to the close angle bracket after its end*/
+		{
+			if(p+3<end&&p[1]=='!'&&p[2]=='-'&&p[3]=='-') for(q=p+4;(q=xml_scan(q,end,'>'))<end&&(q[-1]!='-'||q[-2]!='-'||q<p+6);q++);
+			else if(p+2<end&&p[1]=='!'&&p[2]=='[') for(q=p+3;(q=xml_scan(q,end,'>'))<end&&(q[-1]!=']'||q[-2]!=']'||q<p+11);q++);
+			else for(q=p+2;(q=xml_scan(q,end,'>'))<end&&(q[-1]!='?'||q<p+3);q++);
+		}
+		else
+		{
+			quoted=0;
+			for(q=p+1;q<end&&(*q!='>'||quoted==1);q++)
+			{
+				if(*q=='"') quoted=1-quoted;
+			}
+			if(q<end&&q[-1]!='/') depth++;   //the tags closing themselves are not counted
+		}
+		if(q>=end) return NULL;
+		p=q+1;
+	}
+}
+
+/*************************************************
+Function: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Description: the function could be called by each thread, dealing with each line of the file. Besides, this function could identify the following elements, 
+which include XML head, Start Tag(e.g <xxx>), End Tag(e.g </xxx>), Tag(e.g <xxx/>), Content for the Tag, XML Explanation, Attribute Name for Tag, 
+Attribute Value for Tag, Content for CDATA element. Each element would be processed according to its type. 
+Each byte is classified by xmlCharClass and drives xmlLexTable, the actions of the transitions deal with the elements. 
+A start tag with attributes is run by the automata at its close angle bracket, each attribute is compared with the predicates of the XPaths as it is lexed(see attr_match), 
+and a tag closing itself(e.g <xxx yyy="zzz"/>) is not run at all. 
+Once a start tag leaves only state 0 in the tree, no XPath could match in its element, so the element is stepped over by skip_subtree up to its end tag. 
+The text, comments, attribute values and CDATA are skipped by xml_scan up to their next structural character. 
+If overrunLimit[thread_num] is set, the last token which is not finished at the end of the part and the text following it are dealt with up to the next open angle bracket, and overrunEnd[thread_num] tells where it stops. 
+The lexer state where it stops is kept in endStates[thread_num], so the merge knows whether the next part starts between tokens(see resume_part).
+The cancel flag of the run is looked at after a token once every CANCEL_CHECK bytes, and the part stops there if it is set.
+Called By: int process_part(int slot, char* from, long len, char* limit, int first);
+Input: pText-the content of the xml file; pToken-the type of the current xml element; multilineExp-whether the current line of the xml file is the multiline explanation; 
+multilineCDATA-- whether the current line of the xml file is the multiline CDATA; thread_num-the number of the thread(the slot of its stack tree); 
+Return: 0--success -1--error 1--multiline explantion 2--multiline CDATA 3--stopped as the run is cancelled
+*************************************************/
+int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num)  
+{
+	Node * tempnode=ctx->finish_root[thread_num];
+    char *start = pToken->text.p + pToken->text.len;
+    char *p = start;
+    char *end = pText->p + pText->len;
+    char *limit = (ctx->overrunLimit[thread_num]!=NULL)?ctx->overrunLimit[thread_num]:end;  //the last token may go beyond the part
+    int state = 0;
+    int templen = 0;
+    if(multilineExp == 1) state = 10;   //1--multiline explantion  0--single line explantion
+    if(multilineCDATA == 1) state = 17; //1--multiline CDATA 0--single CDATA
+    int j;
+    int pending = -1;   //the tag id of the start tag whose attributes are being lexed, -1--none
+    PredMask met = 0;   //the predicates met by the attributes of the pending tag
+    char *attrName = NULL;
+    long attrLen = 0;
+    int blank;
+    int dead = 0;   //1--the start tag just dealt with leaves only state 0 in the tree, -1--an element is not closed in the part, nothing is skipped any more
+    char *close;
+    char *nextCheck = p + CANCEL_CHECK;   //where the cancel flag of the run is looked at next
+    LexTrans trans;
+
+    pToken->text.p = p;
+    pToken->type = xml_tt_U;
+    
+    for (; p < end || (p < limit && (state > 0 || *p != '<')); p++)
+    {
+        trans = xmlLexTable[state][xmlCharClass[(unsigned char)*p]];
+        state = trans.next;
+        if(trans.action == XA_NONE)
+        {
+        	if(state < 0) break;
+        	continue;
+		}
+        if(trans.action == XA_SKIP)
+        {
+        	p = xml_scan(p + 1, limit, xmlSkipTo[state]) - 1;   //skip up to the next structural character of this state
+        	continue;
+		}
+        if(trans.action == XA_CDATA_OPEN)
+        {
+        	if(p+5<limit&&*(p+1)=='C'&&*(p+2)=='D'&&*(p+3)=='A'&&*(p+4)=='T'&&*(p+5)=='A')
+        	{
+        		p += 5;
+        		continue;
+			}
+			state = -1;
+			break;
+		}
+        /*the end of a token*/
+        pToken->text.len = p - start + 1;
+        templen = pToken->text.len;
+        switch(trans.action)
+        {
+            case XA_END_TAG:        /* End </xxx> */
+                j=tag_id(ctx->query,pToken->text.p+left_null_count(pToken->text.p)+1 , pToken->text.len-2-left_null_count(pToken->text.p));   //the name with the slash, in place
+                if(j>=0) pop(j,ctx->finish_root[thread_num],thread_num);
+                break;
+            case XA_START_TAG:      /* Begin <xxx> */
+                if(pToken->text.len-1 >= 1)
+                {
+                	j=tag_id(ctx->query,pToken->text.p+left_null_count(pToken->text.p)+1 , pToken->text.len-2-left_null_count(pToken->text.p));   //the name, in place
+                	if(j>=0) start_tag(tag_symbol(ctx->query,j,0),thread_num);
+                	if(j>=0&&dead==0&&ctx->finish_root[thread_num]->childMask==1) dead=1;
+				}
+				else
+				{
+					templen = 1;
+					if(pending>=0) start_tag(tag_symbol(ctx->query,pending,met),thread_num);   //the attributes are all lexed
+					if(pending>=0&&dead==0&&ctx->finish_root[thread_num]->childMask==1) dead=1;
+					pending = -1;
+				}
+                break;
+            case XA_START_ATTR:     /* Begin <xxx yyy="zzz">, the attributes follow */
+                if(pToken->text.len-1 >= 1)
+                {
+                	pending=tag_id(ctx->query,pToken->text.p+left_null_count(pToken->text.p)+1 , pToken->text.len-2-left_null_count(pToken->text.p));   //the name, in place
+                	met = 0;
+				}
+				else templen = 0;
+                break;
+            case XA_TEXT:           /* Text xxx */
+                p--;
+                pToken->text.len = p - start + 1;
+                templen = pToken->text.len;
+                text_output(tempnode,thread_num,pToken->text.p+left_null_count(pToken->text.p)-ctx->spanBase[thread_num],pToken->text.len-left_null_count(pToken->text.p));
+                break;
+            case XA_COMMENT:        /* Comment <!--xx--> */
+                if(multilineExp == 1)
+                {
+                	strcat(ctx->multiExpContent[thread_num],pToken->text.p);
+                	memset(ctx->multiExpContent[thread_num], 0 , sizeof(ctx->multiExpContent[thread_num]));
+				}
+                break;
+            case XA_CDATA:          /* CDATA <![CDATA[xx]]> */
+                if(multilineCDATA == 1)
+                {
+                	strcat(ctx->multiCDATAContent[thread_num],pToken->text.p);
+                	memset(ctx->multiCDATAContent[thread_num], 0 , sizeof(ctx->multiCDATAContent[thread_num]));
+				}
+                break;
+            default:                /* Head <?xxx?>, Begin End <xxx/>, attribute name and attribute value */
+                if(pending<0) break;
+                blank=left_null_count(pToken->text.p);
+                if(state == 14)   //the name with the equal sign
+                {
+                	attrName=pToken->text.p+blank;
+                	attrLen=pToken->text.len-1-blank;
+				}
+                else if(state == 5)   //the value with the quotes
+                {
+                	met|=attr_match(ctx->query,pending,attrName,attrLen,pToken->text.p+blank+1,pToken->text.len-2-blank);
+				}
+                else pending = -1;   //the tag closes itself
+                break;
+        }
+        pToken->text.p = start + templen;
+        start = pToken->text.p;
+        if(dead == 1)
+        {
+        	/*no XPath could go on in the element, the tags in it push state 0 and pop it back and none of its texts is taken, 
+        	so the lexer goes on from its end tag, which pops it as usual*/
+        	close = skip_subtree(p + 1, end);
+        	if(close != NULL)
+        	{
+        		p = close - 1;
+        		pToken->text.p = close;
+        		start = close;
+        		dead = 0;
+			}
+			else dead = -1;   //the elements after it are all in it
+		}
+        if(p >= nextCheck)
+        {
+        	if(__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==1)
+        	{
+        		ctx->overrunEnd[thread_num] = p;
+        		ctx->endStates[thread_num] = state;
+        		return 3;   //the result is known, the rest of the part is not needed
+			}
+        	nextCheck = p + CANCEL_CHECK;
+		}
+    }
+    ctx->overrunEnd[thread_num] = p;
+    ctx->endStates[thread_num] = state;
+    if(state==-1) {return -1;}
+    /*else if(state == 10)
+	{
+		strcat(multiExpContent[thread_num],ltrim(pToken->text.p));
+		return 1;
+	} 
+	else if(state == 17)
+	{
+		strcat(multiCDATAContent[thread_num],ltrim(pToken->text.p));
+		return 2;
+	}*/
+	else if(state == 7)
+	{
+		p--;
+        pToken->text.len = p - start + 1;
+        if(pToken->text.len>0)   //a text of one character at the end of the part is taken too
+        {
+        	//printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
+            //printf("%s","content=");
+            //xml_print(&pToken->text, 0 , pToken->text.len);
+            //printf(";\n\n");
+            text_output(tempnode,thread_num,pToken->text.p+left_null_count(pToken->text.p)-ctx->spanBase[thread_num],pToken->text.len-left_null_count(pToken->text.p));
+        }
+		return 0;
+	}
+    else return 0;
+}
+
+/*************************************************
+Function: long xml_resync(char* p, char* end, int state);
+Description: look for the first token boundary in a part, assuming that the lexer is in the given state at the beginning of the part. 
+A token boundary is an open angle bracket outside the comments, the CDATA and the tags, so the text belongs to the part of its tag. 
+Only the brackets, the quotes and the ends of comments and CDATA are followed here, no element is dealt with.
+Called By: int speculate_part(int thread_num);
+Input: p--the beginning of the part; end--the end of the part; state--the assumed lexer state(one of specStates)
+Return: the offset of the first token boundary in the part; -1--there is no token boundary in the part for this state
+*************************************************/
+long xml_resync(char* p, char* end, int state)
+{
+	char* q=p;
+	int quoted=0;
+	switch(state)
+	{
+		case 7:     /*text ends before the next open angle bracket*/
+			break;
+		case 15:    /*the rest of a quoted value, then the rest of the tag*/
+			quoted=1;
+		case 5:     /*a tag ends with the first close angle bracket outside the quoted values*/
+			for(;q<end;q++)
+			{
+				if(*q=='"') quoted=1-quoted;
+				else if(*q=='>'&&quoted==0) break;
+			}
+			q++;
+			break;
+		case 10:    /*comment ends with -->*/
+			for(;q+2<end;q++)
+			{
+				if(q[0]=='-'&&q[1]=='-'&&q[2]=='>') break;
+			}
+			q=q+3;
+			break;
+		case 17:    /*CDATA ends with ]]>*/
+			for(;q+2<end;q++)
+			{
+				if(q[0]==']'&&q[1]==']'&&q[2]=='>') break;
+			}
+			q=q+3;
+			break;
+		default:
+			return -1;
+	}
+	if(q>=end) return -1;
+	q=(char*)memchr(q,'<',end-q);
+	return (q==NULL)?-1:q-p;
+}
+
+/*************************************************
+Function: void prepare_part(int slot, char* from, char* limit, int first);
+Description: create a stack tree in the slot for a part of the XML file
+Called By: int process_part(int slot, char* from, long len, char* limit, int first); int replay_part(int i);
+Input: slot--the slot for the stack tree; from--the input which the spans of the part point into; 
+limit--xml_process may go beyond the part up to limit to finish its last token, NULL--no overrun; first--1 if the part is the beginning of the file(slot 0 only)
+*************************************************/
+void prepare_part(int slot, char* from, char* limit, int first)
+{
+    if(first==1) 
+	{
+		createTree_first(1);
+	}
+    else if(ctx->treeExact[slot]==1) createTree_merge(slot);   //dealt with again at the merge(see refresh_part)
+    else {
+    	createTree(slot);
+	}
+    ctx->finish_root[slot]->state=-1;
+    ctx->start_root[slot]->state=-1;
+    ctx->overrunLimit[slot]=limit;
+    ctx->spanBase[slot]=from;
+}
+
+/*************************************************
+Function: int process_part(int slot, char* from, long len, char* limit, int first);
+Description: create a stack tree in the slot and deal with a part of the XML file
+Called By: void main_task(int i); int speculate_part(int thread_num); int resolve_part(int i); void resume_part(int i);
+Input: slot--the slot for the stack tree; from--the beginning of the part; len--the length of the part; 
+limit--xml_process may go beyond the part up to limit to finish its last token, NULL--no overrun; first--1 if the part is the beginning of the file(slot 0 only)
+Return: the return value of xml_process
+*************************************************/
+int process_part(int slot, char* from, long len, char* limit, int first)
+{
+    xml_Text xml;
+    xml_Token token;               
+    int multiExp = 0; //0--single line explanation 1-- multiline explanation
+    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
+    prepare_part(slot,from,limit,first);
+    ctx->slotLens[slot]=len;
+    xml_initTextLen(&xml,from,len);
+    xml_initToken(&token, &xml);
+    return xml_process(&xml, &token, multiExp, multiCDATA, slot);
+}
+
+/*************************************************
+Function: int speculate_part(int thread_num);
+Description: deal with a part which is cut at an exact size from the mapping. The lexer state at the beginning of the part is unknown, 
+so the part is lexed once for every state in specStates. Each assumption starts from its own first token boundary(see xml_resync), 
+the assumptions reaching the same boundary share one run, and the last token of every run is finished beyond the part. 
+The merge chooses the assumption which is right(see resolve_part). The first part is lexed from the beginning of the file only.
+Called By: void main_task(int i);
+Input: thread_num--the number of the thread
+Return: 0--at least one assumption succeeds or the part is empty; -1--every assumption fails
+*************************************************/
+int speculate_part(int thread_num)
+{
+	long begin,end,r;
+	int k,m;
+	int ok=-1;
+	SpecRun* run;
+	begin=thread_num*ctx->partSize;
+	end=begin+ctx->partSize;
+	if(begin>ctx->mapSize) begin=ctx->mapSize;
+	if(end>ctx->mapSize) end=ctx->mapSize;
+	ctx->partBegin[thread_num]=begin;
+	ctx->buffFiles[thread_num]=ctx->mapBase+begin;
+	ctx->buffLens[thread_num]=end-begin;
+	if(begin==end) ok=0;
+	for(k=0;k<MAX_SPEC;k++)
+	{
+		run=&ctx->specRuns[thread_num][k];
+		run->resync=-1;
+		run->slot=-1;
+		run->ret=-1;
+		if(thread_num==0&&k>0) continue;   //the first part always starts between tokens
+		if(thread_num==0) r=0;   //the first part always starts from the beginning of the file
+		else r=xml_resync(ctx->mapBase+begin,ctx->mapBase+end,specStates[k]);
+		if(r==-1) continue;
+		run->resync=begin+r;
+		for(m=0;m<k;m++)
+		{
+			if(ctx->specRuns[thread_num][m].resync==run->resync) break;
+		}
+		if(m<k)
+		{
+			*run=ctx->specRuns[thread_num][m];   //the same boundary, so the same run
+			continue;
+		}
+		run->slot=thread_num+k*ctx->chunkCount;
+		run->ret=process_part(run->slot,ctx->mapBase+run->resync,end-run->resync,ctx->mapBase+ctx->mapSize,thread_num==0);
+		run->overrun=ctx->overrunEnd[run->slot]-ctx->mapBase;
+		if(run->ret!=-1) ok=0;
+	}
+	return ok;
+}
+
+/*************************************************
+Function: int resolve_part(int i);
+Description: choose the right assumption for a part cut at an exact size, the parts are resolved in order. The first part starts between tokens, and every other part 
+starts from the boundary where the last token of the former part ends(resolveNext). A part lying inside that token is skipped, and a part without 
+any assumption reaching that boundary is dealt with again from it.
+Called By: int merge_part(int i); int getresult();
+Input: i--the number of the part
+Output: partSlot--the slot chosen for the part; resolveNext--the boundary for the next part
+Return: 0--success; -1--the XML file is wrong
+*************************************************/
+int resolve_part(int i)
+{
+	int k;
+	long end;
+	SpecRun* run;
+	if(i==0) ctx->resolveNext=0;
+	end=ctx->partBegin[i]+ctx->buffLens[i];
+	if(i>0&&ctx->resolveNext>=end)
+	{
+		ctx->partSlot[i]=-1;   //the whole part is inside the last token of the former parts
+		return 0;
+	}
+	for(k=0;k<MAX_SPEC;k++)
+	{
+		if(ctx->specRuns[i][k].resync==ctx->resolveNext&&ctx->specRuns[i][k].ret!=-1) break;
+	}
+	if(k<MAX_SPEC)
+	{
+		run=&ctx->specRuns[i][k];
+	}
+	else
+	{
+		/*no assumption reaches the boundary, deal with the part again from it*/
+		free_tree(i);
+		run=&ctx->specRuns[i][0];
+		run->slot=i;
+		run->resync=ctx->resolveNext;
+		run->ret=process_part(i,ctx->mapBase+ctx->resolveNext,end-ctx->resolveNext,ctx->mapBase+ctx->mapSize,i==0);
+		run->overrun=ctx->overrunEnd[i]-ctx->mapBase;
+	}
+	if(run->ret==-1) return -1;
+	ctx->partSlot[i]=run->slot;
+	ctx->resolveNext=run->overrun;
+	return 0;
+}
+
+/*************************************************
+Function: long lex_resume(char* p, char* end, int* state);
+Description: finish the token which the former part left unfinished, the lexer goes on from the state the former part stopped in 
+until it is between tokens again. Only xmlLexTable is followed, no element is dealt with.
+Called By: void resume_part(int i);
+Input: p--the beginning of the part; end--the end of the part; state--the lexer state at the end of the former part(not between tokens)
+Output: state--the lexer state at the end of the part if the token does not end in it, -1 if the lexer fails
+Return: the offset of the first token boundary in the part; -1--the token does not end in the part or the lexer fails
+*************************************************/
+long lex_resume(char* p, char* end, int* state)
+{
+	char* q;
+	LexTrans trans;
+	for(q=p;q<end;q++)
+	{
+		trans=xmlLexTable[*state][xmlCharClass[(unsigned char)*q]];
+		*state=trans.next;
+		if(*state<0) return -1;
+		if(trans.action==XA_SKIP)
+		{
+			q=xml_scan(q+1,end,xmlSkipTo[*state])-1;   //skip up to the next structural character of this state
+			continue;
+		}
+		if(trans.action==XA_CDATA_OPEN)
+		{
+			if(q+5<end&&memcmp(q+1,"CDATA",5)==0)
+			{
+				q+=5;
+				continue;
+			}
+			*state=-1;
+			return -1;
+		}
+		if(*state==0) return q+1-p;   //the close angle bracket of the token
+	}
+	return -1;
+}
+
+/*************************************************
+Function: void resume_part(int i);
+Description: make sure that a part cut at an open angle bracket is dealt with from a token boundary. The cut is right if the former parts stop between tokens, 
+otherwise the bracket is in a comment, a CDATA, a head or a tag, and the part is dealt with again after the token left unfinished(see lex_resume). 
+A part lying inside that token maps every state to itself. lexState carries the lexer state from part to part, and from batch to batch for the streaming version. 
+The parts cut by the structural index and by the speculative lexing are not dealt with here.
+Called By: int merge_part(int i); int getresult();
+Input: i--the number of the part
+Output: partSlot--the slot of the stack tree of the part, -1--the part maps every state to itself; chunkStatus--the status of a part dealt with again
+*************************************************/
+void resume_part(int i)
+{
+	int state=ctx->lexState;
+	int ret;
+	long r;
+	ctx->partSlot[i]=i;
+	if(state<=0||state==7||ctx->chunkStatus[i]==2||ctx->buffFiles[i]==NULL)   //the cut is a token boundary, or the part was not dealt with to the end
+	{
+		ctx->lexState=ctx->endStates[i];
+		return;
+	}
+	r=lex_resume(ctx->buffFiles[i],ctx->buffFiles[i]+ctx->buffLens[i],&state);
+	if(state==-1)
+	{
+		ctx->chunkStatus[i]=-1;   //the XML file is wrong
+		ctx->lexState=0;
+		return;
+	}
+	if(r==-1)
+	{
+		ctx->partSlot[i]=-1;   //the whole part is inside the last token of the former parts, whatever its own lexing gave
+		ctx->chunkStatus[i]=1;
+		ctx->lexState=state;
+		return;
+	}
+	free_tree(i);
+	ret=process_part(i,ctx->buffFiles[i]+r,ctx->buffLens[i]-r,NULL,0);
+	ctx->chunkStatus[i]=(ret==-1)?-1:((ret==3)?2:1);
+	ctx->lexState=ctx->endStates[i];
+}
+
+/*************************************************
+Function: Node* map_stacks(int thread_num, int start, ResultSet* before, ResultSet* set);
+Description: get the states and the stacks of the mapping for the stack tree of one thread, given the state that the former part ends with. 
+Where the start tree has several states below a state(after //, see pop), the one on the stack of the former parts is followed if it is known, 
+otherwise the smallest one and the mapping is marked as guessed. The outputs are left in the tree, on the start nodes popped and on the nodes from the bottom of the stack up to its top(see hand_down).
+Called By: ResultSet get_mapping(int thread_num, int start, ResultSet* before); void reduce_map(int i);
+Input: thread_num--the number of the thread; start--the state at the beginning of this part; before--the mapping of the former parts, NULL--unknown
+Output: set--the mapping without outputs, begin is -1 if there is no mapping for this start state, guessed is 1 if a state below was guessed
+Return: the node of the finish tree at the bottom of the stack; NULL--no mapping for this start state
+*************************************************/
+Node* map_stacks(int thread_num, int start, ResultSet* before, ResultSet* set)
+{
+	Node* node;
+	Node* below;
+	Node* child;
+	Node* bottom;
+	ChildMask m;
+	int k;
+	set->begin=start;
+	node=child_get(ctx->start_root[thread_num],start);   //the first child for the root
+	//deal with the start tree
+	if(node==NULL)
+	{
+		set->begin=-1;
+		return NULL;
+	}
+	while(node->childMask!=0)
+	{
+		if(set->topbegin>=MAX_SIZE)
+		{
+			set->begin=-1;   //the stack is deeper than the mapping could hold
+			return NULL;
+		}
+		k=(before!=NULL)?before->topend-1-set->topbegin:-1;   //the place of the state below on the stack of the former parts
+		below=(k>=0)?start_child(node,before->end_stack[k]):NULL;
+		for(m=node->childMask;m!=0&&(below==NULL||k<0);m&=m-1)
+		{
+			child=start_child(node,mask_low(m));
+			if(child==NULL) continue;
+			if(below!=NULL)
+			{
+				set->guessed=1;   //another state could be below, so the mapping depends on the stack of the former parts
+				break;
+			}
+			below=child;   //the child of the smallest state
+		}
+		if(below==NULL)
+		{
+			set->begin=-1;   //every assumption below this state has been given up
+			return NULL;
+		}
+		node=below;
+		set->begin_stack[set->topbegin++]=node->state;
+	}
+	//deal with final tree
+	node=node->finish_node;
+	bottom=node;
+	if(node!=NULL&&node->state!=-1)
+	{
+		set->end_stack[set->topend++]=node->state;
+	}
+	while(node!=NULL&&node->parent!=NULL&&node->parent->state!=-1)
+	{
+		if(set->topend>=MAX_SIZE)
+		{
+			set->begin=-1;
+			return NULL;
+		}
+		node=node->parent;
+		set->end_stack[set->topend++]=node->state;
+	}
+	if(node==NULL||set->topend==0)
+	{
+		set->begin=-1;
+		return NULL;
+	}
+	set->end=set->end_stack[set->topend-1];
+	set->topend--;
+	return bottom;
+}
+
+/*************************************************
+Function: ResultSet get_mapping(int thread_num, int start, ResultSet* before);
+Description: get the mapping for the stack tree of one thread, given the state that the former part ends with. 
+The texts are taken from the start nodes popped, from the first one on, and then from the bottom of the stack up to its top, as the texts kept lower are older.
+Called By: void reduce_take(int i); int merge_slot(int i, int slot); int part_proves(int slot);
+Input: thread_num--the number of the thread; start--the state at the beginning of this part; before--the mapping of the former parts, NULL--unknown(see map_stacks)
+Return: the mapping set for this part; begin is -1 if there is no mapping for this start state
+*************************************************/
+ResultSet get_mapping(int thread_num, int start, ResultSet* before)
+{
+	ResultSet set;
+	Node* node;
+	Node* bottom;
+	Span* span;
+	int k;
+	init_result(&set);
+	bottom=map_stacks(thread_num,start,before,&set);
+	if(bottom==NULL) return set;
+	node=child_get(ctx->start_root[thread_num],start);
+	for(k=0;node!=NULL;k++)
+	{
+		if(node->hasOutput==1)
+		{
+			for(span=node->output.head;span!=NULL;span=span->next)
+			{
+				result_add_text(&set,ctx->spanBase[thread_num]+span->offset,span->len,span->state);
+			}
+		}
+		node=(k<set.topbegin)?start_child(node,set.begin_stack[k]):NULL;
+	}
+	for(node=bottom;node->state!=-1;node=node->parent)
+	{
+		if(node->hasOutput==1)
+		{
+			for(span=node->output.head;span!=NULL;span=span->next)
+			{
+				result_add_text(&set,ctx->spanBase[thread_num]+span->offset,span->len,span->state);
+			}
+		}
+	}
+	/*the tree of a quiet part holds nothing, its texts are all in the state on the top of its stack, as no tag moves it*/
+	if(ctx->sideQuiet!=NULL&&thread_num<ctx->chunkCount&&ctx->sideQuiet[thread_num]==1&&set.end!=0&&(mask_words(ctx->dfa.acceptWords)>>set.end&1)==1)
+	{
+		quiet_texts(thread_num,set.end,&set);
+	}
+	return set;
+}
+
+/*************************************************
+Function: int merge_result(ResultSet* final_set, ResultSet* set, int first);
+Description: merge the states and the stacks of the mapping of the next part into the mapping of all the former parts. 
+The texts are gathered by reduce_parts, so only the fixed-size stacks are merged here.
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); int merge_slot(int i, int slot);
+Input: final_set--the mapping for all the former parts; set--the mapping for the next part; first--1 if set is the first part of the file
+Output: final_set--the merged mapping
+Return: the end state of the merged mapping; -1--the two mappings could not be merged
+*************************************************/
+int merge_result(ResultSet* final_set, ResultSet* set, int first)
+{
+	int k,keep;
+	if(set->begin==-1||(first==0&&final_set->end!=set->begin))
+	{
+		final_set->begin=-1;
+		return -1;
+	}
+	final_set->end=set->end;
+	if(first==1)
+	{
+		final_set->begin=set->begin;
+		for(k=0;k<set->topbegin;k++)
+		{
+			final_set->begin_stack[final_set->topbegin++]=set->begin_stack[k];
+		}
+		for(k=0;k<set->topend;k++)
+		{
+			final_set->end_stack[final_set->topend++]=set->end_stack[k];
+		}
+	}
+	else
+	{
+		/*the part pops its start state and the states of begin_stack but the last one, which stays as the bottom of its own stack(see map_stacks), 
+		so the states of the former parts below that bottom are kept and the stack of the part is put onto them*/
+		keep=(set->topbegin<=final_set->topend)?final_set->topend-set->topbegin:0;
+		if(keep+set->topend>MAX_SIZE)
+		{
+			final_set->begin=-1;   //the stack is deeper than the mapping could hold
+			return -1;
+		}
+		for(k=0;k<set->topend;k++)
+		{
+			final_set->end_stack[keep+k]=set->end_stack[k];  //merge
+		}
+		final_set->topend=keep+set->topend;
+	}
+	return final_set->end;
+}
+
+/*************************************************
+Function: void init_result(ResultSet* set);
+Description: initiate an empty mapping which is waiting for the first part to be merged into
+Called By: int merge_slot(int i, int slot); int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); RunContext* run_create(Query* query, int mode);
+Input: set--the mapping to be initialized
+*************************************************/
+void init_result(ResultSet* set)
+{
+	set->topbegin=0;
+	set->topend=0;
+	set->begin=0;set->end=0;set->output=NULL;set->hasOutput=0;set->outputLen=0;set->outputCap=0;
+	set->outputEnds=NULL;set->outputStates=NULL;set->outputTexts=0;set->outputTextCap=0;
+	set->spans=NULL;set->spanCount=0;set->spanCap=0;
+	set->guessed=0;
+	set->aggs=NULL;
+}
+
+/*************************************************
+Function: void result_add_span(ResultSet* set, char* p, long len, int state);
+Description: append a text to a mapping, only the place of the text is kept, the text is copied by flush_result
+Called By: void result_add_text(ResultSet* set, char* p, long len, int state); int merge_slot(int i, int slot); long load_state(const char* state_name);
+Input: set--the mapping; p--the text in the input; len--the length of the text; state--the state the text is found in
+*************************************************/
+void result_add_span(ResultSet* set, char* p, long len, int state)
+{
+	if(set->spanCount>=set->spanCap)
+	{
+		set->spanCap=(set->spanCap==0)?64:2*set->spanCap;
+		set->spans=(TextSpan*)realloc(set->spans,set->spanCap*sizeof(TextSpan));
+	}
+	set->spans[set->spanCount].p=p;
+	set->spans[set->spanCount].len=len;
+	set->spans[set->spanCount].state=state;
+	set->spanCount++;
+	set->hasOutput=1;
+}
+
+/*************************************************
+Function: void result_add_text(ResultSet* set, char* p, long len, int state);
+Description: take a text found in a state into a mapping. The text is folded into the aggregate of each XPath with an aggregate function which takes it, 
+and it is kept as a span(see result_add_span) only if an XPath without an aggregate function takes it too, so the texts of count() are never kept. 
+The text is parsed as a number once however many XPaths take it.
+Called By: ResultSet get_mapping(int thread_num, int start, ResultSet* before); int walk_index(ResultSet* set);
+Input: set--the mapping; p--the text in the input; len--the length of the text; state--the state the text is found in
+*************************************************/
+void result_add_text(ResultSet* set, char* p, long len, int state)
+{
+	Query* query=ctx->query;
+	QueryMask m=ctx->dfa.stateQueries[state]&query->aggregateMask;
+	Aggregate* agg;
+	double value;
+	int q,number=-1;   //-1--the text has not been parsed yet
+	if(m!=0&&set->aggs==NULL) set->aggs=(Aggregate*)calloc(query->queryCount,sizeof(Aggregate));
+	for(;m!=0;m&=m-1)
+	{
+		q=__builtin_ctzll(m);
+		agg=&set->aggs[q];
+		agg->count++;
+		if(query->aggregates[q]==AGG_COUNT) continue;
+		if(number==-1) number=text_number(p,len,&value);
+		if(number==0) continue;
+		if(agg->numbers==0||value<agg->min) agg->min=value;
+		if(agg->numbers==0||value>agg->max) agg->max=value;
+		agg->sum+=value;
+		agg->numbers++;
+	}
+	if((mask_words(ctx->dfa.spanWords)>>state&1)==1) result_add_span(set,p,len,state);
+}
+
+/*************************************************
+Function: int text_number(char* p, long len, double* value);
+Description: parse a text as a number, the blanks around it are left out. The text is not '\0' terminated, so it is copied first.
+Called By: void result_add_text(ResultSet* set, char* p, long len, int state);
+Input: p--the text in the input; len--the length of the text
+Output: value--the number
+Return: 1--the text is a number; 0--it is not, or it is too long for one
+*************************************************/
+int text_number(char* p, long len, double* value)
+{
+	char buf[MAX_LINE];
+	char* end;
+	for(;len>0&&isspace((unsigned char)*p);p++,len--);
+	for(;len>0&&isspace((unsigned char)p[len-1]);len--);
+	if(len==0||len>=MAX_LINE) return 0;
+	memcpy(buf,p,len);
+	buf[len]='\0';
+	*value=strtod(buf,&end);
+	return end==buf+len;
+}
+
+/*************************************************
+Function: void result_join_aggregates(ResultSet* to, ResultSet* from);
+Description: add the aggregates of the next part to those of the former parts, every aggregate is added up in constant time however many texts it took. 
+The aggregates of from are freed(or handed over if to has none).
+Called By: int merge_slot(int i, int slot); int reduce_parts(int base, int count, int start, ResultSet* final_set);
+Input: to--the mapping of the former parts; from--the mapping of the next part
+Output: to--the mapping with the aggregates of both
+*************************************************/
+void result_join_aggregates(ResultSet* to, ResultSet* from)
+{
+	Aggregate *a,*b;
+	int q;
+	if(from->aggs==NULL) return;
+	if(to->aggs==NULL)
+	{
+		to->aggs=from->aggs;
+		from->aggs=NULL;
+		return;
+	}
+	for(q=0;q<ctx->query->queryCount;q++)
+	{
+		a=&to->aggs[q];
+		b=&from->aggs[q];
+		a->count+=b->count;
+		if(b->numbers==0) continue;
+		if(a->numbers==0||b->min<a->min) a->min=b->min;
+		if(a->numbers==0||b->max>a->max) a->max=b->max;
+		a->sum+=b->sum;
+		a->numbers+=b->numbers;
+	}
+	free(from->aggs);
+	from->aggs=NULL;
+}
+
+/*************************************************
+Function: long result_texts(ResultSet* set);
+Description: count the texts of a mapping, both those copied by flush_result and those not copied yet
+Called By: void chunk_done(int i, int status); int merge_cancelled(); void result_trim(ResultSet* set, long limit); int xml_exists_file(Query* query, const char* file_name, int mode, long window_size);
+Input: set--the mapping
+Return: the number of texts
+*************************************************/
+long result_texts(ResultSet* set)
+{
+	return set->outputTexts+set->spanCount;
+}
+
+/*************************************************
+Function: void result_trim(ResultSet* set, long limit);
+Description: keep the first limit texts of a mapping and drop the others, a run with a limit may have merged a few more texts than it looks for
+Called By: int run_chunks(int n, char* file_name, long window_size);
+Input: set--the mapping; limit--the number of texts kept, at least 1
+*************************************************/
+void result_trim(ResultSet* set, long limit)
+{
+	if(result_texts(set)<=limit) return;
+	if(limit>set->outputTexts)
+	{
+		set->spanCount=limit-set->outputTexts;
+		return;
+	}
+	set->spanCount=0;
+	set->outputTexts=limit;
+	set->outputLen=set->outputEnds[limit-1];
+	set->output[set->outputLen]='\0';
+}
+
+/*************************************************
+Function: void flush_result(ResultSet* set);
+Description: copy the texts of a mapping into its output, the texts are separated by a blank and the end and the state of each one are kept in outputEnds and outputStates. 
+It must be called before the input which the texts point into is released.
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); void print_result(ResultSet set);
+Input: set--the mapping
+Output: set--the mapping with all the texts copied into output
+*************************************************/
+void flush_result(ResultSet* set)
+{
+	long k,need;
+	int blank;
+	if(set->spanCount==0) return;
+	blank=(set->output!=NULL);   //some texts have been copied already
+	need=set->outputLen+1;
+	for(k=0;k<set->spanCount;k++)
+	{
+		need+=set->spans[k].len+1;
+	}
+	if(need>set->outputCap)
+	{
+		set->outputCap=(need>2*set->outputCap)?need:2*set->outputCap;
+		set->output=(char*)realloc(set->output,set->outputCap*sizeof(char));
+	}
+	if(set->outputTexts+set->spanCount>set->outputTextCap)
+	{
+		set->outputTextCap=(set->outputTexts+set->spanCount>2*set->outputTextCap)?set->outputTexts+set->spanCount:2*set->outputTextCap;
+		set->outputEnds=(long*)realloc(set->outputEnds,set->outputTextCap*sizeof(long));
+		set->outputStates=(int*)realloc(set->outputStates,set->outputTextCap*sizeof(int));
+	}
+	for(k=0;k<set->spanCount;k++)
+	{
+		if(blank==1) set->output[set->outputLen++]=' ';
+		memcpy(set->output+set->outputLen,set->spans[k].p,set->spans[k].len);
+		set->outputLen+=set->spans[k].len;
+		set->outputEnds[set->outputTexts]=set->outputLen;
+		set->outputStates[set->outputTexts++]=set->spans[k].state;
+		blank=1;
+	}
+	set->output[set->outputLen]='\0';
+	set->spanCount=0;
+}
+
+/*************************************************
+Function: void release_parts();
+Description: free the parts of the file which were loaded into memory, the parts in a mapped file are kept until the file is unmapped
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); void xml_free_run(RunContext* run);
+*************************************************/
+void release_parts()
+{
+	int i;
+	for(i=0;i<ctx->chunkCount;i++)
+	{
+		if(ctx->isMapped==0&&ctx->buffFiles[i]!=NULL) free(ctx->buffFiles[i]);
+		ctx->buffFiles[i]=NULL;
+	}
+}
+
+/*************************************************
+Function: void reduce_map(int i);
+Description: the first step of the parallel merge(see reduce_parts), map every state through the tree of a part
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); (on the workers)
+Input: i--the number of the part
+*************************************************/
+void reduce_map(int i)
+{
+	PartMap* part=&ctx->partMaps[ctx->reduceBase+i];
+	ResultSet scratch;
+	int s;
+	for(s=0;s<=ctx->dfa.stateCount;s++)
+	{
+		if(part->failed==1) part->next[0][s]=-1;
+		else if(part->slot==-1) part->next[0][s]=s;   //nothing to merge, the mapping of this part is the identity
+		else if(tree_stale(part->slot,s)==1) part->next[0][s]=-2;   //the part is dealt with again once s is known(see refresh_part)
+		else
+		{
+			init_result(&scratch);
+			part->next[0][s]=(map_stacks(part->slot,s,NULL,&scratch)==NULL)?-1:scratch.end;
+			if(part->next[0][s]!=-1&&scratch.guessed==1) part->next[0][s]=-2;   //the state depends on the stack below s
+		}
+	}
+}
+
+/*************************************************
+Function: void reduce_compose(int i);
+Description: one round of the prefix of the mappings, after the round for distance d part i holds the composition of the parts i-2d+1 to i
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); (on the workers)
+Input: i--the number of the part
+*************************************************/
+void reduce_compose(int i)
+{
+	PartMap* part=&ctx->partMaps[ctx->reduceBase+i];
+	int* cur=part->next[ctx->reduceCur];
+	int* before;
+	int s;
+	if(i<ctx->reduceRound)
+	{
+		memcpy(part->next[1-ctx->reduceCur],cur,(ctx->dfa.stateCount+1)*sizeof(int));
+		return;
+	}
+	before=ctx->partMaps[ctx->reduceBase+i-ctx->reduceRound].next[ctx->reduceCur];
+	for(s=0;s<=ctx->dfa.stateCount;s++)
+	{
+		part->next[1-ctx->reduceCur][s]=(before[s]<0)?before[s]:cur[before[s]];
+	}
+}
+
+/*************************************************
+Function: void reduce_take(int i);
+Description: take the mapping of a part for the state it really starts with, which is known from the prefix of the former parts
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); (on the workers)
+Input: i--the number of the part
+*************************************************/
+void reduce_take(int i)
+{
+	PartMap* part=&ctx->partMaps[ctx->reduceBase+i];
+	int start=(i==0)?ctx->reduceStart:ctx->partMaps[ctx->reduceBase+i-1].next[ctx->reduceCur][ctx->reduceStart];
+	init_result(&part->set);
+	if(part->failed==1||start==-1) part->set.begin=-1;
+	else if(part->slot!=-1) part->set=get_mapping(part->slot,start,NULL);
+	part->spanEnd[0]=part->set.spanCount;
+}
+
+/*************************************************
+Function: void reduce_count(int i);
+Description: one round of the prefix of the numbers of the texts, which gives every part the place of its texts in the final mapping
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); (on the workers)
+Input: i--the number of the part
+*************************************************/
+void reduce_count(int i)
+{
+	PartMap* part=&ctx->partMaps[ctx->reduceBase+i];
+	part->spanEnd[1-ctx->reduceCur]=part->spanEnd[ctx->reduceCur]+((i>=ctx->reduceRound)?ctx->partMaps[ctx->reduceBase+i-ctx->reduceRound].spanEnd[ctx->reduceCur]:0);
+}
+
+/*************************************************
+Function: void reduce_copy(int i);
+Description: put the texts of a part into their place in the final mapping
+Called By: int reduce_parts(int base, int count, int start, ResultSet* final_set); (on the workers)
+Input: i--the number of the part
+*************************************************/
+void reduce_copy(int i)
+{
+	PartMap* part=&ctx->partMaps[ctx->reduceBase+i];
+	long base=ctx->reduceSet->spanCount+part->spanEnd[ctx->reduceCur]-part->set.spanCount;
+	if(part->set.spanCount>0) memcpy(ctx->reduceSet->spans+base,part->set.spans,part->set.spanCount*sizeof(TextSpan));
+	if(part->set.spans!=NULL) free(part->set.spans);
+	part->set.spans=NULL;
+}
+
+/*************************************************
+Function: int reduce_parts(int base, int count, int start, ResultSet* final_set);
+Description: merge the mappings of the parts in partMaps[base..base+count-1] into the final mapping in parallel, partMaps[i].slot, failed and first are given by the caller.
+The mapping of every part is a function from the state at its beginning to the state at its end, and the functions are composed by a parallel prefix
+in log2(parts) rounds, so every part knows the state it starts with without waiting for the former parts. Then every part takes its mapping from its own tree,
+the places of the texts are found by a second prefix, and the texts are put into the final mapping in parallel.
+The fixed-size stacks and the aggregates are merged in the order of the parts at last, without touching the trees or the texts.
+Called By: int getresult();
+Input: base--the first part; count--the number of parts; start--the state at the beginning of the first part; final_set--the mapping of all the former parts
+Output: final_set--the merged mapping
+Return: the end state of the merged mapping; -1--the mappings could not be merged; -2--a part starts below the states it knows, 
+so the parts must be merged one by one with the stack of the former parts(see map_stacks), final_set is not changed
+*************************************************/
+int reduce_parts(int base, int count, int start, ResultSet* final_set)
+{
+	int i,grain;
+	long total;
+	if(count<=0) return final_set->end;
+	ctx->reduceBase=base;
+	ctx->reduceCount=count;
+	ctx->reduceStart=start;
+	ctx->reduceSet=final_set;
+	grain=(pool.workers>0)?(count+pool.workers-1)/pool.workers:count;   //the rounds are short, so every worker takes a block of parts at once
+	pool_run(count,1,reduce_map);
+	ctx->reduceCur=0;
+	for(ctx->reduceRound=1;ctx->reduceRound<count;ctx->reduceRound*=2)
+	{
+		pool_run(count,grain,reduce_compose);
+		ctx->reduceCur=1-ctx->reduceCur;
+	}
+	if(ctx->partMaps[base+count-1].next[ctx->reduceCur][start]==-2) return -2;   //nothing has been merged yet
+	pool_run(count,1,reduce_take);
+	ctx->reduceCur=0;
+	for(ctx->reduceRound=1;ctx->reduceRound<count;ctx->reduceRound*=2)
+	{
+		pool_run(count,grain,reduce_count);
+		ctx->reduceCur=1-ctx->reduceCur;
+	}
+	total=ctx->partMaps[base+count-1].spanEnd[ctx->reduceCur];
+	if(final_set->spanCount+total>final_set->spanCap)
+	{
+		final_set->spanCap=(final_set->spanCount+total>2*final_set->spanCap)?final_set->spanCount+total:2*final_set->spanCap;
+		final_set->spans=(TextSpan*)realloc(final_set->spans,final_set->spanCap*sizeof(TextSpan));
+	}
+	pool_run(count,grain,reduce_copy);
+	for(i=base;i<base+count;i++)
+	{
+		if(ctx->partMaps[i].slot==-1&&ctx->partMaps[i].failed==0) continue;   //the identity changes nothing
+		if(merge_result(final_set,&ctx->partMaps[i].set,ctx->partMaps[i].first)==-1) break;
+		result_join_aggregates(final_set,&ctx->partMaps[i].set);
+	}
+	if(total>0) final_set->hasOutput=1;
+	final_set->spanCount+=total;
+	return (final_set->begin==-1)?-1:final_set->end;
+}
+
+/*************************************************
+Function: void begin_merge(ResultSet* final_set, int count);
+Description: get ready for the incremental merge of a batch of parts, it is called before the parts are given to the workers
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); int run_chunks(int n, char* file_name, long window_size);
+Input: final_set--the mapping of all the former batches; count--the number of parts in this batch
+*************************************************/
+void begin_merge(ResultSet* final_set, int count)
+{
+	int i;
+	pthread_mutex_lock(&ctx->mergeLock);
+	ctx->mergeSet=final_set;
+	ctx->mergeCount=count;
+	ctx->mergeFront=0;
+	ctx->mergeDone=0;
+	ctx->merging=0;
+	ctx->mergeFailed=0;
+	for(i=0;i<count;i++)
+	{
+		ctx->chunkStatus[i]=0;
+	}
+	pthread_mutex_unlock(&ctx->mergeLock);
+}
+
+/*************************************************
+Function: void chunk_done(int i, int status);
+Description: record that a part is finished. If the part at the front of the merge is finished, the worker merges it and goes on with the 
+next parts which are finished, without holding the lock while merging. Only one worker merges at a time, a part finished meanwhile is taken 
+by that worker. Once every part is finished the rest is left to getresult, which merges it in parallel. 
+The run is cancelled once the parts merged hold the first limit texts, and nothing is merged here after the run is cancelled.
+Called By: void main_task(int i); void main_function();
+Input: i--the number of the part; status--1--finished -1--finished without a mapping 2--stopped as the run is cancelled
+*************************************************/
+void chunk_done(int i, int status)
+{
+	int front,ret;
+	pthread_mutex_lock(&ctx->mergeLock);
+	ctx->chunkStatus[i]=status;
+	ctx->mergeDone++;
+	if(ctx->merging==1)
+	{
+		pthread_mutex_unlock(&ctx->mergeLock);
+		return;
+	}
+	ctx->merging=1;
+	while(ctx->mergeFailed==0&&ctx->mergeDone<ctx->mergeCount&&ctx->mergeFront<ctx->mergeCount&&ctx->chunkStatus[ctx->mergeFront]!=0
+		&&__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==0)
+	{
+		front=ctx->mergeFront;
+		pthread_mutex_unlock(&ctx->mergeLock);
+		ret=merge_part(front);
+		pthread_mutex_lock(&ctx->mergeLock);
+		if(ret==-1) ctx->mergeFailed=1;
+		ctx->mergeFront++;
+		if(ctx->limit>0&&result_texts(ctx->mergeSet)>=ctx->limit) __atomic_store_n(&ctx->cancelled,1,__ATOMIC_RELAXED);   //the first texts are all merged
+	}
+	ctx->merging=0;
+	pthread_mutex_unlock(&ctx->mergeLock);
+}
+
+/*************************************************
+Function: int merge_part(int i);
+Description: merge one part into mergeSet, all the parts before it have been merged so the state it starts with is known, 
+and so is the token boundary it starts from(see resolve_part and resume_part)
+Called By: void chunk_done(int i, int status); int getresult();
+Input: i--the number of the part
+Output: mergeSet--the merged mapping
+Return: the end state of the merged mapping; -1--the mappings could not be merged
+*************************************************/
+int merge_part(int i)
+{
+	int slot=i;
+	if(ctx->speculative==1)
+	{
+		if(resolve_part(i)==-1)
+		{
+			ctx->mergeSet->begin=-1;
+			return -1;
+		}
+		slot=ctx->partSlot[i];
+	}
+	else if(ctx->sideBase==NULL)
+	{
+		resume_part(i);
+		slot=ctx->partSlot[i];
+	}
+	return merge_slot(i,slot);
+}
+
+/*************************************************
+Function: int tree_stale(int slot, int start);
+Description: tell whether the stack tree of a slot could give a wrong mapping for a start state. A tag of the part may have needed a state 
+which was not built(see treeMissed), or states may have been built since the tree was created(see treeStates): the tree has no node for 
+a start state built later, and where an end tag closes an element opened before the part, the states it could come from are only the ones the tree knew. 
+A tree which starts with the states the part really starts with is right(see treeExact).
+Called By: int merge_slot(int i, int slot); void reduce_map(int i);
+Input: slot--the slot of the stack tree; start--the state at the beginning of the part
+Return: 1--the part must be dealt with again; 0--the mapping of the tree is right
+*************************************************/
+int tree_stale(int slot, int start)
+{
+	if(ctx->treeExact[slot]==1) return 0;
+	if(ctx->treeMissed[slot]==1) return 1;
+	if(ctx->treeStates[slot]>__atomic_load_n(&ctx->dfa.stateCount,__ATOMIC_ACQUIRE)) return 0;   //no state has been built since
+	return start>=ctx->treeStates[slot]||ctx->treeBelow[slot]==1;
+}
+
+/*************************************************
+Function: ResultSet refresh_part(int i, int slot);
+Description: deal with a part again from the same input, its stack tree is stale(see tree_stale). The start state and the stack of the 
+former parts are known by now, so the new tree holds that stack only(see createTree_merge), and the part builds the states its tags enter from it. 
+It happens only while a run is still building the states its input reaches.
+Called By: int merge_slot(int i, int slot);
+Input: i--the number of the part; slot--the slot of its stack tree
+Output: chunkStatus--the status of the part dealt with again
+Return: the mapping of the part for the state mergeSet ends with; begin is -1 if there is none
+*************************************************/
+ResultSet refresh_part(int i, int slot)
+{
+	ResultSet set;
+	char* from=ctx->spanBase[slot];
+	int ret;
+	free_tree(slot);
+	ctx->treeExact[slot]=1;
+	if(ctx->sideBase!=NULL) ret=replay_part(slot);   //the slot of a part with a sidecar index is its number
+	else ret=process_part(slot,from,ctx->slotLens[slot],ctx->overrunLimit[slot],0);
+	ctx->chunkStatus[i]=(ret==-1)?-1:((ret==3)?2:1);
+	if(ret==-1)
+	{
+		init_result(&set);
+		set.begin=-1;
+		return set;
+	}
+	set=get_mapping(slot,(ctx->mergeSet->topend>0)?ctx->mergeSet->end_stack[0]:ctx->mergeSet->end,NULL);
+	if(set.begin!=-1)
+	{
+		/*the tree starts at the bottom of the stack, so the part takes the whole stack of mergeSet and gives back its own*/
+		set.begin=ctx->mergeSet->end;
+		set.topbegin=ctx->mergeSet->topend;
+	}
+	return set;
+}
+
+/*************************************************
+Function: int merge_slot(int i, int slot);
+Description: merge one part into mergeSet with the stack tree it was dealt with, the stack of mergeSet is followed where the tree has several states below a state. 
+A tree which is stale for the state the part starts with is built again instead(see refresh_part).
+Called By: int merge_part(int i); int getresult();
+Input: i--the number of the part; slot--the slot of its stack tree, -1--the part maps every state to itself
+Output: mergeSet--the merged mapping
+Return: the end state of the merged mapping; -1--the mappings could not be merged
+*************************************************/
+int merge_slot(int i, int slot)
+{
+	ResultSet set;
+	long k;
+	if(slot==-1) return ctx->mergeSet->end;   //the identity changes nothing
+	init_result(&set);
+	if(ctx->chunkStatus[i]!=-1&&ctx->windowBase+i!=0&&ctx->mergeSet->begin!=-1&&tree_stale(slot,ctx->mergeSet->end)==1) set=refresh_part(i,slot);
+	else if(ctx->chunkStatus[i]==-1) set.begin=-1;
+	else if(ctx->windowBase+i==0) set=get_mapping(slot,1,NULL);
+	else set=get_mapping(slot,ctx->mergeSet->end,ctx->mergeSet);
+	if(merge_result(ctx->mergeSet,&set,ctx->windowBase+i==0)!=-1)
+	{
+		for(k=0;k<set.spanCount;k++)
+		{
+			result_add_span(ctx->mergeSet,set.spans[k].p,set.spans[k].len,set.spans[k].state);
+		}
+		result_join_aggregates(ctx->mergeSet,&set);
+	}
+	if(set.spans!=NULL) free(set.spans);
+	free(set.aggs);
+	return (ctx->mergeSet->begin==-1)?-1:ctx->mergeSet->end;
+}
+
+/*************************************************
+Function: int getresult();
+Description: finish the merge after all the parts are finished. The parts left behind a part which finished late are few when the workers 
+are few, and they are merged one by one, otherwise they are merged by the parallel prefix(see reduce_parts). The prefix maps only the states, 
+so the parts are always merged one by one if the mapping of a part depends on the stack below its start state(see stackMapping), 
+or if a part pops below the states its tree knows(e.g. it starts inside an element which no XPath takes). A run which is cancelled is finished by merge_cancelled.
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); int run_chunks(int n, char* file_name, long window_size);
+Output: mergeSet--the mapping for all the parts
+Return: the end state of the mapping; -1--the mappings could not be merged
+*************************************************/
+int getresult()
+{
+	int i,left,ret;
+	if(ctx->mergeFailed==1) return -1;
+	if(__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==1) return merge_cancelled();
+	left=ctx->mergeCount-ctx->mergeFront;
+	if(left<=pool.workers||pool.workers<=1||ctx->dfa.stackMapping==1)
+	{
+		for(i=ctx->mergeFront;i<ctx->mergeCount;i++)
+		{
+			if(merge_part(i)==-1) return -1;
+		}
+		return ctx->mergeSet->end;
+	}
+	for(i=ctx->mergeFront;i<ctx->mergeCount;i++)
+	{
+		if(ctx->speculative==1&&resolve_part(i)==-1)
+		{
+			ctx->mergeSet->begin=-1;
+			return -1;
+		}
+		if(ctx->speculative==0&&ctx->sideBase==NULL) resume_part(i);
+		ctx->partMaps[i].slot=(ctx->speculative==1||ctx->sideBase==NULL)?ctx->partSlot[i]:i;
+		ctx->partMaps[i].failed=(ctx->chunkStatus[i]==-1);
+		ctx->partMaps[i].first=(ctx->windowBase+i==0);
+	}
+	ret=reduce_parts(ctx->mergeFront,left,(ctx->windowBase+ctx->mergeFront==0)?1:ctx->mergeSet->end,ctx->mergeSet);
+	for(i=ctx->mergeFront;ret==-2&&i<ctx->mergeCount;i++)   //the parts have been resolved, so they are merged one by one from their slots
+	{
+		if(merge_slot(i,ctx->partMaps[i].slot)==-1) return -1;
+	}
+	return (ret==-2)?ctx->mergeSet->end:ret;
+}
+
+/*************************************************
+Function: int merge_cancelled();
+Description: finish the merge of a run cancelled before all its parts are dealt with. Nothing is left to merge if a part proved that a text exists, 
+otherwise the parts dealt with to the end are merged from the front until the result holds the first limit texts. The first part of the file is merged 
+even if it was stopped, since it starts with state 1 and the beginning of it is all the result needs.
+Called By: int getresult();
+Output: mergeSet--the mapping for the parts merged
+Return: the end state of the mapping; -1--the mappings could not be merged
+*************************************************/
+int merge_cancelled()
+{
+	int i;
+	for(i=ctx->mergeFront;i<ctx->mergeCount&&ctx->found==0&&result_texts(ctx->mergeSet)<ctx->limit;i++)
+	{
+		if(ctx->chunkStatus[i]!=1&&(ctx->chunkStatus[i]!=2||ctx->windowBase+i!=0)) break;
+		if(merge_part(i)==-1) return -1;
+		if(ctx->chunkStatus[i]==2) break;
+	}
+	return ctx->mergeSet->end;
+}
+
+/*************************************************
+Function: void print_result(ResultSet* set);
+Description: print the result mapping set. 
+Called By: int main(void);
+Input: set-result mapping set; 
+*************************************************/
+void print_result(ResultSet* set)
+{
+	if(set->begin==-1)
+	{
+		printf("The mapping for this part is null, please check the XPath command.\n");
+		return;
+	}
+	int i;
+	printf("The mapping for this part is: %d,  ",set->begin);
+	for(i=0;i<set->topbegin;i++)  
+	{
+		printf("%d:",set->begin_stack[i]);
+	}
+    printf(",  ");
+	printf("%d,  ",set->end);
+	for(i=set->topend-1;i>=0;i--)
+	{
+		printf("%d:",set->end_stack[i]);
+	}
+	printf(",  ");
+	flush_result(set);
+	if(set->output!=NULL)  printf("%s\n",set->output);
+	else printf("null");
+}
+
+/*************************************************
+Function: IndexWord index_byte(char* p);
+Description: build the index word for 64 bytes one byte at a time, it is used on the CPUs without SIMD
+Called By: void index_task(int i); (chosen by init_scanner)
+Input: p--the beginning of the 64 bytes
+Return: the index word, bit k is set if p[k] is a structural character(see structIndex)
+*************************************************/
+IndexWord index_byte(char* p)
+{
+	IndexWord word=0;
+	int k;
+	for(k=0;k<INDEX_WORD;k++)
+	{
+		if(p[k]=='<'||p[k]=='>'||p[k]=='"') word|=((IndexWord)1)<<k;
+	}
+	return word;
+}
+
+#ifdef XML_SCAN_X86
+/*************************************************
+Function: IndexWord index_sse2(char* p);
+Description: build the index word for 64 bytes, 16 bytes are compared at a time
+Called By: void index_task(int i); (chosen by init_scanner)
+Input: p--the beginning of the 64 bytes
+Return: the index word, bit k is set if p[k] is a structural character(see structIndex)
+*************************************************/
+__attribute__((target("sse2"))) IndexWord index_sse2(char* p)
+{
+	__m128i lt=_mm_set1_epi8('<');
+	__m128i gt=_mm_set1_epi8('>');
+	__m128i qt=_mm_set1_epi8('"');
+	__m128i v,eq;
+	IndexWord word=0;
+	int k;
+	for(k=0;k<INDEX_WORD;k+=16)
+	{
+		v=_mm_loadu_si128((const __m128i*)(p+k));
+		eq=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,lt),_mm_cmpeq_epi8(v,gt)),_mm_cmpeq_epi8(v,qt));
+		word|=((IndexWord)(unsigned int)_mm_movemask_epi8(eq))<<k;
+	}
+	return word;
+}
+
+/*************************************************
+Function: IndexWord index_avx2(char* p);
+Description: build the index word for 64 bytes, 32 bytes are compared at a time
+Called By: void index_task(int i); (chosen by init_scanner)
+Input: p--the beginning of the 64 bytes
+Return: the index word, bit k is set if p[k] is a structural character(see structIndex)
+*************************************************/
+__attribute__((target("avx2"))) IndexWord index_avx2(char* p)
+{
+	__m256i lt=_mm256_set1_epi8('<');
+	__m256i gt=_mm256_set1_epi8('>');
+	__m256i qt=_mm256_set1_epi8('"');
+	__m256i v,eq;
+	IndexWord word=0;
+	int k;
+	for(k=0;k<INDEX_WORD;k+=32)
+	{
+		v=_mm256_loadu_si256((const __m256i*)(p+k));
+		eq=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,lt),_mm256_cmpeq_epi8(v,gt)),_mm256_cmpeq_epi8(v,qt));
+		word|=((IndexWord)(unsigned int)_mm256_movemask_epi8(eq))<<k;
+	}
+	return word;
+}
+#endif
+
+#ifdef XML_SCAN_NEON
+/*************************************************
+Function: IndexWord index_neon(char* p);
+Description: build the index word for 64 bytes, 16 bytes are compared at a time and only the blocks with structural characters are looked at byte by byte
+Called By: void index_task(int i); (chosen by init_scanner)
+Input: p--the beginning of the 64 bytes
+Return: the index word, bit k is set if p[k] is a structural character(see structIndex)
+*************************************************/
+IndexWord index_neon(char* p)
+{
+	uint8x16_t lt=vdupq_n_u8('<');
+	uint8x16_t gt=vdupq_n_u8('>');
+	uint8x16_t qt=vdupq_n_u8('"');
+	uint8x16_t v,eq;
+	IndexWord word=0;
+	int k,m;
+	for(k=0;k<INDEX_WORD;k+=16)
+	{
+		v=vld1q_u8((const uint8_t*)(p+k));
+		eq=vorrq_u8(vorrq_u8(vceqq_u8(v,lt),vceqq_u8(v,gt)),vceqq_u8(v,qt));
+		if(vmaxvq_u8(eq)==0) continue;
+		for(m=k;m<k+16;m++)
+		{
+			if(p[m]=='<'||p[m]=='>'||p[m]=='"') word|=((IndexWord)1)<<m;
+		}
+	}
+	return word;
+}
+#endif
+
+/*************************************************
+Function: void index_task(int i);
+Description: stage 1 of the structural index engine, build the index words for a chunk of the mapping. 
+The chunks are cut at word boundaries, so no chunk has to know anything about the others.
+Called By: int build_index(); (by pool_run)
+Input: i--the number of this chunk
+*************************************************/
+void index_task(int i)
+{
+	long per,w,wend;
+	char tail[INDEX_WORD];
+	long rest;
+	per=(ctx->indexWords+ctx->indexChunks-1)/ctx->indexChunks;
+	w=i*per;
+	wend=(w+per<ctx->indexWords)?w+per:ctx->indexWords;
+	for(;w<wend;w++)
+	{
+		rest=ctx->mapSize-w*INDEX_WORD;
+		if(rest>=INDEX_WORD)
+		{
+			ctx->structIndex[w]=index_block(ctx->mapBase+w*INDEX_WORD);
+		}
+		else
+		{
+			/*the last word of the file is padded with blanks*/
+			memset(tail,' ',INDEX_WORD);
+			memcpy(tail,ctx->mapBase+w*INDEX_WORD,rest);
+			ctx->structIndex[w]=index_block(tail);
+		}
+	}
+}
+
+/*************************************************
+Function: int build_index();
+Description: allocate the structural index for the mapping and run stage 1 on the workers, the index is built in the chunks of the mapping
+Called By: int run_chunks(int n, char* file_name, long window_size); int xml_build_index(const char* file_name);
+Return: 0--success; -1--the index could not be built
+*************************************************/
+int build_index()
+{
+	ctx->indexWords=(ctx->mapSize+INDEX_WORD-1)/INDEX_WORD;
+	ctx->indexChunks=ctx->chunkCount;
+	ctx->structIndex=(IndexWord*)malloc((ctx->indexWords+1)*sizeof(IndexWord));
+	if(ctx->structIndex==NULL) return -1;
+	pool_run(ctx->indexChunks,1,index_task);
+	return 0;
+}
+
+/*************************************************
+Function: long next_struct(long from, char c);
+Description: find the next structural character c in the mapping by the index, the bytes between two structural characters are never read
+Called By: long lex_event(long cur, TagEvent* event, long* nameLen);
+Input: from--the offset to start from; c--the structural character('<', '>' or '"'), 0--any of them
+Return: the offset of the structural character; mapSize--there is no such character
+*************************************************/
+long next_struct(long from, char c)
+{
+	long w;
+	IndexWord word;
+	long pos;
+	if(from>=ctx->mapSize) return ctx->mapSize;
+	w=from/INDEX_WORD;
+	word=ctx->structIndex[w]&(~((IndexWord)0)<<(from%INDEX_WORD));
+	while(1)
+	{
+		while(word==0)
+		{
+			w++;
+			if(w>=ctx->indexWords) return ctx->mapSize;
+			word=ctx->structIndex[w];
+		}
+		pos=w*INDEX_WORD+__builtin_ctzll(word);
+		if(pos>=ctx->mapSize) return ctx->mapSize;
+		if(c==0||ctx->mapBase[pos]==c) return pos;
+		word&=word-1;
+	}
+}
+
+/*************************************************
+Function: void index_output(IndexFrame* frame, long offset, long len);
+Description: append an output to a frame of the stack as a span of the mapped file, the spans are kept in the arena of slot 0
+Called By: int walk_index(ResultSet* set);
+Input: frame--the frame of the stack; offset--the offset of the output in the file; len--the length of the output
+*************************************************/
+void index_output(IndexFrame* frame, long offset, long len)
+{
+	span_add(&frame->output,0,offset,len,frame->state);
+	frame->hasOutput=1;
+}
+
+/*************************************************
+Function: PredMask index_attrs(int id, char* p, char* end);
+Description: compare the attributes of a start tag with the predicates of the XPaths(see attr_match), the attributes are read in place
+Called By: int walk_index(ResultSet* set); int replay_part(int i);
+Input: id--the tag id; p--the first byte after the tag name; end--the close angle bracket of the tag
+Return: the predicates met by the attributes
+*************************************************/
+PredMask index_attrs(int id, char* p, char* end)
+{
+	PredMask met=0;
+	char *name,*value;
+	long nameLen;
+	while(p<end)
+	{
+		for(;p<end&&(*p==' '||*p=='\t');p++);
+		for(name=p;p<end&&*p!='=';p++);
+		if(p>=end) break;
+		nameLen=p-name;
+		for(p++;p<end&&*p!='"';p++);
+		for(value=++p;p<end&&*p!='"';p++);
+		if(p>=end) break;
+		met|=attr_match(ctx->query,id,name,nameLen,value,p-value);
+		p++;
+	}
+	return met;
+}
+
+/*************************************************
+Function: void index_push(int symbol);
+Description: run the automata for a start tag, the next state is pushed if the tag matches the top of the stack, otherwise state 0 is pushed
+Called By: int walk_index(ResultSet* set);
+Input: symbol--the symbol of the tag(see tag_symbol)
+*************************************************/
+void index_push(int symbol)
+{
+	IndexFrame* frame;
+	if(ctx->indexTop+1>=ctx->indexCap)
+	{
+		ctx->indexCap=2*ctx->indexCap;
+		ctx->indexStack=(IndexFrame*)realloc(ctx->indexStack,ctx->indexCap*sizeof(IndexFrame));
+	}
+	frame=&ctx->indexStack[++ctx->indexTop];
+	frame->state=tag_move(symbol,ctx->indexStack[ctx->indexTop-1].state,1);
+	frame->output.head=NULL;
+	frame->output.tail=NULL;
+	frame->hasOutput=0;
+}
+
+/*************************************************
+Function: void index_pop(int j);
+Description: run the automata for an end tag, the top of the stack is popped if the tag enters it from the state below or it is state 0, 
+and the output of the top is handed down to the new top
+Called By: int walk_index(ResultSet* set);
+Input: j--the tag id of the end tag(see tag_id), -1--the tag is not in the XPaths
+*************************************************/
+void index_pop(int j)
+{
+	IndexFrame* frame;
+	if(j<0||ctx->indexTop==0) return;
+	frame=&ctx->indexStack[ctx->indexTop];
+	if(frame->state!=0&&(tag_from(j,ctx->indexStack[ctx->indexTop-1].state,frame->state)&1)==0) return;
+	if(frame->hasOutput==1)
+	{
+		span_join(&ctx->indexStack[ctx->indexTop-1].output,&frame->output);
+		ctx->indexStack[ctx->indexTop-1].hasOutput=1;
+	}
+	ctx->indexTop--;
+}
+
+/*************************************************
+Function: long lex_event(long cur, TagEvent* event, long* nameLen);
+Description: find the next markup of the mapping from cur by the structural index, and tell whether it is a start tag, an end tag or something else. 
+The comments, CDATA and quoted values are skipped by the index, the text before the markup is left to the caller.
+Called By: int walk_index(ResultSet* set); int xml_build_index(const char* file_name);
+Input: cur--the offset to start from, it is not inside a markup
+Output: event--the markup(the name is not looked up, it is -1); nameLen--the length of the tag name without the slash(start and end tags only)
+Return: the offset after the markup; 0--there is no more markup; -1--the XML file is wrong
+*************************************************/
+long lex_event(long cur, TagEvent* event, long* nameLen)
+{
+	long q,r,t;
+	char* s=ctx->mapBase;
+	int k;
+	q=next_struct(cur,'<');
+	if(q>=ctx->mapSize-1) return 0;
+	event->begin=q;
+	event->name=-1;
+	event->kind=EVENT_OTHER;
+	switch(s[q+1])
+	{
+		case '?':     /*Head <?xxx?>*/
+			for(r=q+2;r<ctx->mapSize&&s[r]!='?';r++);
+			if(r+1>=ctx->mapSize||s[r+1]!='>') return -1;
+			r++;
+			break;
+		case '!':     /*Comment <!--xx--> or CDATA <![CDATA[xx]]>*/
+			if(q+3<ctx->mapSize&&s[q+2]=='-'&&s[q+3]=='-')
+			{
+				t=q+4;
+				k='-';
+			}
+			else if(q+8<ctx->mapSize&&memcmp(s+q+2,"[CDATA[",7)==0)
+			{
+				t=q+9;
+				k=']';
+			}
+			else return -1;
+			for(r=next_struct(t,'>');r<ctx->mapSize&&(r-2<t||s[r-1]!=k||s[r-2]!=k);r=next_struct(r+1,'>'));
+			if(r>=ctx->mapSize) return -1;
+			break;
+		case '/':     /*End </xxx>*/
+			r=next_struct(q+2,'>');
+			if(r>=ctx->mapSize) return -1;
+			if(memchr(s+q+1,' ',r-q-1)!=NULL) return -1;
+			event->kind=EVENT_CLOSE;
+			*nameLen=r-q-2;
+			break;
+		case ' ':
+			return -1;
+		default:      /*Begin <xxx>, <xxx/> or <xxx yyy="zzz">*/
+			for(r=q+1;r<ctx->mapSize&&s[r]!=' '&&s[r]!='>'&&s[r]!='/';r++);
+			if(r>=ctx->mapSize) return -1;
+			if(s[r]=='/')
+			{
+				if(r+1>=ctx->mapSize||s[r+1]!='>') return -1;
+				r++;
+				break;
+			}
+			*nameLen=r-q-1;
+			if(s[r]==' ')
+			{
+				/*the attributes, the tag ends with the first close angle bracket outside the quoted values*/
+				k=0;
+				for(r=next_struct(r,0);r<ctx->mapSize&&(s[r]!='>'||k==1);r=next_struct(r+1,0))
+				{
+					if(s[r]=='"') k=1-k;
+				}
+				if(r>=ctx->mapSize) return -1;
+				if(s[r-1]=='/') break;   //the tag closes itself
+			}
+			event->kind=EVENT_OPEN;
+			break;
+	}
+	event->end=r;
+	return r+1;
+}
+
+/*************************************************
+Function: int walk_index(ResultSet* set);
+Description: stage 2 of the structural index engine, run the automata over the structural index from the beginning of the file. 
+Only the tags are read from the mapping(see lex_event), the text is read only if it is an output. 
+The walk stops at the first limit texts of a run with a limit, and the mapping is given for the beginning of the file walked.
+Called By: int run_chunks(int n, char* file_name, long window_size);
+Output: set--the mapping for the whole file, in the same form as getresult gives
+Return: 0--success; -1--the XML file is wrong
+*************************************************/
+int walk_index(ResultSet* set)
+{
+	long cur=0,next,r,nameLen,texts=0;
+	char* s=ctx->mapBase;
+	int state,k,j;
+	PredMask met;
+	Span* span;
+	TagEvent event;
+	init_result(set);
+	ctx->indexCap=MAX_SIZE;
+	ctx->indexStack=(IndexFrame*)malloc(ctx->indexCap*sizeof(IndexFrame));
+	ctx->indexTop=0;
+	ctx->indexStack[0].state=1;
+	ctx->indexStack[0].output.head=NULL;
+	ctx->indexStack[0].output.tail=NULL;
+	ctx->indexStack[0].hasOutput=0;
+	while(1)
+	{
+		next=lex_event(cur,&event,&nameLen);
+		if(next==0) break;
+		/*the text before the markup*/
+		state=ctx->indexStack[ctx->indexTop].state;
+		if((mask_words(ctx->dfa.acceptWords)>>state&1)==1)
+		{
+			for(r=cur;r<event.begin&&s[r]==' ';r++);
+			if(r<event.begin)
+			{
+				for(r=cur;r<event.begin&&(s[r]==' '||s[r]=='\t');r++);
+				index_output(&ctx->indexStack[ctx->indexTop],r,event.begin-r);
+				if(ctx->limit>0&&(mask_words(ctx->dfa.spanWords)>>state&1)==1&&++texts>=ctx->limit) break;   //the first texts are found
+			}
+		}
+		if(next==-1) return -1;
+		if(event.kind==EVENT_CLOSE) index_pop(tag_id(ctx->query,s+event.begin+2,nameLen));
+		else if(event.kind==EVENT_OPEN)
+		{
+			j=tag_id(ctx->query,s+event.begin+1,nameLen);
+			met=0;
+			if(j>=0&&ctx->query->tagSymbols[j].preds!=0) met=index_attrs(j,s+event.begin+1+nameLen,s+event.end);
+			if(j>=0) index_push(tag_symbol(ctx->query,j,met));
+		}
+		cur=next;
+	}
+	/*the stack is given as the mapping of the whole file*/
+	if(ctx->indexTop>MAX_SIZE)
+	{
+		arena_reset(0);
+		return -1;
+	}
+	set->begin=1;
+	set->end=ctx->indexStack[ctx->indexTop].state;
+	for(k=0;k<ctx->indexTop;k++)
+	{
+		set->end_stack[set->topend++]=ctx->indexStack[k].state;
+	}
+	for(k=0;k<=ctx->indexTop;k++)   //the outputs kept lower on the stack are older
+	{
+		if(ctx->indexStack[k].hasOutput==0) continue;
+		for(span=ctx->indexStack[k].output.head;span!=NULL;span=span->next)
+		{
+			result_add_text(set,ctx->mapBase+span->offset,span->len,span->state);
+		}
+	}
+	arena_reset(0);
+	free(ctx->indexStack);
+	ctx->indexStack=NULL;
+	return 0;
+}
+
+/*************************************************
+Function: long sidecar_name(char* p, long len);
+Description: find the number of a tag name while the sidecar index is built, a name seen for the first time is added to the pool of the names
+Called By: int xml_build_index(const char* file_name);
+Input: p--the tag name in the file; len--the length of the name
+Return: the number of the name
+*************************************************/
+long sidecar_name(char* p, long len)
+{
+	long h,k;
+	SideName* name;
+	if(2*(ctx->sideNameCount+1)>ctx->sideHashCap)
+	{
+		/*the table is kept at most half full, the names are put into a table twice as large*/
+		free(ctx->sideHash);
+		ctx->sideHashCap=(ctx->sideHashCap==0)?256:2*ctx->sideHashCap;
+		ctx->sideHash=(int*)calloc(ctx->sideHashCap,sizeof(int));
+		ctx->sideNames=(SideName*)realloc(ctx->sideNames,ctx->sideHashCap/2*sizeof(SideName));
+		for(k=0;k<ctx->sideNameCount;k++)
+		{
+			name=&ctx->sideNames[k];
+			for(h=tag_hash(ctx->sidePool+name->offset,name->len,0)&(ctx->sideHashCap-1);ctx->sideHash[h]!=0;h=(h+1)&(ctx->sideHashCap-1));
+			ctx->sideHash[h]=k+1;
+		}
+	}
+	for(h=tag_hash(p,len,0)&(ctx->sideHashCap-1);ctx->sideHash[h]!=0;h=(h+1)&(ctx->sideHashCap-1))
+	{
+		name=&ctx->sideNames[ctx->sideHash[h]-1];
+		if(name->len==len&&memcmp(ctx->sidePool+name->offset,p,len)==0) return ctx->sideHash[h]-1;
+	}
+	ctx->sidePool=(char*)realloc(ctx->sidePool,ctx->sidePoolSize+len);
+	memcpy(ctx->sidePool+ctx->sidePoolSize,p,len);
+	name=&ctx->sideNames[ctx->sideNameCount];
+	name->offset=ctx->sidePoolSize;
+	name->len=len;
+	ctx->sidePoolSize+=len;
+	ctx->sideHash[h]=ctx->sideNameCount+1;
+	return ctx->sideNameCount++;
+}
+
+/*************************************************
+Function: long file_nsec(const char* file_name, struct stat* st);
+Description: the part of the modification time of a file under a second, which stat gives in st_mtime, 
+so that an edit of the same size in the same second as the sidecar index is found too. Windows gives it in steps of 100 nanoseconds.
+Called By: int write_sidecar(const char* file_name, struct stat* st); int open_sidecar(char* file_name);
+Input: file_name--the name for the file; st--the status of the file
+Return: the nanoseconds of the modification time; 0--not known
+*************************************************/
+long file_nsec(const char* file_name, struct stat* st)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(GetFileAttributesExA(file_name,GetFileExInfoStandard,&data)==0) return 0;
+	return (long)((((unsigned long long)data.ftLastWriteTime.dwHighDateTime<<32|data.ftLastWriteTime.dwLowDateTime)%10000000)*100);
+#elif defined(__APPLE__)
+	return st->st_mtimespec.tv_nsec;
+#else
+	return st->st_mtim.tv_nsec;
+#endif
+}
+
+/*************************************************
+Function: int write_sidecar(const char* file_name, struct stat* st);
+Description: write the sidecar index built in the run next to the XML file, it is written into a temporary file first 
+and renamed at last, so a run never maps half of an index
+Called By: int xml_build_index(const char* file_name);
+Input: file_name--the name for the xml file; st--the status of the xml file when the index was built
+Return: 0--success; -1--the index could not be written
+*************************************************/
+int write_sidecar(const char* file_name, struct stat* st)
+{
+	SidecarHead head;
+	char pad[8]={0};
+	char* name=(char*)malloc(strlen(file_name)+strlen(SIDECAR_SUFFIX)+5);
+	char* temp=(char*)malloc(strlen(file_name)+strlen(SIDECAR_SUFFIX)+5);
+	FILE* fp;
+	int ok;
+	sprintf(name,"%s%s",file_name,SIDECAR_SUFFIX);
+	sprintf(temp,"%s%s.tmp",file_name,SIDECAR_SUFFIX);
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,SIDECAR_MAGIC,sizeof(SIDECAR_MAGIC));
+	head.fileSize=st->st_size;
+	head.fileTime=st->st_mtime;
+	head.fileNsec=file_nsec(file_name,st);
+	head.nameCount=ctx->sideNameCount;
+	head.poolSize=(ctx->sidePoolSize+7)/8*8;
+	head.eventCount=ctx->sideEventCount;
+	head.cutCount=ctx->sideCutCount;
+	fp=fopen(temp,"wb");
+	ok=(fp!=NULL);
+	if(ok)
+	{
+		ok=fwrite(&head,sizeof(head),1,fp)==1;
+		ok=ok&&fwrite(ctx->sideNames,sizeof(SideName),ctx->sideNameCount,fp)==ctx->sideNameCount;
+		ok=ok&&fwrite(ctx->sidePool,1,ctx->sidePoolSize,fp)==ctx->sidePoolSize;
+		ok=ok&&fwrite(pad,1,head.poolSize-ctx->sidePoolSize,fp)==head.poolSize-ctx->sidePoolSize;
+		ok=ok&&fwrite(ctx->sideEvents,sizeof(TagEvent),ctx->sideEventCount,fp)==ctx->sideEventCount;
+		ok=ok&&fwrite(ctx->sideCuts,sizeof(long),ctx->sideCutCount,fp)==ctx->sideCutCount;
+		ok=ok&&fwrite(ctx->sideBlooms,sizeof(SideBloom),ctx->sideCutCount,fp)==ctx->sideCutCount;
+		ok=(fclose(fp)==0)&&ok;
+	}
+	remove(name);   //rename does not replace a file on windows
+	if(ok) ok=(rename(temp,name)==0);
+	if(!ok) remove(temp);
+	free(name);
+	free(temp);
+	return ok?0:-1;
+}
+
+/*************************************************
+Function: int xml_build_index(const char* file_name);
+Description: lex an XML file once and write its sidecar index next to it(the name of the file with SIDECAR_SUFFIX). 
+The index keeps every markup with the number of its tag name, its kind and its offsets, and a cut at the first markup after every SIDECAR_CUT bytes 
+with the filter of the tag names up to the next cut. 
+It does not depend on any query, the later runs of the structural index version map it instead of lexing the file(see open_sidecar), 
+as long as the size and the modification time of the file are still the ones it was built for. The file is lexed by the structural index(see lex_event).
+Called By: int main(void); the programs using the library
+Input: file_name--the name for the xml file
+Return: 0--success; -1--can't open the XML file, the XML file is wrong or the index could not be written
+*************************************************/
+int xml_build_index(const char* file_name)
+{
+	RunContext* saved=ctx;
+	RunContext* run;
+	struct stat st;
+	TagEvent event;
+	long cur=0,next=-1,nameLen,cap=0,cutCap=0,nextCut=0;
+	int ret=-1;
+	if(file_name==NULL||stat(file_name,&st)==-1) return -1;
+	run=run_create(NULL,5);
+	if(run==NULL) return -1;
+	ctx=run;
+	if(map_file((char*)file_name)!=-1&&ctx->mapSize==st.st_size&&build_index()!=-1)
+	{
+		while((next=lex_event(cur,&event,&nameLen))>0)
+		{
+			if(event.kind!=EVENT_OTHER) event.name=sidecar_name(ctx->mapBase+event.begin+((event.kind==EVENT_CLOSE)?2:1),nameLen);
+			if(ctx->sideEventCount==cap)
+			{
+				cap=(cap==0)?1024:2*cap;
+				ctx->sideEvents=(TagEvent*)realloc(ctx->sideEvents,cap*sizeof(TagEvent));
+			}
+			if(event.begin>=nextCut)
+			{
+				/*a cut at the first markup after each SIDECAR_CUT bytes, the bytes without a markup give no cut*/
+				if(ctx->sideCutCount==cutCap)
+				{
+					cutCap=(cutCap==0)?1024:2*cutCap;
+					ctx->sideCuts=(long*)realloc(ctx->sideCuts,cutCap*sizeof(long));
+					ctx->sideBlooms=(SideBloom*)realloc(ctx->sideBlooms,cutCap*sizeof(SideBloom));
+				}
+				memset(&ctx->sideBlooms[ctx->sideCutCount],0,sizeof(SideBloom));
+				ctx->sideCuts[ctx->sideCutCount++]=ctx->sideEventCount;
+				nextCut=(event.begin/SIDECAR_CUT+1)*SIDECAR_CUT;
+			}
+			if(event.kind!=EVENT_OTHER) bloom_add(&ctx->sideBlooms[ctx->sideCutCount-1],ctx->mapBase+event.begin+((event.kind==EVENT_CLOSE)?2:1),nameLen);
+			ctx->sideEvents[ctx->sideEventCount++]=event;
+			cur=next;
+		}
+	}
+	if(next==0) ret=write_sidecar(file_name,&st);
+	ctx=saved;
+	xml_free_run(run);
+	return ret;
+}
+
+/*************************************************
+Function: int open_sidecar(char* file_name);
+Description: map the sidecar index of the XML file of the run if it is up to date, that is its size and modification time are the ones the index was built for. 
+The tag names of the index are looked up in the query once, so the parts never compare a name again(see replay_part).
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly);
+Input: file_name--the name for the xml file, it has been mapped(see map_file)
+Return: 0--the index is mapped; -1--there is no index or it is out of date, the file is lexed as usual
+*************************************************/
+int open_sidecar(char* file_name)
+{
+	struct stat st;
+	SidecarHead* head;
+	char* name;
+	long k,size;
+#ifndef _WIN32
+	int fd;
+	struct stat sst;
+#else
+	FILE* fp;
+#endif
+	if(stat(file_name,&st)==-1||st.st_size!=ctx->mapSize) return -1;
+	name=(char*)malloc(strlen(file_name)+strlen(SIDECAR_SUFFIX)+1);
+	sprintf(name,"%s%s",file_name,SIDECAR_SUFFIX);
+#ifndef _WIN32
+	fd=open(name,O_RDONLY);
+	free(name);
+	if(fd==-1) return -1;
+	if(fstat(fd,&sst)==-1||sst.st_size==0)
+	{
+		close(fd);
+		return -1;
+	}
+	ctx->sideSize=sst.st_size;
+	ctx->sideBase=(char*)mmap(NULL,ctx->sideSize,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(ctx->sideBase==MAP_FAILED)
+	{
+		ctx->sideBase=NULL;
+		return -1;
+	}
+#else
+	/*no mmap on windows, the index is loaded into memory once*/
+	fp=fopen(name,"rb");
+	free(name);
+	if(fp==NULL) return -1;
+	fseek(fp,0,SEEK_END);
+	ctx->sideSize=ftell(fp);
+	rewind(fp);
+	ctx->sideBase=(char*)malloc(ctx->sideSize+1);
+	ctx->sideSize=fread(ctx->sideBase,1,ctx->sideSize,fp);
+	fclose(fp);
+#endif
+	head=(SidecarHead*)ctx->sideBase;
+	size=-1;
+	if(ctx->sideSize>=(long)sizeof(SidecarHead)&&memcmp(head->magic,SIDECAR_MAGIC,sizeof(SIDECAR_MAGIC))==0&&head->nameCount>=0&&head->poolSize>=0&&head->eventCount>=0&&head->cutCount>=0)
+	{
+		size=sizeof(SidecarHead)+head->nameCount*sizeof(SideName)+head->poolSize+head->eventCount*sizeof(TagEvent)+head->cutCount*(sizeof(long)+sizeof(SideBloom));
+	}
+	if(size!=ctx->sideSize||head->fileSize!=st.st_size||head->fileTime!=(long)st.st_mtime||head->fileNsec!=file_nsec(file_name,&st))
+	{
+		free_sidecar();   //not an index, or built for another version of the file
+		return -1;
+	}
+	ctx->sideNames=(SideName*)(ctx->sideBase+sizeof(SidecarHead));
+	ctx->sidePool=(char*)(ctx->sideNames+head->nameCount);
+	ctx->sideEvents=(TagEvent*)(ctx->sidePool+head->poolSize);
+	ctx->sideCuts=(long*)(ctx->sideEvents+head->eventCount);
+	ctx->sideBlooms=(SideBloom*)(ctx->sideCuts+head->cutCount);
+	ctx->sideNameCount=head->nameCount;
+	ctx->sidePoolSize=head->poolSize;
+	ctx->sideEventCount=head->eventCount;
+	ctx->sideCutCount=head->cutCount;
+	ctx->sideTags=(int*)malloc((ctx->sideNameCount+1)*sizeof(int));
+	for(k=0;k<ctx->sideNameCount;k++)
+	{
+		ctx->sideTags[k]=tag_id(ctx->query,ctx->sidePool+ctx->sideNames[k].offset,ctx->sideNames[k].len);
+	}
+	ctx->sideQuiet=(char*)calloc(ctx->chunkCount,sizeof(char));
+	return 0;
+}
+
+/*************************************************
+Function: void free_sidecar();
+Description: release the sidecar index of the run, the mapping of an index opened by open_sidecar or the arrays of an index built by xml_build_index
+Called By: int open_sidecar(char* file_name); void xml_free_run(RunContext* run);
+*************************************************/
+void free_sidecar()
+{
+	if(ctx->sideBase!=NULL)
+	{
+#ifndef _WIN32
+		munmap(ctx->sideBase,ctx->sideSize);
+#else
+		free(ctx->sideBase);
+#endif
+	}
+	else
+	{
+		free(ctx->sideNames);
+		free(ctx->sidePool);
+		free(ctx->sideEvents);
+		free(ctx->sideCuts);
+		free(ctx->sideBlooms);
+	}
+	free(ctx->sideTags);
+	free(ctx->sideHash);
+	free(ctx->sideQuiet);
+	ctx->sideBase=NULL;
+	ctx->sideNames=NULL;
+	ctx->sidePool=NULL;
+	ctx->sideEvents=NULL;
+	ctx->sideCuts=NULL;
+	ctx->sideBlooms=NULL;
+	ctx->sideTags=NULL;
+	ctx->sideHash=NULL;
+	ctx->sideQuiet=NULL;
+}
+
+/*************************************************
+Function: void bloom_add(SideBloom* bloom, char* p, long len);
+Description: add a tag name to the filter of a cut, the name sets two bits taken from one hash
+Called By: int xml_build_index(const char* file_name);
+Input: bloom--the filter; p--the tag name; len--the length of the name
+*************************************************/
+void bloom_add(SideBloom* bloom, char* p, long len)
+{
+	unsigned int h=tag_hash(p,len,0);
+	int bits=SIDECAR_BLOOM*64;
+	bloom->bits[h%bits/64]|=(BloomWord)1<<(h%64);
+	h=(h>>16)%bits;
+	bloom->bits[h/64]|=(BloomWord)1<<(h%64);
+}
+
+/*************************************************
+Function: int bloom_test(SideBloom* bloom, char* p, long len);
+Description: tell whether a tag name may have been added to a filter(see bloom_add)
+Called By: int side_quiet(long cut, long cutEnd);
+Input: bloom--the filter; p--the tag name; len--the length of the name
+Return: 1--the name may be in the filter; 0--the name is surely not in it
+*************************************************/
+int bloom_test(SideBloom* bloom, char* p, long len)
+{
+	unsigned int h=tag_hash(p,len,0);
+	int bits=SIDECAR_BLOOM*64;
+	if((bloom->bits[h%bits/64]>>(h%64)&1)==0) return 0;
+	h=(h>>16)%bits;
+	return (int)(bloom->bits[h/64]>>(h%64)&1);
+}
+
+/*************************************************
+Function: void side_range(int i, long* cut, long* cutEnd, long* first, long* last);
+Description: find the part of a chunk in the sidecar index, the cuts are shared out among the chunks in order, 
+and a part begins with the markup of its first cut and ends before the markup of the first cut of the next part
+Called By: int replay_part(int i); void quiet_texts(int i, int state, ResultSet* set);
+Input: i--the number of the chunk
+Output: cut, cutEnd--the cuts of the part; first, last--the markups of the part
+*************************************************/
+void side_range(int i, long* cut, long* cutEnd, long* first, long* last)
+{
+	*cut=i*ctx->sideCutCount/ctx->chunkCount;
+	*cutEnd=(i+1)*ctx->sideCutCount/ctx->chunkCount;
+	*first=(*cut<ctx->sideCutCount)?ctx->sideCuts[*cut]:ctx->sideEventCount;
+	*last=(*cutEnd<ctx->sideCutCount)?ctx->sideCuts[*cutEnd]:ctx->sideEventCount;
+}
+
+/*************************************************
+Function: int side_text(long e, long* offset, long* len);
+Description: find the text between a markup and the one before it, it is taken in the same way as walk_index takes it
+Called By: int replay_part(int i); void quiet_texts(int i, int state, ResultSet* set);
+Input: e--the number of the markup
+Output: offset--the offset of the text in the file; len--the length of the text
+Return: 1--there is a text; 0--there are only blanks
+*************************************************/
+int side_text(long e, long* offset, long* len)
+{
+	char* s=ctx->mapBase;
+	long begin=ctx->sideEvents[e].begin;
+	long cur=(e==0)?0:ctx->sideEvents[e-1].end+1;
+	long r;
+	for(r=cur;r<begin&&s[r]==' ';r++);
+	if(r>=begin) return 0;
+	for(r=cur;r<begin&&(s[r]==' '||s[r]=='\t');r++);
+	*offset=r;
+	*len=begin-r;
+	return 1;
+}
+
+/*************************************************
+Function: int side_quiet(long cut, long cutEnd);
+Description: look up the tag names of the XPaths in the filters of some cuts. If none of them is there, the automata never move in those markups, 
+since a tag which is not in the XPaths is skipped. After a * step every tag may move them.
+Called By: int replay_part(int i);
+Input: cut, cutEnd--the cuts
+Return: 1--no tag of the XPaths is in the cuts; 0--there may be one
+*************************************************/
+int side_quiet(long cut, long cutEnd)
+{
+	SideBloom all;
+	long k;
+	int j;
+	if(ctx->query->wildcard==1) return 0;
+	memset(&all,0,sizeof(all));
+	for(;cut<cutEnd;cut++)
+	{
+		for(k=0;k<SIDECAR_BLOOM;k++) all.bits[k]|=ctx->sideBlooms[cut].bits[k];
+	}
+	for(j=0;j<ctx->query->tagCount;j++)
+	{
+		if(bloom_test(&all,ctx->query->tagSymbols[j].name,ctx->query->tagSymbols[j].len)==1) return 0;
+	}
+	return 1;
+}
+
+/*************************************************
+Function: int replay_part(int i);
+Description: deal with a part of a file which has a sidecar index(see side_range), the automata are run over the markups of the index in the stack tree of the part, 
+so no byte of the file is lexed and only the texts and the attributes the XPaths may need are read. 
+A part whose filters take no tag name of the XPaths is quiet, its tree is left as it is created as it maps every state to itself, 
+and its texts are taken by get_mapping only if the state it really starts with is an output(see quiet_texts).
+Called By: void main_task(int i);
+Input: i--the number of the chunk, it is also the slot of the stack tree
+Return: 0--success; 3--stopped as the run is cancelled
+*************************************************/
+int replay_part(int i)
+{
+	long cut,cutEnd,e,last,offset,len;
+	long nextCheck=CANCEL_CHECK;
+	char* s=ctx->mapBase;
+	TagEvent* event;
+	Node* root;
+	PredMask met;
+	ChildMask accept=mask_words(ctx->dfa.acceptWords)&~(ChildMask)1;
+	int j;
+	prepare_part(i,ctx->mapBase,NULL,i==0);
+	root=ctx->finish_root[i];
+	side_range(i,&cut,&cutEnd,&e,&last);
+	if(side_quiet(cut,cutEnd)==1)
+	{
+		ctx->sideQuiet[i]=1;
+		return 0;
+	}
+	for(;e<last;e++)
+	{
+		event=&ctx->sideEvents[e];
+		if((root->childMask&accept)!=0&&side_text(e,&offset,&len)==1) text_output(root,i,offset,len);   //the text before the markup
+		j=(event->kind==EVENT_OTHER)?-1:ctx->sideTags[event->name];
+		if(j>=0&&event->kind==EVENT_CLOSE) pop(j,root,i);
+		else if(j>=0)
+		{
+			met=(ctx->query->tagSymbols[j].preds!=0)?index_attrs(j,s+event->begin+1+ctx->sideNames[event->name].len,s+event->end):0;
+			start_tag(tag_symbol(ctx->query,j,met),i);
+			accept=mask_words(ctx->dfa.acceptWords)&~(ChildMask)1;   //the tag may have built a state
+		}
+		if(event->end>=nextCheck)
+		{
+			if(__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==1) return 3;   //the result is known, the rest of the part is not needed
+			nextCheck=event->end+CANCEL_CHECK;
+		}
+	}
+	return 0;
+}
+
+/*************************************************
+Function: void quiet_texts(int i, int state, ResultSet* set);
+Description: take the texts of a quiet part(see replay_part) into its mapping, they are all in the state the part starts with
+Called By: ResultSet get_mapping(int thread_num, int start, ResultSet* before);
+Input: i--the number of the chunk; state--the state the part starts with, it is an output
+Output: set--the mapping of the part
+*************************************************/
+void quiet_texts(int i, int state, ResultSet* set)
+{
+	long cut,cutEnd,e,last,offset,len;
+	side_range(i,&cut,&cutEnd,&e,&last);
+	for(;e<last;e++)
+	{
+		if(side_text(e,&offset,&len)==1) result_add_text(set,ctx->mapBase+offset,len,state);
+	}
+}
+
+/*************************************************
+Function: int hardware_threads();
+Description: get the number of CPUs online, it is the number of workers by default
+Called By: int xml_init(int workers);
+Return: the number of CPUs, at least 1
+*************************************************/
+int hardware_threads()
+{
+#ifndef _WIN32
+	long n=sysconf(_SC_NPROCESSORS_ONLN);
+	return (n<1)?1:(int)n;
+#else
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors<1)?1:(int)info.dwNumberOfProcessors;
+#endif
+}
+
+/*************************************************
+Function: int chunk_count(long size);
+Description: decide how many chunks a file is cut into. There are CHUNKS_PER_WORKER chunks for every worker, so a chunk which is slow to deal with
+(e.g. dense with matching tags) does not keep the other workers waiting, but no chunk is smaller than MIN_CHUNK. 
+A cut at an open angle bracket inside a comment or CDATA is put right by the merge(see resume_part), so every version cuts the same number of chunks.
+Called By: int split_file(char* file_name); int cut_mapping();
+Input: size--the size of the file
+Return: the number of chunks, at least 1
+*************************************************/
+int chunk_count(long size)
+{
+	long chunks=(long)workerCount*CHUNKS_PER_WORKER;
+	if(size/MIN_CHUNK<chunks) chunks=size/MIN_CHUNK;
+	return (chunks<1)?1:(int)chunks;
+}
+
+/*************************************************
+Function: void alloc_chunks(int chunks);
+Description: allocate everything kept for each chunk and for each slot, the arrays are filled with 0 and NULL
+Called By: int split_file(char* file_name); int cut_mapping(); int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly); int cut_cached();
+Input: chunks--the number of chunks
+*************************************************/
+void alloc_chunks(int chunks)
+{
+	ctx->chunkCount=chunks;
+	ctx->slotCount=chunks*MAX_SPEC;
+	ctx->chunkStatus=(int*)calloc(chunks,sizeof(int));
+	ctx->buffFiles=(char**)calloc(chunks,sizeof(char*));
+	ctx->buffLens=(long*)calloc(chunks,sizeof(long));
+	ctx->specRuns=(SpecRun(*)[MAX_SPEC])calloc(chunks,sizeof(SpecRun[MAX_SPEC]));
+	ctx->partSlot=(int*)calloc(chunks,sizeof(int));
+	ctx->partBegin=(long*)calloc(chunks,sizeof(long));
+	ctx->partMaps=(PartMap*)calloc(chunks,sizeof(PartMap));
+	ctx->overrunLimit=(char**)calloc(ctx->slotCount,sizeof(char*));
+	ctx->overrunEnd=(char**)calloc(ctx->slotCount,sizeof(char*));
+	ctx->endStates=(int*)calloc(ctx->slotCount,sizeof(int));
+	ctx->start_root=(Node**)calloc(ctx->slotCount,sizeof(Node*));
+	ctx->finish_root=(Node**)calloc(ctx->slotCount,sizeof(Node*));
+	ctx->arenas=(Arena*)calloc(ctx->slotCount,sizeof(Arena));
+	ctx->spanBase=(char**)calloc(ctx->slotCount,sizeof(char*));
+	ctx->slotLens=(long*)calloc(ctx->slotCount,sizeof(long));
+	ctx->treeStates=(int*)calloc(ctx->slotCount,sizeof(int));
+	ctx->treeBelow=(int*)calloc(ctx->slotCount,sizeof(int));
+	ctx->treeMissed=(int*)calloc(ctx->slotCount,sizeof(int));
+	ctx->treeExact=(int*)calloc(ctx->slotCount,sizeof(int));
+	ctx->multiExpContent=(char(*)[MAX_LINE])calloc(ctx->slotCount,MAX_LINE);
+	ctx->multiCDATAContent=(char(*)[MAX_LINE])calloc(ctx->slotCount,MAX_LINE);
+}
+
+/*************************************************
+Function: int pool_start(int workers);
+Description: start the workers of the pool, each worker has its own deque of tasks. The workers live until pool_stop and sleep while there is no task.
+Called By: int xml_init(int workers);
+Input: workers--the number of workers
+Return: 0--success; -1--the workers could not be started
+*************************************************/
+int pool_start(int workers)
+{
+	int i,rc;
+	pool.workers=workers;
+	pool.threads=(pthread_t*)malloc(workers*sizeof(pthread_t));
+	pool.ids=(int*)malloc(workers*sizeof(int));
+	pool.deques=(TaskDeque*)calloc(workers,sizeof(TaskDeque));
+	pool.queued=0;
+	pool.stop=0;
+	pool.next=0;
+	pthread_mutex_init(&pool.lock,NULL);
+	pthread_cond_init(&pool.work,NULL);
+	pthread_cond_init(&pool.done,NULL);
+	for(i=0;i<workers;i++)
+	{
+		pthread_mutex_init(&pool.deques[i].lock,NULL);
+	}
+	for(i=0;i<workers;i++)
+	{
+		pool.ids[i]=i;
+		rc=pthread_create(&pool.threads[i], NULL, pool_worker, &pool.ids[i]);
+		if (rc)
+		{
+			printf("ERROR; return code is %d\n", rc);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*************************************************
+Function: void pool_submit(TaskFunc func, int begin, int end, TaskGroup* group);
+Description: put a task of the current run at the bottom of the deque of a worker, the deques are taken in turn so that every worker starts with its share
+Called By: void pool_run(int count, int grain, TaskFunc func);
+Input: func--the function of the task; begin, end--the task calls func(i) for every i in [begin,end); group--the group which waits for the task
+*************************************************/
+void pool_submit(TaskFunc func, int begin, int end, TaskGroup* group)
+{
+	TaskDeque* deque;
+	pthread_mutex_lock(&pool.lock);
+	deque=&pool.deques[pool.next];
+	pool.next=(pool.next+1)%pool.workers;
+	group->unfinished++;
+	pthread_mutex_unlock(&pool.lock);
+	pthread_mutex_lock(&deque->lock);
+	if(deque->bottom>=deque->cap)
+	{
+		if(deque->top>0)
+		{
+			memmove(deque->tasks,deque->tasks+deque->top,(deque->bottom-deque->top)*sizeof(Task));
+			deque->bottom-=deque->top;
+			deque->top=0;
+		}
+		if(deque->bottom>=deque->cap)
+		{
+			deque->cap=(deque->cap==0)?64:2*deque->cap;
+			deque->tasks=(Task*)realloc(deque->tasks,deque->cap*sizeof(Task));
+		}
+	}
+	deque->tasks[deque->bottom].func=func;
+	deque->tasks[deque->bottom].begin=begin;
+	deque->tasks[deque->bottom].end=end;
+	deque->tasks[deque->bottom].run=ctx;
+	deque->tasks[deque->bottom].group=group;
+	deque->bottom++;
+	pthread_mutex_unlock(&deque->lock);
+	pthread_mutex_lock(&pool.lock);
+	pool.queued++;
+	pthread_cond_signal(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*************************************************
+Function: int pool_take(int self, Task* task);
+Description: take a task for a worker. The oldest task of its own deque is taken first, otherwise the oldest task of another deque is stolen. 
+The chunks are submitted in the order of the file, so they are dealt with in that order and the front of the merge(see chunk_done) moves on while the later chunks are dealt with.
+Called By: void *pool_worker(void *arg);
+Input: self--the number of the worker
+Output: task--the task taken
+Return: 1--a task is taken; 0--every deque is empty
+*************************************************/
+int pool_take(int self, Task* task)
+{
+	TaskDeque* deque=&pool.deques[self];
+	int k,got=0;
+	pthread_mutex_lock(&deque->lock);
+	if(deque->bottom>deque->top)
+	{
+		*task=deque->tasks[deque->top++];
+		got=1;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	for(k=1;got==0&&k<pool.workers;k++)
+	{
+		deque=&pool.deques[(self+k)%pool.workers];   //steal from the next workers in turn
+		pthread_mutex_lock(&deque->lock);
+		if(deque->bottom>deque->top)
+		{
+			*task=deque->tasks[deque->top++];
+			got=1;
+		}
+		pthread_mutex_unlock(&deque->lock);
+	}
+	if(got==1)
+	{
+		pthread_mutex_lock(&pool.lock);
+		pool.queued--;
+		pthread_mutex_unlock(&pool.lock);
+	}
+	return got;
+}
+
+/*************************************************
+Function: void *pool_worker(void *arg);
+Description: main function for each worker, it keeps taking tasks(see pool_take) and sleeps while there is none. 
+The tasks of all the runs share the deques, so ctx is set to the run of each task before it is called.
+Called By: int pool_start(int workers);
+Input: arg--the number of this worker
+*************************************************/
+void *pool_worker(void *arg)
+{
+	int self=(int)(*((int*)arg));
+	Task task;
+	int i;
+	while(1)
+	{
+		if(pool_take(self,&task)==1)
+		{
+			ctx=task.run;
+			for(i=task.begin;i<task.end;i++)
+			{
+				task.func(i);
+			}
+			ctx=NULL;
+			pthread_mutex_lock(&pool.lock);
+			task.group->unfinished--;
+			if(task.group->unfinished==0) pthread_cond_broadcast(&pool.done);
+			pthread_mutex_unlock(&pool.lock);
+			continue;
+		}
+		pthread_mutex_lock(&pool.lock);
+		while(pool.queued==0&&pool.stop==0)
+		{
+			pthread_cond_wait(&pool.work,&pool.lock);
+		}
+		if(pool.queued==0&&pool.stop==1)
+		{
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool.lock);
+	}
+	return NULL;
+}
+
+/*************************************************
+Function: void pool_run(int count, int grain, TaskFunc func);
+Description: call func(i) for every i in [0,count) of the current run on the workers and wait until all of them return.
+Every task takes grain numbers, the chunks are given one by one so that they could be stolen one by one. 
+Only the tasks of this call are waited for, so several runs could use the pool at once. 
+Without workers(the sequential version) the calls are made by the caller.
+Called By: int run_chunks(int n, char* file_name, long window_size); int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); int build_index(); int reduce_parts(int base, int count, int start, ResultSet* final_set); int cut_cached();
+Input: count--the number of calls; grain--the number of calls in each task; func--the function
+*************************************************/
+void pool_run(int count, int grain, TaskFunc func)
+{
+	TaskGroup group;
+	int i;
+	if(pool.workers==0)
+	{
+		for(i=0;i<count;i++) func(i);
+		return;
+	}
+	if(grain<1) grain=1;
+	group.unfinished=0;
+	for(i=0;i<count;i+=grain)
+	{
+		pool_submit(func,i,(i+grain<count)?i+grain:count,&group);
+	}
+	pthread_mutex_lock(&pool.lock);
+	while(group.unfinished>0)
+	{
+		pthread_cond_wait(&pool.done,&pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*************************************************
+Function: void pool_stop();
+Description: wake up all the workers and wait until they exit, the pool could not be used after it is stopped
+Called By: void xml_finish();
+*************************************************/
+void pool_stop()
+{
+	int i;
+	pthread_mutex_lock(&pool.lock);
+	pool.stop=1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+	for(i=0;i<pool.workers;i++)
+	{
+		pthread_join(pool.threads[i],NULL);
+	}
+	for(i=0;i<pool.workers;i++)
+	{
+		pthread_mutex_destroy(&pool.deques[i].lock);
+		if(pool.deques[i].tasks!=NULL) free(pool.deques[i].tasks);
+	}
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.work);
+	pthread_cond_destroy(&pool.done);
+	free(pool.deques);
+	free(pool.ids);
+	free(pool.threads);
+}
+
+/*************************************************
+Function: void main_task(int i);
+Description: main function for each chunk, it is called on a worker. The chunk is merged as soon as it and the chunks before it are finished(see chunk_done). 
+A chunk is skipped or stopped once the run is cancelled. The progress of the chunk is printed only for the program(see xmlVerbose).
+Called By: int run_chunks(int n, char* file_name, long window_size); int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); (by pool_run)
+Input: i--the number of this chunk; 
+*************************************************/
+void main_task(int i)
+{
+	int ret = 0;
+	if(__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==1)
+	{
+		chunk_done(i,-1);   //the result is known, the chunk is not needed
+		return;
+	}
+	if(xmlVerbose==1) printf("start to deal with chunk %d.\n",i);
+    if(ctx->speculative==1)
+    {
+    	ret = speculate_part(i);
+    	if(ret==-1&&xmlVerbose==1) printf("No assumption succeeds in chunk %d, the part would be dealt with again while merging.\n",i);
+    	if(xmlVerbose==1) printf("finish dealing with chunk %d.\n",i);
+    	chunk_done(i,(__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==1)?2:1);
+    	return;
+	}
+    if(ctx->splitByThread==1&&ctx->sideBase==NULL)
+    {
+    	if(ctx->isMapped==1) locate_part(i);
+    	else ctx->buffFiles[i]=load_part(i,&ctx->buffLens[i]);
+    	if(ctx->buffFiles[i]==NULL)
+    	{
+    		if(xmlVerbose==1) printf("There are something wrong with the xml file, we can not load it.\n");
+    		chunk_done(i,-1);
+    		return;
+		}
+	}
+    if(ctx->cacheHits!=NULL&&cache_lookup(i)==1)
+    {
+    	if(xmlVerbose==1) printf("take the stack tree of chunk %d from the cache.\n",i);
+    	chunk_done(i,1);   //the part is the same as in the former run
+    	return;
+	}
+    if(ctx->sideBase!=NULL) ret = replay_part(i);    //the markups are taken from the sidecar index, the part is not lexed
+    else ret = process_part(i,ctx->buffFiles[i],ctx->buffLens[i],NULL,i==0&&ctx->windowBase==0);
+    if(xmlVerbose==1) printf("Tree has been created for chunk %d.\n",i);
+    /*printf("The final stack tree for the chunk %d is shown as follows.\n",i);
+	printf("For the start tree\n");
+	print_tree(start_root[i],0);
+    printf("For the finish tree\n");
+    print_tree(finish_root[i],0);*/
+    if(ret==-1)
+    {
+    	if(xmlVerbose==1) printf("There is something wrong with your XML format, please check it!\n");
+    	if(xmlVerbose==1) printf("finish dealing with chunk %d.\n",i);
+    	chunk_done(i,-1);   //finished without a mapping
+    	return;
+	}
+    if(ret==3)
+    {
+    	if(xmlVerbose==1) printf("stop dealing with chunk %d, the result is known.\n",i);
+    	chunk_done(i,2);   //only the beginning of the part is dealt with
+    	return;
+	}
+    if(ctx->cacheHits!=NULL) cache_part(i);    //kept for the next run before the part is merged
+    if(ctx->existsOnly==1&&part_proves(i)==1)
+    {
+    	pthread_mutex_lock(&ctx->mergeLock);
+    	ctx->found=1;
+    	pthread_mutex_unlock(&ctx->mergeLock);
+    	__atomic_store_n(&ctx->cancelled,1,__ATOMIC_RELAXED);
+	}
+    if(xmlVerbose==1) printf("finish dealing with chunk %d.\n",i);
+    chunk_done(i,1);   //the part is merged here if the parts before it are merged
+}
+
+/*************************************************
+Function: int part_proves(int slot);
+Description: tell whether a part takes a text whatever state it starts with, then a text exists whatever the former parts are. 
+A state below the start state which is guessed(see map_stacks) proves nothing.
+Called By: void main_task(int i);
+Input: slot--the slot of the stack tree of the part
+Return: 1--the part takes a text for every start state; 0--it does not
+*************************************************/
+int part_proves(int slot)
+{
+	ResultSet set;
+	int s,texts;
+	if(ctx->dfa.complete==0) return 0;   //the part may start with a state not built yet
+	for(s=0;s<=ctx->dfa.stateCount;s++)
+	{
+		set=get_mapping(slot,s,NULL);
+		texts=(set.begin!=-1&&set.guessed==0)?set.spanCount:0;
+		free(set.spans);
+		free(set.aggs);
+		if(texts==0) return 0;
+	}
+	return 1;
+}
+
+/*************************************************
+Function: void free_tree(int thread_num);
+Description: free the start tree and the finish tree of a thread. The nodes, children arrays and output spans are all kept in the arena of the slot, 
+so the trees are given back by resetting the arena.
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set); int resolve_part(int i); void resume_part(int i); int run_chunks(int n, char* file_name, long window_size);
+Input: thread_num--the number of the thread
+*************************************************/
+void free_tree(int thread_num)
+{
+	arena_reset(thread_num);
+	ctx->start_root[thread_num]=NULL;
+	ctx->finish_root[thread_num]=NULL;
+	ctx->treeExact[thread_num]=0;   //the next tree of the slot assumes every state unless refresh_part says otherwise
+}
+
+/*************************************************
+Function: char* read_window(FILE* fp, char** carry, long* carryLen, long window_size, int* eof, long* len);
+Description: read the next window of the XML file. The window starts with the bytes carried over from the former window and 
+is cut before its last open angle bracket, the bytes after the cut are carried over to the next window. 
+The bracket may be in a comment, a CDATA or a tag, then the merge deals with the next window again from the end of that token(see resume_part).
+Called By: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set);
+Input: fp--the XML file; carry--the bytes carried over from the former window; carryLen--the number of these bytes; window_size--the default size of a window
+Output: carry, carryLen--the bytes for the next window; eof--1 if the end of the file has been reached; len--the length of the window
+Return: the '\0' terminated window
+*************************************************/
+char* read_window(FILE* fp, char** carry, long* carryLen, long window_size, int* eof, long* len)
+{
+	char* buff;
+	long size,k,cut;
+	size=*carryLen;
+	buff=(char*)malloc((size+window_size+1)*sizeof(char));
+	if(*carryLen>0) memcpy(buff,*carry,*carryLen);
+	if(*carry!=NULL) free(*carry);
+	*carry=NULL;
+	*carryLen=0;
+	cut=0;
+	while(cut==0&&*eof==0)
+	{
+		k=fread(buff+size,1,window_size,fp);
+		size+=k;
+		if(k<window_size)
+		{
+			*eof=1;
+			break;
+		}
+		/*look for the last open angle bracket, the part after it might be an unfinished element*/
+		for(cut=size-1;cut>0&&buff[cut]!='<';cut--);
+		if(cut==0)
+		{
+			buff=(char*)realloc(buff,(size+window_size+1)*sizeof(char));  //no bracket in this window, read more
+		}
+	}
+	if(*eof==1) cut=size;
+	if(cut<size)
+	{
+		*carryLen=size-cut;
+		*carry=(char*)malloc((*carryLen)*sizeof(char));
+		memcpy(*carry,buff+cut,*carryLen);
+	}
+	buff[cut]='\0';
+	*len=cut;
+	return buff;
+}
+
+/*************************************************
+Function: int stream_file(char* file_name, int n, long window_size, ResultSet* final_set);
+Description: streaming version for the files larger than the memory. The file is read window by window, n windows are dealt with by n threads at the same time, 
+then their mappings are merged into the final mapping and the windows and stack trees are released before the next n windows are read. 
+So the peak memory depends on n and window_size instead of the size of the file. No more window is read once the run is cancelled. 
+The lexer state at the end of a batch is carried to the next one(see lexState).
+Called By: int run_chunks(int n, char* file_name, long window_size);
+Input: file_name--the name for the xml file; n--the number of threads; window_size--the default size of a window
+Output: final_set--the final mapping for the whole file
+Return: the number of windows; -1--can't open the XML file; -2--the XML file is wrong or the mappings could not be merged
+*************************************************/
+int stream_file(char* file_name, int n, long window_size, ResultSet* final_set)
+{
+	FILE *fp;
+	char* carry=NULL;
+	long carryLen=0;
+	int eof=0;
+	int i,count;
+	int ret=0;
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return -1;}
+	alloc_chunks(n);
+	init_result(final_set);
+	ctx->windowBase=0;
+	while(ret==0&&(eof==0||carryLen>0)&&__atomic_load_n(&ctx->cancelled,__ATOMIC_RELAXED)==0)
+	{
+		for(count=0;count<n&&(eof==0||carryLen>0);count++)
+		{
+			ctx->buffFiles[count]=read_window(fp,&carry,&carryLen,window_size,&eof,&ctx->buffLens[count]);
+		}
+		begin_merge(final_set,count);
+		pool_run(count,1,main_task);    //the windows are merged while the later ones are being dealt with
+		if(getresult()==-1) ret=-2;
+		for(i=0;i<count;i++)
+		{
+			free_tree(i);
+		}
+		flush_result(final_set);   //the texts are copied out before the windows are released
+		release_parts();
+		ctx->windowBase+=count;
+	}
+	if(carry!=NULL) free(carry);
+	fclose(fp);
+	if(ret!=0) return ret;
+	return ctx->windowBase;
+}
+
+/*************************************************
+Function: void main_function();
+Description: main function for sequential version. 
+Called By: int run_chunks(int n, char* file_name, long window_size);
+*************************************************/
+void main_function()
+{
+	if(xmlVerbose==1) printf("begin dealing with the state tree.\n");
+	int ret = 0;
+    xml_Text xml;
+    xml_Token token;               
+    int multiExp = 0; //0--single line explanation 1-- multiline explanation
+    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
+    int i=0;
+    int j;
+    if(i==0) 
+	{
+		createTree_first(1);
+	}
+    else {
+    	createTree(i);
+	}
+    ctx->finish_root[i]->state=-1;
+    ctx->start_root[i]->state=-1;
+    if(xmlVerbose==1) printf("Tree has been created.\n");
+    /*printf("The initial stack tree is shown as follows.\n");
+	printf("For the start tree\n");
+	print_tree(start_root[i],0);
+    printf("For the finish tree\n");
+    print_tree(finish_root[i],0);
+    printf("The results are listed as follows:\n");*/
+    ctx->spanBase[i]=ctx->buffFiles[i];
+    xml_initText(&xml,ctx->buffFiles[i]);
+    xml_initToken(&token, &xml);
+    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);    //the file is released after the result is printed
+    if(ret==-1)
+    {
+    	if(xmlVerbose==1) printf("There is something wrong with your XML format, please check it!\n");
+    	if(xmlVerbose==1) printf("finish dealing with the state tree.\n");
+    	return;
+	}
+    if(ret==3)
+    {
+    	chunk_done(i,2);   //the first texts are found, the rest of the file is not dealt with
+    	if(xmlVerbose==1) printf("stop dealing with the state tree, the result is known.\n");
+    	return;
+	}
+    /*printf("The final stack tree is shown as follows.\n");
+	printf("For the start tree\n");
+	print_tree(start_root[i],0);
+    printf("For the finish tree\n");
+    print_tree(finish_root[i],0);*/
+    chunk_done(i,1);
+    if(xmlVerbose==1) printf("finish dealing with the state tree.\n");
+}
+
+/*************************************************
+Function: int xml_init(int workers);
+Description: get the library ready, the scanner is chosen for the CPU and the workers are started. The workers are shared by all the runs.
+Called By: int main(void); the programs using the library
+Input: workers--the number of workers, 0 for the number of CPUs, -1 for no worker(every run is dealt with by its caller alone)
+Return: 0--success; -1--the workers could not be started
+*************************************************/
+int xml_init(int workers)
+{
+	pthread_once(&scannerOnce,init_scanner);
+	if(workers<0) return 0;
+	workerCount=(workers>0)?workers:hardware_threads();
+	return pool_start(workerCount);
+}
+
+/*************************************************
+Function: void xml_finish();
+Description: stop the workers started by xml_init, no run should be going on
+Called By: int main(void); the programs using the library
+*************************************************/
+void xml_finish()
+{
+	if(pool.workers>0) pool_stop();
+	pool.workers=0;
+}
+
+/*************************************************
+Function: Query* xml_compile(const char* xpath);
+Description: compile one or more XPaths into a query, the XPaths of the caller are copied before they are cut into the tag names. 
+The XPaths share one automata(see createAutoMachine), so they are all run in one pass over the input and each of them gets its own texts(see xml_next_query_result). 
+The query is only read by the runs, so it could be used by any number of runs at once.
+Called By: int main(void); the programs using the library
+Input: xpath--the XPaths separated by '|' or new lines, e.g. /company/develop/programmer or /company/develop/programmer|//tester or //programmer[@age="35"]
+Return: the query; NULL--no XPath, out of memory, more steps, states, XPaths or predicates than the automata could hold, or a predicate which could not be parsed
+*************************************************/
+Query* xml_compile(const char* xpath)
+{
+	Query* query;
+	char* path;
+	if(xpath==NULL) return NULL;
+	query=(Query*)calloc(1,sizeof(Query));
+	path=(char*)malloc((strlen(xpath)+1)*sizeof(char));
+	if(query==NULL||path==NULL)
+	{
+		free(query);
+		free(path);
+		return NULL;
+	}
+	strcpy(path,xpath);
+	query->machineCount=1;
+	query->fingerprint=content_hash(xpath,strlen(xpath),0);
+	if(createAutoMachine(query,path)==-1)
+	{
+		free(path);
+		xml_free_query(query);
+		return NULL;
+	}
+	free(path);
+	return query;
+}
+
+/*************************************************
+Function: void xml_free_query(Query* query);
+Description: free a query, no run of it should be going on
+Called By: int main(void); the programs using the library
+Input: query--the query
+*************************************************/
+void xml_free_query(Query* query)
+{
+	int i;
+	if(query==NULL) return;
+	for(i=1;i<2*MAX_STATE;i++)
+	{
+		free(query->stateMachine[i].str);
+	}
+	for(i=0;i<MAX_STATE;i++)
+	{
+		free(query->stepFilters[i]);
+	}
+	for(i=0;i<query->predCount;i++)
+	{
+		free(query->preds[i].name);
+		free(query->preds[i].value);
+	}
+	free(query);
+}
+
+/*************************************************
+Function: int xml_query_count(Query* query);
+Description: tell how many XPaths are compiled into a query
+Called By: int main(void); the programs using the library
+Input: query--the query
+Return: the number of XPaths, the ids given to xml_next_query_result are 0 to the number-1
+*************************************************/
+int xml_query_count(Query* query)
+{
+	return query->queryCount;
+}
+
+/*************************************************
+Function: RunContext* run_create(Query* query, int mode);
+Description: create an empty run of a query
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly); RunContext* xml_run_buffer(Query* query, const char* buff, long len, int mode); int xml_build_index(const char* file_name); RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name); RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Input: query--the compiled query; mode--the version of the run(see main)
+Return: the run; NULL--out of memory
+*************************************************/
+RunContext* run_create(Query* query, int mode)
+{
+	RunContext* run;
+	pthread_once(&scannerOnce,init_scanner);   //the caller may not have called xml_init
+	run=(RunContext*)calloc(1,sizeof(RunContext));
+	if(run==NULL) return NULL;
+	run->query=query;
+	run->mode=mode;
+	run->reduceRound=1;
+	run->indexChunks=1;
+	pthread_mutex_init(&run->mergeLock,NULL);
+	pthread_mutex_init(&run->dfaLock,NULL);
+	if(query!=NULL) memcpy(&run->dfa,&query->dfa,sizeof(Dfa));   //the run builds its own states on top of the ones compiled
+	init_result(&run->result);
+	return run;
+}
+
+/*************************************************
+Function: int run_chunks(int n, char* file_name, long window_size);
+Description: deal with the input of the current run, which has been cut into chunks, and merge the mapping into its result. 
+The stack trees are released at the end, the parts are kept since the texts of the result point into them.
+Called By: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly); RunContext* xml_run_buffer(Query* query, const char* buff, long len, int mode); RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name); RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Input: n--the number of chunks(start with 0); file_name--the name for the xml file(streaming version only); window_size--the default size of a window(streaming version only)
+Return: 0--success(the mapping may still be null, see status); -1--can't open the XML file
+*************************************************/
+int run_chunks(int n, char* file_name, long window_size)
+{
+	ResultSet* set=&ctx->result;
+	int i;
+	int merged=(ctx->mode!=3&&(ctx->mode!=5||ctx->sideBase!=NULL));   //the chunks are merged by getresult
+	if(merged==1)
+	{
+		begin_merge(set,n+1);    //the chunks are merged as they finish
+	}
+	if(ctx->mode==0)
+	{
+		main_function();
+	}
+	else if(ctx->mode==3)
+	{
+		n=stream_file(file_name,(workerCount>0)?workerCount:1,window_size,set);    //read, deal with and merge the file window by window, one window for each worker
+		if(n==-1) return -1;
+	}
+	else if(ctx->mode==5&&ctx->sideBase==NULL)
+	{
+		if(build_index()==-1||walk_index(set)==-1)    //stage 1 in parallel, then stage 2 over the index
+		{
+			if(xmlVerbose==1) printf("There is something wrong with your XML format, please check it!\n");
+			set->begin=-1;
+		}
+	}
+	else
+	{
+		pool_run(n+1,1,main_task);    //parallel xml processing, the workers steal the chunks from each other
+	}
+	if(merged==1) getresult();
+	if(ctx->limit>0) result_trim(set,ctx->limit);    //the parts merged at once may give more texts than the limit
+	for(i=0;i<ctx->slotCount;i++)
+	{
+		if(ctx->start_root[i]!=NULL) free_tree(i);    //the mappings are taken, release the stack trees in one shot
+	}
+	ctx->status=(set->begin==-1||ctx->dfa.full==1)?-1:0;   //a run which needs more states than the stack trees hold has no mapping
+	return 0;
+}
+
+/*************************************************
+Function: RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly);
+Description: run a query over an XML file, the run is dealt with by the caller and the workers and is finished when it returns. 
+With a limit the run is cancelled as soon as the first limit texts are known, the chunks not started yet are skipped and the ones being dealt with stop at the next check.
+Called By: RunContext* xml_run_file(Query* query, const char* file_name, int mode, long window_size); 
+RunContext* xml_run_file_limit(Query* query, const char* file_name, int mode, long window_size, long limit); int xml_exists_file(Query* query, const char* file_name, int mode, long window_size);
+Input: query--the compiled query; file_name--the name for the xml file; mode--the version(see xml_run_file); window_size--the default size of a window in bytes(streaming version only), 0 for DEFAULT_WINDOW; 
+limit--the number of texts wanted, 0 for all of them; existsOnly--1 if any chunk proving that there is a text could cancel the run
+Return: the run holding the result; NULL--can't open the XML file or the arguments are wrong
+*************************************************/
+RunContext* run_file(Query* query, const char* file_name, int mode, long window_size, long limit, int existsOnly)
+{
+	RunContext* saved=ctx;
+	RunContext* run;
+	char* name=(char*)file_name;
+	int n=0;
+	if(query==NULL||file_name==NULL||mode<0||mode>5||limit<0) return NULL;
+	if(window_size<1) window_size=DEFAULT_WINDOW;
+	run=run_create(query,mode);
+	if(run==NULL) return NULL;
+	run->limit=limit;
+	run->existsOnly=existsOnly;
+	ctx=run;
+	if(mode==0)
+	{
+		alloc_chunks(1);
+		n=load_file(name);    //load file into memory
+	}
+	else if(mode==1)
+	{
+		n=split_file(name);    //split file into chunks
+	}
+	else if(mode!=3)
+	{
+		n=map_file(name);    //map file into memory and cut it into views
+		if(mode==4) ctx->speculative=1;    //the views are cut at exact sizes
+		if(mode==5&&n!=-1) open_sidecar(name);    //the file is not lexed again if its sidecar index is up to date
+	}
+	if(n==-1||run_chunks(n,name,window_size)==-1)
+	{
+		ctx=saved;
+		xml_free_run(run);
+		return NULL;
+	}
+	ctx=saved;
+	return run;
+}
+
+/*************************************************
+Function: RunContext* xml_run_file(Query* query, const char* file_name, int mode, long window_size);
+Description: run a query over an XML file and keep all the texts found
+Called By: int main(void); the programs using the library
+Input: query--the compiled query; file_name--the name for the xml file; mode--the version(0--sequential version, 1--parallel version, 
+2--parallel version with mmap input, 3--streaming version for large files, 4--parallel version with speculative lexing, 5--parallel version with structural index); 
+window_size--the default size of a window in bytes(streaming version only), 0 for DEFAULT_WINDOW
+Return: the run holding the result; NULL--can't open the XML file or the arguments are wrong
+*************************************************/
+RunContext* xml_run_file(Query* query, const char* file_name, int mode, long window_size)
+{
+	return run_file(query,file_name,mode,window_size,0,0);
+}
+
+/*************************************************
+Function: RunContext* xml_run_file_limit(Query* query, const char* file_name, int mode, long window_size, long limit);
+Description: run a query over an XML file and keep only the first limit texts in the order of the file, the run stops early once they are known
+Called By: the programs using the library
+Input: query--the compiled query; file_name--the name for the xml file; mode--the version(see xml_run_file); 
+window_size--the default size of a window in bytes(streaming version only); limit--the number of texts wanted, 0 for all of them
+Return: the run holding the result; NULL--can't open the XML file or the arguments are wrong
+*************************************************/
+RunContext* xml_run_file_limit(Query* query, const char* file_name, int mode, long window_size, long limit)
+{
+	return run_file(query,file_name,mode,window_size,limit,0);
+}
+
+/*************************************************
+Function: int xml_exists_file(Query* query, const char* file_name, int mode, long window_size);
+Description: tell whether a query gives any text over an XML file, the run stops as soon as the first text is known, 
+or as soon as a chunk gives a text whatever the chunks before it are(not for the speculative version)
+Called By: the programs using the library
+Input: query--the compiled query; file_name--the name for the xml file; mode--the version(see xml_run_file); window_size--the default size of a window in bytes(streaming version only)
+Return: 1--there is a text; 0--there is no text; -1--can't open the XML file or the XML text is wrong
+*************************************************/
+int xml_exists_file(Query* query, const char* file_name, int mode, long window_size)
+{
+	RunContext* run=run_file(query,file_name,mode,window_size,1,1);
+	int ret;
+	if(run==NULL) return -1;
+	if(run->found==1||result_texts(&run->result)>0) ret=1;
+	else ret=(run->status==-1)?-1:0;
+	xml_free_run(run);
+	return ret;
+}
+
+/*************************************************
+Function: int dfa_save(SavedState* states);
+Description: copy the states built by the run for the next run(see dfa_restore), the parts are all dealt with so none is being built
+Called By: int save_state(const char* state_name, long offset); int save_cache(const char* cache_name);
+Output: states--the steps, the carry and the tags of states 1 to the number returned, MAX_STATE-1 at most
+Return: the number of states
+*************************************************/
+int dfa_save(SavedState* states)
+{
+	int k;
+	for(k=1;k<=ctx->dfa.stateCount;k++)
+	{
+		memset(&states[k-1],0,sizeof(SavedState));   //the padding is written as 0
+		states[k-1].steps=ctx->dfa.stateSteps[k];
+		states[k-1].carry=ctx->dfa.stateCarry[k];
+		states[k-1].tags=ctx->dfa.stateTags[k];
+	}
+	return ctx->dfa.stateCount;
+}
+
+/*************************************************
+Function: int dfa_restore(SavedState* states, int count);
+Description: take the states saved by a former run of the same query(see dfa_save) into the automata of the run before any part is dealt with, 
+so a state number kept with them means the same set of steps. The states compiled are the first ones of every run, the others are added in their order, 
+and their transitions are built again as the tags reach them. The tags entering a state are taken too, as an end tag may pop a state 
+of the stack saved before any transition into it is built again(see pop).
+Called By: long load_state(const char* state_name); int load_cache(const char* cache_name);
+Input: states--the steps, the carry and the tags of states 1 to count
+Return: 0--success; -1--the states were saved for other automata, none of them is taken
+*************************************************/
+int dfa_restore(SavedState* states, int count)
+{
+	Dfa* dfa=&ctx->dfa;
+	int k,j;
+	if(count<dfa->stateCount||count>=MAX_STATE||(dfa->complete==1&&count!=dfa->stateCount)) return -1;
+	for(k=1;k<=count;k++)
+	{
+		if(k<=dfa->stateCount&&(states[k-1].steps!=dfa->stateSteps[k]||states[k-1].carry!=dfa->stateCarry[k])) return -1;
+		if(ctx->query->tagCount<64&&(states[k-1].tags>>ctx->query->tagCount)!=0) return -1;
+		for(j=1;j<k;j++)
+		{
+			if(states[j-1].steps==states[k-1].steps&&states[j-1].carry==states[k-1].carry) return -1;   //a set of steps is one state
+		}
+	}
+	for(k=dfa->stateCount+1;k<=count;k++)
+	{
+		dfa_add(ctx->query,dfa,states[k-1].steps,states[k-1].carry);
+	}
+	for(k=1;k<=count;k++)
+	{
+		dfa->stateTags[k]|=states[k-1].tags;
+	}
+	return 0;
+}
+
+/*************************************************
+Function: long load_state(const char* state_name);
+Description: take the state saved by a former run over the same file into the result of the run. It is taken only if it was saved for the same query 
+and the file has only grown since, that is the file is not shorter and the APPEND_TAIL bytes before the offset saved give the same hash. 
+The texts saved are offsets into the file, they are turned into spans of the mapping again, and the lexer state at the offset is given back to lexState. 
+The states of the automata built by the former run are taken first, the stacks and the texts saved are in them.
+Called By: RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name);
+Input: state_name--the name for the state file, the whole file is the mapping of the run
+Output: the result of the run
+Return: the offset to go on from; 0--there is no state for this query and this file, the file is dealt with from the beginning
+*************************************************/
+long load_state(const char* state_name)
+{
+	AppendHead head;
+	SavedSpan span;
+	SavedState states[MAX_STATE];
+	ResultSet* set=&ctx->result;
+	FILE* fp=fopen(state_name,"rb");
+	long k,from;
+	int ok;
+	if(fp==NULL) return 0;
+	ok=fread(&head,sizeof(head),1,fp)==1&&memcmp(head.magic,APPEND_MAGIC,sizeof(APPEND_MAGIC))==0&&head.query==ctx->query->fingerprint
+		&&head.offset>0&&head.offset<=ctx->mapSize&&head.spanCount>=0&&(head.aggCount==0||head.aggCount==ctx->query->queryCount)
+		&&head.topbegin>=0&&head.topbegin<=MAX_SIZE&&head.topend>=0&&head.topend<=MAX_SIZE&&head.lexState>=0&&head.lexState<XML_STATES
+		&&head.stateCount>0&&head.stateCount<MAX_STATE;
+	if(ok)
+	{
+		from=(head.offset>APPEND_TAIL)?head.offset-APPEND_TAIL:0;
+		ok=(content_hash(ctx->mapBase+from,head.offset-from,0)==head.tail);   //the file has been changed, not only appended to
+	}
+	if(ok) ok=fread(states,sizeof(SavedState),head.stateCount,fp)==(size_t)head.stateCount&&dfa_restore(states,head.stateCount)==0;
+	if(ok)
+	{
+		set->begin=head.begin;
+		set->topbegin=head.topbegin;
+		memcpy(set->begin_stack,head.begin_stack,sizeof(head.begin_stack));
+		set->end=head.end;
+		set->topend=head.topend;
+		memcpy(set->end_stack,head.end_stack,sizeof(head.end_stack));
+		ctx->lexState=head.lexState;
+		for(k=0;ok&&k<head.spanCount;k++)
+		{
+			ok=fread(&span,sizeof(span),1,fp)==1&&span.offset>=0&&span.len>=0&&span.offset+span.len<=head.offset&&span.state>0&&span.state<=head.stateCount;
+			if(ok) result_add_span(set,ctx->mapBase+span.offset,span.len,span.state);
+		}
+		if(ok&&head.aggCount>0)
+		{
+			set->aggs=(Aggregate*)malloc(head.aggCount*sizeof(Aggregate));
+			ok=fread(set->aggs,sizeof(Aggregate),head.aggCount,fp)==head.aggCount;
+		}
+	}
+	fclose(fp);
+	if(!ok)
+	{
+		free(set->spans);
+		free(set->aggs);
+		init_result(set);
+		ctx->lexState=0;
+		return 0;
+	}
+	return head.offset;
+}
+
+/*************************************************
+Function: int save_state(const char* state_name, long offset);
+Description: save the result of a run over a file which only grows, so that the next run goes on from offset(see load_state). 
+The state is written into a temporary file first and renamed at last, so a run never takes half of a state.
+Called By: RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name);
+Input: state_name--the name for the state file; offset--the bytes of the file dealt with, the texts of the result are all before it
+Return: 0--success; -1--the state could not be written
+*************************************************/
+int save_state(const char* state_name, long offset)
+{
+	AppendHead head;
+	SavedSpan span;
+	SavedState states[MAX_STATE];
+	ResultSet* set=&ctx->result;
+	char* temp=(char*)malloc(strlen(state_name)+5);
+	FILE* fp;
+	long k,from;
+	int ok;
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,APPEND_MAGIC,sizeof(APPEND_MAGIC));
+	head.query=ctx->query->fingerprint;
+	head.offset=offset;
+	from=(offset>APPEND_TAIL)?offset-APPEND_TAIL:0;
+	head.tail=content_hash(ctx->appendBase+from,offset-from,0);
+	head.lexState=ctx->lexState;
+	head.begin=set->begin;
+	head.topbegin=set->topbegin;
+	memcpy(head.begin_stack,set->begin_stack,sizeof(head.begin_stack));
+	head.end=set->end;
+	head.topend=set->topend;
+	memcpy(head.end_stack,set->end_stack,sizeof(head.end_stack));
+	head.stateCount=dfa_save(states);
+	head.spanCount=set->spanCount;
+	head.aggCount=(set->aggs!=NULL)?ctx->query->queryCount:0;
+	sprintf(temp,"%s.tmp",state_name);
+	fp=fopen(temp,"wb");
+	ok=(fp!=NULL);
+	if(ok)
+	{
+		ok=fwrite(&head,sizeof(head),1,fp)==1&&fwrite(states,sizeof(SavedState),head.stateCount,fp)==(size_t)head.stateCount;
+		for(k=0;ok&&k<set->spanCount;k++)
+		{
+			span.offset=set->spans[k].p-ctx->appendBase;
+			span.len=set->spans[k].len;
+			span.state=set->spans[k].state;
+			ok=fwrite(&span,sizeof(span),1,fp)==1;
+		}
+		if(ok&&head.aggCount>0) ok=fwrite(set->aggs,sizeof(Aggregate),head.aggCount,fp)==head.aggCount;
+		ok=(fclose(fp)==0)&&ok;
+	}
+	remove(state_name);   //rename does not replace a file on windows
+	if(ok) ok=(rename(temp,state_name)==0);
+	if(!ok) remove(temp);
+	free(temp);
+	return ok?0:-1;
+}
+
+/*************************************************
+Function: RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name);
+Description: run a query over an XML file which only grows at its end, such as a log, with the parallel version with mmap input. 
+The result of the former run is taken from the state file(see load_state), only the bytes added since are cut into chunks and dealt with, 
+and their parts are merged onto the saved stacks as the windows of the streaming version are. The bytes after the last open angle bracket 
+may be an element still being written, so they are left to the next run, and the state of the new result is saved for it. 
+That bracket may be inside a comment or CDATA, so the lexer state there is saved too and the next run starts from it(see resume_part). 
+The whole file is mapped, but the bytes dealt with before are read only for the hash of their tail and for the texts asked for.
+Called By: int main(void); the programs using the library
+Input: query--the compiled query; file_name--the name for the xml file; state_name--the name for the state file, it is created by the first run
+Return: the run holding the result for the file up to its last open angle bracket; NULL--can't open the XML file or the arguments are wrong
+*************************************************/
+RunContext* xml_run_append(Query* query, const char* file_name, const char* state_name)
+{
+	RunContext* saved=ctx;
+	RunContext* run;
+	char* name=(char*)file_name;
+	long from,cut;
+	int n;
+	if(query==NULL||file_name==NULL||state_name==NULL) return NULL;
+	run=run_create(query,2);
+	if(run==NULL) return NULL;
+	ctx=run;
+	if(open_mapping(name)==-1)
+	{
+		ctx=saved;
+		xml_free_run(run);
+		return NULL;
+	}
+	from=load_state(state_name);
+	for(cut=ctx->mapSize-1;cut>from&&ctx->mapBase[cut]!='<';cut--);
+	if(cut<from) cut=from;
+	/*the mapping of the run is cut down to the new bytes*/
+	ctx->appendBase=ctx->mapBase;
+	ctx->appendSize=ctx->mapSize;
+	ctx->mapBase+=from;
+	ctx->mapSize=cut-from;
+	ctx->windowBase=(from>0)?1:0;
+	if(ctx->mapSize>0)
+	{
+		n=cut_mapping();
+		if(run_chunks(n,name,0)==-1)
+		{
+			ctx=saved;
+			xml_free_run(run);
+			return NULL;
+		}
+		if(ctx->status==0) save_state(state_name,cut);
+	}
+	else ctx->status=(ctx->result.begin==-1)?-1:0;
+	ctx=saved;
+	return run;
+}
+
+/*************************************************
+Function: int cut_cached();
+Description: cut the mapping into chunks whose cuts depend on the bytes around them only, so an edit moves the cuts near it and the other chunks 
+stay the same bytes as in the former run(see xml_run_cached). A gear hash, which forgets a byte after CACHE_WINDOW more bytes, picks the points 
+where its top bits are 0, the workers look for them in parallel(see cache_scan), and each chunk is cut at the first open angle bracket after a point. 
+That bracket may be inside a comment or CDATA, then the merge deals with the chunk again from the end of it(see resume_part), whether or not its tree is taken from the cache. 
+A point too close to the last cut is passed over, and a chunk with no point is cut at its largest size. The average size of a chunk is about 
+CACHE_CHUNK, it is doubled for a large file until there are no more than CACHE_CHUNKS chunks, so it is not changed by the number of workers.
+Called By: RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Return: the number of chunks(start with 0)
+*************************************************/
+int cut_cached()
+{
+	unsigned long long x;
+	long target=CACHE_CHUNK;
+	long size=ctx->mapSize;
+	long least,most,prev,p,r,k,regions,cap;
+	long* cuts;
+	char* next;
+	int n,bits;
+	while(target*CACHE_CHUNKS<size) target*=2;
+	for(bits=0;(1L<<bits)<target;bits++);
+	least=target/4;
+	most=target*4;
+	ctx->cacheShift=64-bits;   //a point every target bytes on average
+	for(k=0;k<256;k++)
+	{
+		x=(unsigned long long)k*0x9E3779B97F4A7C15ull+0x632BE59BD9B4E019ull;   //splitmix64, the table is the same for every run
+		x=(x^(x>>30))*0xBF58476D1CE4E5B9ull;
+		x=(x^(x>>27))*0x94D049BB133111EBull;
+		ctx->cacheGear[k]=x^(x>>31);
+	}
+	ctx->cacheRegion=target;
+	regions=size/target+1;
+	ctx->cachePoints=(long**)calloc(regions,sizeof(long*));
+	ctx->cachePointCounts=(long*)calloc(regions,sizeof(long));
+	pool_run(regions,1,cache_scan);
+	cap=size/least+2;
+	cuts=(long*)malloc((cap+1)*sizeof(long));
+	n=0;
+	cuts[n++]=0;
+	prev=0;
+	for(r=0;r<=regions;r++)
+	{
+		for(k=0;prev>=0&&k<((r<regions)?ctx->cachePointCounts[r]:1);k++)
+		{
+			p=(r<regions)?ctx->cachePoints[r][k]:size;   //the end of the mapping at last
+			while(prev>=0&&p-prev>most)   //no point in the largest size of a chunk
+			{
+				next=(char*)memchr(ctx->mapBase+prev+most,'<',size-prev-most);
+				prev=(next==NULL)?-1:next-ctx->mapBase;
+				if(prev>=0) cuts[n++]=prev;
+			}
+			if(prev<0||r==regions||p-prev<least) continue;
+			next=(char*)memchr(ctx->mapBase+p+1,'<',size-p-1);
+			prev=(next==NULL)?-1:next-ctx->mapBase;
+			if(prev>=0) cuts[n++]=prev;
+		}
+		if(r<regions) free(ctx->cachePoints[r]);
+	}
+	free(ctx->cachePoints);
+	free(ctx->cachePointCounts);
+	ctx->cachePoints=NULL;
+	ctx->cachePointCounts=NULL;
+	n--;
+	cuts[n+1]=size;
+	ctx->isMapped=1;
+	ctx->partFileSize=size;
+	alloc_chunks(n+1);
+	ctx->cacheCuts=cuts;
+	ctx->splitByThread=1;
+	return n;
+}
+
+/*************************************************
+Function: void cache_scan(int r);
+Description: find the points of one region of the mapping where the chunks may be cut(see cut_cached). The hash of a byte depends on the 
+CACHE_WINDOW bytes before it only, so the region starts hashing that many bytes early and finds the same points as a scan from the beginning.
+Called By: int cut_cached(); (on the workers)
+Input: r--the number of the region
+*************************************************/
+void cache_scan(int r)
+{
+	unsigned long long h=0;
+	unsigned char* s=(unsigned char*)ctx->mapBase;
+	long begin=r*ctx->cacheRegion;
+	long end=begin+ctx->cacheRegion;
+	long p,cap=0;
+	if(end>ctx->mapSize) end=ctx->mapSize;
+	for(p=(begin>CACHE_WINDOW)?begin-CACHE_WINDOW:0;p<begin;p++)
+	{
+		h=(h<<1)+ctx->cacheGear[s[p]];
+	}
+	for(;p<end;p++)
 	{
-		strcat(multiExpContent[thread_num],ltrim(pToken->text.p));
-		return 1;
-	} 
-	else if(state == 17)
+		h=(h<<1)+ctx->cacheGear[s[p]];
+		if((h>>ctx->cacheShift)!=0) continue;
+		if(ctx->cachePointCounts[r]==cap)
+		{
+			cap=(cap==0)?8:2*cap;
+			ctx->cachePoints[r]=(long*)realloc(ctx->cachePoints[r],cap*sizeof(long));
+		}
+		ctx->cachePoints[r][ctx->cachePointCounts[r]++]=p;
+	}
+}
+
+/*************************************************
+Function: int cache_entry_compare(const void* a, const void* b);
+Description: order the entries of a chunk cache by their keys, for qsort and bsearch
+Called By: int cache_lookup(int i); int save_cache(const char* cache_name);
+*************************************************/
+int cache_entry_compare(const void* a, const void* b)
+{
+	unsigned long long x=((const CacheEntry*)a)->key;
+	unsigned long long y=((const CacheEntry*)b)->key;
+	return (x<y)?-1:(x>y);
+}
+
+/*************************************************
+Function: int cache_lookup(int i);
+Description: look for the stack tree of a chunk in the cache of the run, by the hash of its bytes and the fingerprint of the query. 
+The first chunk of the file is hashed with another seed, as it is lexed from the beginning of the file.
+Called By: void main_task(int i);
+Input: i--the number of the chunk, its view has been located
+Return: 1--the stack tree is found and rebuilt, the chunk is not dealt with; 0--the chunk is dealt with as usual
+*************************************************/
+int cache_lookup(int i)
+{
+	CacheEntry key;
+	CacheEntry* entry;
+	ctx->cacheKeys[i]=content_hash(ctx->buffFiles[i],ctx->buffLens[i],ctx->query->fingerprint+(i==0));
+	if(ctx->cacheEntryCount==0) return 0;
+	key.key=ctx->cacheKeys[i];
+	entry=(CacheEntry*)bsearch(&key,ctx->cacheEntries,ctx->cacheEntryCount,sizeof(CacheEntry),cache_entry_compare);
+	if(entry==NULL||entry->len!=ctx->buffLens[i]||load_tree(i,ctx->cacheData+entry->offset,entry->size)==-1) return 0;
+	ctx->cacheHits[i]=ctx->cacheData+entry->offset;
+	ctx->cacheSizes[i]=entry->size;
+	return 1;
+}
+
+/*************************************************
+Function: long tree_index(TreeIndex* index, Node* node);
+Description: number the nodes of a stack tree for the chunk cache, a node is numbered the first time it is seen. 
+The numbers are found by a hash of the addresses of the nodes, the table is doubled when it is half full.
+Called By: void cache_part(int i);
+Input: index--the nodes numbered so far; node--the node, NULL is -1
+Output: index--the node is added if it is new
+Return: the number of the node
+*************************************************/
+long tree_index(TreeIndex* index, Node* node)
+{
+	unsigned long long h;
+	long k,cap;
+	if(node==NULL) return -1;
+	if(2*(index->count+1)>index->tableCap)
 	{
-		strcat(multiCDATAContent[thread_num],ltrim(pToken->text.p));
-		return 2;
-	}*/
-	else if(state == 7)
+		cap=(index->tableCap==0)?256:2*index->tableCap;
+		free(index->table);
+		index->table=(long*)calloc(cap,sizeof(long));
+		index->tableCap=cap;
+		index->nodes=(Node**)realloc(index->nodes,cap/2*sizeof(Node*));
+		for(k=0;k<index->count;k++)   //the nodes are put into the larger table again
+		{
+			h=((unsigned long long)(size_t)index->nodes[k]>>4)*0x9E3779B97F4A7C15ull;
+			for(h&=cap-1;index->table[h]!=0;h=(h+1)&(cap-1));
+			index->table[h]=k+1;
+		}
+	}
+	h=((unsigned long long)(size_t)node>>4)*0x9E3779B97F4A7C15ull;
+	for(h&=index->tableCap-1;index->table[h]!=0;h=(h+1)&(index->tableCap-1))
 	{
-		p--;
-        pToken->text.len = p - start + 1;
-        if(pToken->text.len>1)
-        {
-        	//printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-            //printf("%s","content=");
-            //xml_print(&pToken->text, 0 , pToken->text.len);
-            //printf(";\n\n");
-             for(j=1;j<=stateCount;j++)
-            {
-                if(finish_root[thread_num]->children[j]!=NULL)
-                {
-                    if(finish_root[thread_num]->children[j]->state<=stateCount)
-                    {
-					    break;
-				    }       	   	   
-			    }
-		    }
-		    if(finish_root[thread_num]->children[j]->state>1){	   
-		        if(stateMachine[2*(finish_root[thread_num]->children[j]->state-1)].isoutput==1)
-		        {
-		        	if(finish_root[thread_num]->children[j]->hasOutput==1)
-						finish_root[thread_num]->children[j]->output=strcat(finish_root[thread_num]->children[j]->output," ");
-			        else finish_root[thread_num]->children[j]->hasOutput=1;
-			        char* sub=substring(pToken->text.p , 0 , pToken->text.len);
-			        finish_root[thread_num]->children[j]->output=strcat(finish_root[thread_num]->children[j]->output,sub);
-			        if(sub!=NULL) free(sub);
-		        }	          
-     	    }
-        }
-		return 0;
+		if(index->nodes[index->table[h]-1]==node) return index->table[h]-1;
 	}
-    else return 0;
+	index->nodes[index->count]=node;
+	index->table[h]=index->count+1;
+	return index->count++;
 }
 
 /*************************************************
-Function: ResultSet getresult(int n) ;
-Description: get all the mappings for the stack tree of the related thread, then merged them into one final mapping. 
-Called By: int main(void);
-Input: n-total number for all the threads; 
-Return: the final mapping set
-*************************************************/
-ResultSet getresult(int n) 
-{
-	ResultSet final_set,set;
-	int i,j,k;
-	final_set.topbegin=0;
-	final_set.topend=0;
-    Node* start_node=start_root[n];
-    Node* end_node=finish_root[n];
-    final_set.begin=0;final_set.end=0;final_set.output=NULL;final_set.hasOutput=0;
-    int start=1;
-    Node* root=start_root[0];
-    set.begin=start;
-    Node* node;
-    for(i=0;i<=n;i++)
-    {
-    	set.begin=start;set.end=0;set.output=NULL;set.hasOutput=0;
-    	set.topbegin=0;set.topend=0;
-    	node=start_root[i]->children[start];   //the first child for the root
-		j=0;
-		//deal with the start tree
-		if((node==NULL)||(node!=NULL&&node->state>stateCount))
-		{
-			final_set.begin=-1;
-		    break;
-	    }
-		while(1)
+Function: long cached_size(long nodeCount, long childCount, long spanCount);
+Description: the bytes of a stack tree kept in the chunk cache, the children are padded to 8 bytes for the texts after them 
+and the whole tree to CACHE_ALIGN bytes, so the next tree in the cache file starts aligned as well
+Called By: void cache_part(int i); int load_tree(int i, char* blob, long size);
+Input: nodeCount, childCount, spanCount--the counts of the tree(see CachedTree)
+Return: the size of the tree kept
+*************************************************/
+long cached_size(long nodeCount, long childCount, long spanCount)
+{
+	long size=sizeof(CachedTree)+nodeCount*sizeof(CachedNode)+((childCount*sizeof(int)+7)&~7L)+spanCount*sizeof(SavedSpan);
+	return (size+CACHE_ALIGN-1)&~(long)(CACHE_ALIGN-1);
+}
+
+/*************************************************
+Function: void cache_part(int i);
+Description: keep the stack tree of a chunk just dealt with, so that the next run takes it if the chunk is the same(see load_tree). 
+The tree is the mapping of the chunk for every state it may start with, so it is kept as it is: the nodes reached from the two roots 
+are numbered and every pointer between them is kept as a number, and the texts are kept as offsets from the beginning of the chunk. 
+The lexer state where the chunk stops is kept too, the merge needs it to know whether the next chunk starts between tokens(see resume_part).
+Called By: void main_task(int i);
+Input: i--the number of the chunk, it is also the slot of the stack tree
+*************************************************/
+void cache_part(int i)
+{
+	TreeIndex index;
+	CachedTree* tree;
+	CachedNode* saved;
+	SavedSpan* spans;
+	Span* span;
+	Node* node;
+	int* children;
+	char* blob;
+	long k,c,size,childCount=0,spanCount=0;
+	int ok=1;
+	memset(&index,0,sizeof(index));
+	tree_index(&index,ctx->start_root[i]);
+	tree_index(&index,ctx->finish_root[i]);
+	for(k=0;k<index.count;k++)   //the list grows as the nodes are found
+	{
+		node=index.nodes[k];
+		for(c=0;c<child_count(node);c++)
+		{
+			tree_index(&index,node->children[c]);
+		}
+		tree_index(&index,node->start_node);
+		tree_index(&index,node->finish_node);
+		tree_index(&index,node->parent);
+		childCount+=child_count(node);
+		for(span=node->output.head;span!=NULL;span=span->next,spanCount++)
 		{
-			for(j=0;j<=stateCount;j++)
+			if(span->offset<0||span->offset+span->len>ctx->buffLens[i]) ok=0;   //a text out of the chunk
+		}
+	}
+	size=cached_size(index.count,childCount,spanCount);
+	blob=(ok==1)?(char*)calloc(1,size):NULL;   //the padding is written as 0
+	if(blob!=NULL)
+	{
+		tree=(CachedTree*)blob;
+		tree->nodeCount=index.count;
+		tree->childCount=childCount;
+		tree->spanCount=spanCount;
+		tree->endState=ctx->endStates[i];
+		tree->treeStates=ctx->treeStates[i];
+		tree->treeBelow=ctx->treeBelow[i];
+		tree->treeMissed=ctx->treeMissed[i];
+		saved=(CachedNode*)(tree+1);
+		children=(int*)(saved+index.count);
+		spans=(SavedSpan*)((char*)children+((childCount*sizeof(int)+7)&~7L));
+		childCount=0;
+		spanCount=0;
+		for(k=0;k<index.count;k++)
+		{
+			node=index.nodes[k];
+			memset(&saved[k],0,sizeof(CachedNode));
+			saved[k].childMask=node->childMask;
+			saved[k].state=node->state;
+			saved[k].isLeaf=node->isLeaf;
+			saved[k].hasOutput=node->hasOutput;
+			saved[k].start=tree_index(&index,node->start_node);
+			saved[k].finish=tree_index(&index,node->finish_node);
+			saved[k].parent=tree_index(&index,node->parent);
+			saved[k].firstSpan=spanCount;
+			for(c=0;c<child_count(node);c++)
 			{
-				if(node->children[j]!=NULL)
-				{
-			    	node=node->children[j];
-			    	set.begin_stack[set.topbegin++]=node->state;
-				    break;
-			    }
+				children[childCount++]=tree_index(&index,node->children[c]);
 			}
-			if(j>stateCount)
+			for(span=node->output.head;span!=NULL;span=span->next,spanCount++)
 			{
-				break;
+				spans[spanCount].offset=span->offset;
+				spans[spanCount].len=span->len;
+				spans[spanCount].state=span->state;
 			}
+			saved[k].spanCount=spanCount-saved[k].firstSpan;
 		}
-		//deal with final tree
-		node=node->finish_node;
-		if(node!=NULL&&node->state!=-1)
+	}
+	free(index.nodes);
+	free(index.table);
+	ctx->cacheBlobs[i]=blob;
+	ctx->cacheSizes[i]=(blob!=NULL)?size:0;
+}
+
+/*************************************************
+Function: int load_tree(int i, char* blob, long size);
+Description: rebuild the stack tree of a chunk kept in the cache(see cache_part) in the slot of the chunk, it is merged as if the chunk were dealt with
+Called By: int cache_lookup(int i);
+Input: i--the number of the chunk, its view has been located; blob--the tree kept; size--the size of the tree kept
+Return: 0--success; -1--the tree kept is broken, the chunk is dealt with as usual
+*************************************************/
+int load_tree(int i, char* blob, long size)
+{
+	CachedTree* tree=(CachedTree*)blob;
+	CachedNode* saved=(CachedNode*)(tree+1);
+	SavedSpan* spans;
+	Node** nodes;
+	Node* node;
+	int* children;
+	long k,c,childCount=0,count;
+	int ok;
+	ok=size>=(long)sizeof(CachedTree)&&tree->nodeCount>=2&&tree->childCount>=0&&tree->spanCount>=0&&tree->endState>=0&&tree->endState<XML_STATES
+		&&tree->treeStates>0&&tree->treeStates<=ctx->dfa.stateCount+1&&(tree->treeMissed==0||tree->treeMissed==1)&&size==cached_size(tree->nodeCount,tree->childCount,tree->spanCount);
+	if(!ok) return -1;
+	count=tree->nodeCount;
+	children=(int*)(saved+count);
+	spans=(SavedSpan*)((char*)children+((tree->childCount*sizeof(int)+7)&~7L));
+	nodes=(Node**)malloc(count*sizeof(Node*));
+	for(k=0;k<count;k++)
+	{
+		nodes[k]=node_alloc(i);
+	}
+	for(k=0;ok&&k<count;k++)
+	{
+		node=nodes[k];
+		node->childMask=saved[k].childMask;
+		node->state=saved[k].state;
+		node->isLeaf=saved[k].isLeaf;
+		node->hasOutput=saved[k].hasOutput;
+		ok=saved[k].start<count&&saved[k].finish<count&&saved[k].parent<count&&childCount+child_count(node)<=tree->childCount&&node->state<=ctx->dfa.stateCount
+			&&saved[k].firstSpan>=0&&saved[k].spanCount>=0&&saved[k].firstSpan+saved[k].spanCount<=tree->spanCount;
+		if(!ok) break;
+		node->start_node=(saved[k].start>=0)?nodes[saved[k].start]:NULL;
+		node->finish_node=(saved[k].finish>=0)?nodes[saved[k].finish]:NULL;
+		node->parent=(saved[k].parent>=0)?nodes[saved[k].parent]:NULL;
+		node->childCap=child_count(node);
+		if(node->childCap>0) node->children=children_alloc(i,node->childCap);
+		for(c=0;ok&&c<node->childCap;c++,childCount++)
 		{
-			set.end_stack[set.topend++]=node->state;
+			ok=children[childCount]>=0&&children[childCount]<count;
+			if(ok) node->children[c]=nodes[children[childCount]];
 		}
-		while(node!=NULL&&node->parent!=NULL&&node->parent->state!=-1)
+		for(c=saved[k].firstSpan;c<saved[k].firstSpan+saved[k].spanCount;c++)
 		{
-			node=node->parent;
-			set.end_stack[set.topend++]=node->state;
+			span_add(&node->output,i,spans[c].offset,spans[c].len,spans[c].state);
 		}
-		set.end=set.end_stack[set.topend-1];
-		if(node->hasOutput==1&&node->output!=NULL)
+	}
+	if(ok)
+	{
+		ctx->start_root[i]=nodes[0];
+		ctx->finish_root[i]=nodes[1];
+		ctx->overrunLimit[i]=NULL;
+		ctx->spanBase[i]=ctx->buffFiles[i];
+		ctx->slotLens[i]=ctx->buffLens[i];
+		ctx->endStates[i]=(int)tree->endState;
+		ctx->treeStates[i]=tree->treeStates;
+		ctx->treeBelow[i]=tree->treeBelow;
+		ctx->treeMissed[i]=tree->treeMissed;
+	}
+	else arena_reset(i);   //the nodes carved so far are given back
+	free(nodes);
+	return ok?0:-1;
+}
+
+/*************************************************
+Function: int load_cache(const char* cache_name);
+Description: load the chunk cache saved by a former run of the same query, a cache of another query is not taken. 
+The whole cache is loaded, as every chunk looks into it, and the states of the automata saved with it are taken before any chunk is dealt with(see dfa_restore).
+Called By: RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Input: cache_name--the name for the cache file
+Return: 0--the cache is loaded; -1--there is no cache for this query, every chunk is dealt with
+*************************************************/
+int load_cache(const char* cache_name)
+{
+	CacheHead* head;
+	FILE* fp=fopen(cache_name,"rb");
+	long size,k,states;
+	if(fp==NULL) return -1;
+	fseek(fp,0,SEEK_END);
+	size=ftell(fp);
+	rewind(fp);
+	ctx->cacheData=(char*)malloc(size+1);
+	size=(long)fread(ctx->cacheData,1,size,fp);
+	fclose(fp);
+	head=(CacheHead*)ctx->cacheData;
+	states=(size<(long)sizeof(CacheHead))?0:head->stateCount*(long)sizeof(SavedState);
+	if(size<(long)sizeof(CacheHead)||memcmp(head->magic,CACHE_MAGIC,sizeof(CACHE_MAGIC))!=0||head->query!=ctx->query->fingerprint
+		||head->stateCount<=0||head->stateCount>=MAX_STATE||head->queryCount!=ctx->query->queryCount||head->entryCount<0||head->dataSize<0
+		||size!=(long)sizeof(CacheHead)+states+head->entryCount*(long)sizeof(CacheEntry)+head->dataSize
+		||dfa_restore((SavedState*)(ctx->cacheData+sizeof(CacheHead)),head->stateCount)==-1)
+	{
+		free(ctx->cacheData);   //not a cache, or saved for another query
+		ctx->cacheData=NULL;
+		return -1;
+	}
+	ctx->cacheEntries=(CacheEntry*)(ctx->cacheData+sizeof(CacheHead)+states);
+	ctx->cacheEntryCount=head->entryCount;
+	for(k=0;k<head->entryCount;k++)
+	{
+		if(ctx->cacheEntries[k].offset<0||ctx->cacheEntries[k].size<0||ctx->cacheEntries[k].offset+ctx->cacheEntries[k].size>head->dataSize
+			||ctx->cacheEntries[k].offset%CACHE_ALIGN!=0)
 		{
-			set.output=(char*)malloc((strlen(node->output)+1)*sizeof(char));
-			set.output=strcpy(set.output,node->output);
-			set.hasOutput=1;
+			ctx->cacheEntryCount=0;   //a broken cache, nothing is taken from it
+			break;
 		}
-		set.topend--;
-		//merge finalset&set
-	    if(i>0&&final_set.end!=set.begin)
-	    {
-		    final_set.begin=-1;
-		    break;
-	    }
-	    else{
-		
-	        if(set.hasOutput==1)
-	        {
-		        if(final_set.output==NULL)  {
-			        final_set.output=(char*)malloc(MAX_OUTPUT*sizeof(char));
-			        memset(final_set.output,0,sizeof(final_set.output));
-		        }
-		        if(i>0){
-		        	final_set.output=strcat(final_set.output," ");
-				}  
-		        final_set.output=strcat(final_set.output,set.output);
-		        final_set.hasOutput=1;
-	        }
-	        final_set.end=set.end;
-	        if(i==0)
-	        {
-		        final_set.begin=set.begin;
-		        for(k=0;k<set.topbegin;k++)
-		        {
-			        final_set.begin_stack[final_set.topbegin++]=set.begin_stack[k];
-		        }
-		        for(k=0;k<set.topend;k++)
-		        {
-			        final_set.end_stack[final_set.topend++]=set.end_stack[k];
-		        }
-            }
-            else{
-	            int equal_flag=0;
-	            if(final_set.topend==set.topbegin)
-	            {
-		            for(k=0;k<set.topbegin;k++)
-		            {
-			            if(final_set.end_stack[set.topbegin-k-1]!=set.begin_stack[k])
-			            {
-				            equal_flag=1;
-				            break;
-			            }
-		            }
-	            }
-                if(equal_flag==0)
-                {
-                	final_set.topend=set.topend;         //end_stack is equal to the current set
-	            	for(k=0;k<set.topend;k++)
-    	            {
-    		            final_set.end_stack[k]=set.end_stack[k];  
-		            }
-	            }
-	            else
-	            {
-	            	for(k=0;k<set.topend;k++)
-    	            {
-    		            final_set.end_stack[final_set.topend++]=set.end_stack[k];  //merge
-		            }
-				}
-            }
-
-            start=final_set.end;
-    	}
+		ctx->cacheEntries[k].offset+=sizeof(CacheHead)+states+head->entryCount*sizeof(CacheEntry);   //the offsets into the data are turned into offsets into cacheData
 	}
-	return final_set;
+	return 0;
 }
 
 /*************************************************
-Function: void print_result(ResultSet set);
-Description: print the result mapping set. 
-Called By: int main(void);
-Input: set-result mapping set; 
+Function: int save_cache(const char* cache_name);
+Description: save the stack trees of the chunks of the run for the next run, those taken from the cache and those just dealt with. 
+The entries are sorted by their keys so that the next run finds them by bsearch. The cache is written into a temporary file first and renamed at last.
+Called By: RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Input: cache_name--the name for the cache file
+Return: 0--success; -1--the cache could not be written
 *************************************************/
-void print_result(ResultSet set)
+int save_cache(const char* cache_name)
 {
-	if(set.begin==-1)
+	CacheHead head;
+	SavedState states[MAX_STATE];
+	CacheEntry* entries=(CacheEntry*)malloc((ctx->chunkCount+1)*sizeof(CacheEntry));
+	char* temp=(char*)malloc(strlen(cache_name)+5);
+	char* blob;
+	FILE* fp;
+	long count=0,data=0;
+	int i,ok;
+	for(i=0;i<ctx->chunkCount;i++)
 	{
-		printf("The mapping for this part is null, please check the XPath command.\n");
-		return;
+		if(ctx->cacheHits[i]==NULL&&ctx->cacheBlobs[i]==NULL) continue;   //not kept, it is dealt with again next time
+		entries[count].key=ctx->cacheKeys[i];
+		entries[count].len=ctx->buffLens[i];
+		entries[count].offset=data;
+		entries[count].size=ctx->cacheSizes[i];
+		data+=ctx->cacheSizes[i];
+		count++;
+	}
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,CACHE_MAGIC,sizeof(CACHE_MAGIC));
+	head.query=ctx->query->fingerprint;
+	head.stateCount=dfa_save(states);
+	head.queryCount=ctx->query->queryCount;
+	head.entryCount=count;
+	head.dataSize=data;
+	sprintf(temp,"%s.tmp",cache_name);
+	fp=fopen(temp,"wb");
+	ok=(fp!=NULL);
+	if(ok)
+	{
+		ok=fwrite(&head,sizeof(head),1,fp)==1&&fwrite(states,sizeof(SavedState),head.stateCount,fp)==(size_t)head.stateCount;
+		/*the data is written in the order of the chunks, the entries point into it in the order of the keys*/
+		qsort(entries,count,sizeof(CacheEntry),cache_entry_compare);
+		if(ok&&count>0) ok=fwrite(entries,sizeof(CacheEntry),count,fp)==(size_t)count;
+		for(i=0;ok&&i<ctx->chunkCount;i++)
+		{
+			blob=(ctx->cacheHits[i]!=NULL)?ctx->cacheHits[i]:ctx->cacheBlobs[i];
+			if(blob!=NULL&&ctx->cacheSizes[i]>0) ok=fwrite(blob,1,ctx->cacheSizes[i],fp)==(size_t)ctx->cacheSizes[i];
+		}
+		ok=(fclose(fp)==0)&&ok;
 	}
+	remove(cache_name);   //rename does not replace a file on windows
+	if(ok) ok=(rename(temp,cache_name)==0);
+	if(!ok) remove(temp);
+	free(temp);
+	free(entries);
+	return ok?0:-1;
+}
+
+/*************************************************
+Function: void free_cache();
+Description: release the chunk cache of the run, the cache loaded and the stack trees kept for each chunk
+Called By: void xml_free_run(RunContext* run);
+*************************************************/
+void free_cache()
+{
 	int i;
-	printf("The mapping for this part is: %d,  ",set.begin);
-	for(i=0;i<set.topbegin;i++)  
+	if(ctx->cacheBlobs!=NULL)
 	{
-		printf("%d:",set.begin_stack[i]);
+		for(i=0;i<ctx->chunkCount;i++)
+		{
+			free(ctx->cacheBlobs[i]);
+		}
 	}
-    printf(",  ");
-	printf("%d,  ",set.end);
-	for(i=set.topend-1;i>=0;i--)
+	free(ctx->cacheData);
+	free(ctx->cacheCuts);
+	free(ctx->cacheKeys);
+	free(ctx->cacheHits);
+	free(ctx->cacheBlobs);
+	free(ctx->cacheSizes);
+	ctx->cacheData=NULL;
+	ctx->cacheEntries=NULL;
+	ctx->cacheEntryCount=0;
+	ctx->cacheCuts=NULL;
+	ctx->cacheKeys=NULL;
+	ctx->cacheHits=NULL;
+	ctx->cacheBlobs=NULL;
+	ctx->cacheSizes=NULL;
+}
+
+/*************************************************
+Function: RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name);
+Description: run a query over an XML file with the parallel version with mmap input, keeping the stack trees of its chunks in a cache file. 
+The chunks are cut where the bytes around them say(see cut_cached), so after a few edits most of the chunks are the same bytes as before, 
+and a chunk whose bytes and query are the same as in the former run takes its tree from the cache instead of being dealt with(see cache_lookup). 
+The trees are merged with the other parts as usual, and the cache is saved again for the next run.
+Called By: int main(void); the programs using the library
+Input: query--the compiled query; file_name--the name for the xml file; cache_name--the name for the cache file, it is created by the first run
+Return: the run holding the result; NULL--can't open the XML file or the arguments are wrong
+*************************************************/
+RunContext* xml_run_cached(Query* query, const char* file_name, const char* cache_name)
+{
+	RunContext* saved=ctx;
+	RunContext* run;
+	char* name=(char*)file_name;
+	int n;
+	if(query==NULL||file_name==NULL||cache_name==NULL) return NULL;
+	run=run_create(query,2);
+	if(run==NULL) return NULL;
+	ctx=run;
+	if(open_mapping(name)==-1)
 	{
-		printf("%d:",set.end_stack[i]);
+		ctx=saved;
+		xml_free_run(run);
+		return NULL;
 	}
-	printf(",  ");
-	if(set.output!=NULL)  printf("%s\n",set.output);
-	else printf("null");
+	n=cut_cached();
+	ctx->cacheKeys=(unsigned long long*)calloc(n+1,sizeof(unsigned long long));
+	ctx->cacheHits=(char**)calloc(n+1,sizeof(char*));
+	ctx->cacheBlobs=(char**)calloc(n+1,sizeof(char*));
+	ctx->cacheSizes=(long*)calloc(n+1,sizeof(long));
+	load_cache(cache_name);
+	if(run_chunks(n,name,0)==-1)
+	{
+		ctx=saved;
+		xml_free_run(run);
+		return NULL;
+	}
+	if(ctx->status==0) save_cache(cache_name);
+	ctx=saved;
+	return run;
 }
 
 /*************************************************
-Function: void *main_thread(void *arg);
-Description: main function for each thread. 
-Called By: int main(void);
-Input: arg--the number of this thread; 
+Function: RunContext* xml_run_buffer(Query* query, const char* buff, long len, int mode);
+Description: run a query over an XML text in memory, the text is cut into views without being copied or written, so it must be kept until the run is freed
+Called By: the programs using the library
+Input: query--the compiled query; buff--the XML text, it needs no '\0'; len--the length of the text; 
+mode--the version(2--parallel version, 4--parallel version with speculative lexing, 5--parallel version with structural index)
+Return: the run holding the result; NULL--the text is empty or the arguments are wrong
 *************************************************/
-void *main_thread(void *arg)
+RunContext* xml_run_buffer(Query* query, const char* buff, long len, int mode)
 {
-	int i=(int)(*((int*)arg));
-	printf("start to deal with thread %d.\n",i);
-	int ret = 0;
-    xml_Text xml;
-    xml_Token token;               
-    int multiExp = 0; //0--single line explanation 1-- multiline explanation
-    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
-    
-    int j;
-    if(i==0) 
+	RunContext* saved=ctx;
+	RunContext* run;
+	int n;
+	if(query==NULL||(mode!=2&&mode!=4&&mode!=5)) return NULL;
+	run=run_create(query,mode);
+	if(run==NULL) return NULL;
+	ctx=run;
+	n=map_buffer((char*)buff,len);
+	if(mode==4) ctx->speculative=1;
+	if(n==-1||run_chunks(n,NULL,0)==-1)
 	{
-		createTree_first(1);
+		ctx=saved;
+		xml_free_run(run);
+		return NULL;
 	}
-    else {
-    	createTree(i);
+	ctx=saved;
+	return run;
+}
+
+/*************************************************
+Function: int xml_run_status(RunContext* run);
+Description: tell whether a run has found the mapping
+Called By: the programs using the library
+Input: run--the run
+Return: 0--the mapping is found; -1--the XML file is wrong, the mappings could not be merged or the run needs more states than the stack trees hold
+*************************************************/
+int xml_run_status(RunContext* run)
+{
+	return run->status;
+}
+
+/*************************************************
+Function: int run_text(RunContext* run, long k, const char** text, long* len);
+Description: find the k-th text of the result of a run, the texts copied by flush_result come before the ones not copied yet
+Called By: int xml_next_result(RunContext* run, const char** text, long* len); int xml_next_query_result(RunContext* run, int query_id, const char** text, long* len);
+Input: run--the run; k--the number of the text(start with 0)
+Output: text--the text; len--the length of the text
+Return: the state the text is found in; 0--there is no such text
+*************************************************/
+int run_text(RunContext* run, long k, const char** text, long* len)
+{
+	ResultSet* set=&run->result;
+	long from;
+	if(k<set->outputTexts)
+	{
+		from=(k==0)?0:set->outputEnds[k-1]+1;   //the texts copied by flush_result are separated by a blank
+		*text=set->output+from;
+		*len=set->outputEnds[k]-from;
+		return set->outputStates[k];
 	}
-    finish_root[i]->state=-1;
-    start_root[i]->state=-1;
-    printf("Tree has been created for thread %d.\n",i);
-    /*printf("The initial stack tree for the thread %d is shown as follows.\n",i);
-	printf("For the start tree\n");
-	print_tree(start_root[i],0);
-    printf("For the finish tree\n");
-    print_tree(finish_root[i],0);*/
-    //printf("The results for thread %d are listed as follows:\n",i);
-    xml_initText(&xml,buffFiles[i]);
-    xml_initToken(&token, &xml);
-    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);
-    free(buffFiles[i]);
-    if(ret==-1)
-    {
-    	printf("There is something wrong with your XML format, please check it!\n");
-    	printf("finish dealing with thread %d.\n",i);
-    	return NULL;
+	if(k-set->outputTexts<set->spanCount)
+	{
+		*text=set->spans[k-set->outputTexts].p;
+		*len=set->spans[k-set->outputTexts].len;
+		return set->spans[k-set->outputTexts].state;
 	}
-    
-    /*printf("The final stack tree for the thread %d is shown as follows.\n",i);
-	printf("For the start tree\n");
-	print_tree(start_root[i],0);
-    printf("For the finish tree\n");
-    print_tree(finish_root[i],0);*/
-    finish_args[i]=1;
-    printf("finish dealing with thread %d.\n",i);
-	return NULL;
+	return 0;
 }
 
 /*************************************************
-Function: void thread_wait(int n);
-Description: waiting for all the threads finish their tasks. 
-Called By: int main(void);
-Input: n--the number of all threads; 
+Function: int xml_next_result(RunContext* run, const char** text, long* len);
+Description: give the texts of the result one by one in the order of the input, the texts of all the XPaths of the query are given. 
+A text is not '\0' terminated, and it stays valid until the run is freed.
+Called By: the programs using the library
+Input: run--the run
+Output: text--the next text; len--the length of the text
+Return: 1--a text is given; 0--there is no more text
 *************************************************/
-void thread_wait(int n)
+int xml_next_result(RunContext* run, const char** text, long* len)
 {
-	int t;
-	while(1){
-		for( t = 0; t <= n; t++)
-	    {
-	    	if(finish_args[t]==0)
-	    	{
-	    		break;
-			}
-	    }
-	    if(t>n) break;
-	   usleep(10000);
-	}   
+	if(run->status==-1||run_text(run,run->nextText,text,len)==0) return 0;
+	run->nextText++;
+	return 1;
 }
 
 /*************************************************
-Function: void main_function();
-Description: main function for sequential version. 
-Called By: int main(void);
+Function: int xml_next_query_result(RunContext* run, int query_id, const char** text, long* len);
+Description: give the texts of one XPath of the query one by one in the order of the input, an XPath takes the texts found in the state of its last step. 
+A text taken by several XPaths is given to each of them, and every XPath is read at its own pace. An XPath in an aggregate function gives no text.
+Called By: int main(void); the programs using the library
+Input: run--the run; query_id--the place of the XPath in the query(start with 0)
+Output: text--the next text; len--the length of the text
+Return: 1--a text is given; 0--there is no more text
 *************************************************/
-void main_function()
+int xml_next_query_result(RunContext* run, int query_id, const char** text, long* len)
 {
-	printf("begin dealing with the state tree.\n");
-	int ret = 0;
-    xml_Text xml;
-    xml_Token token;               
-    int multiExp = 0; //0--single line explanation 1-- multiline explanation
-    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
-    int i=0;
-    int j;
-    if(i==0) 
+	Query* query=run->query;
+	int state;
+	if(run->status==-1||query_id<0||query_id>=query->queryCount) return 0;
+	if((query->aggregateMask>>query_id&1)==1) return 0;   //an aggregate function gives no text, even if its state is shared with an XPath without one
+	if(run->queryNext==NULL)
 	{
-		createTree_first(1);
+		run->queryNext=(long*)calloc(query->queryCount,sizeof(long));
+		if(run->queryNext==NULL) return 0;
 	}
-    else {
-    	createTree(i);
+	while((state=run_text(run,run->queryNext[query_id],text,len))!=0)
+	{
+		run->queryNext[query_id]++;
+		if((run->dfa.stateQueries[state]>>query_id&1)==1) return 1;
 	}
-    finish_root[i]->state=-1;
-    start_root[i]->state=-1;
-    printf("Tree has been created.\n");
-    /*printf("The initial stack tree is shown as follows.\n");
-	printf("For the start tree\n");
-	print_tree(start_root[i],0);
-    printf("For the finish tree\n");
-    print_tree(finish_root[i],0);
-    printf("The results are listed as follows:\n");*/
-    xml_initText(&xml,buffFiles[i]);
-    xml_initToken(&token, &xml);
-    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);
-    free(buffFiles[i]);
-    if(ret==-1)
-    {
-    	printf("There is something wrong with your XML format, please check it!\n");
-    	printf("finish dealing with the state tree.\n");
-    	return;
+	return 0;
+}
+
+/*************************************************
+Function: int xml_query_aggregate(RunContext* run, int query_id, double* value);
+Description: give the value of the aggregate function around one XPath of the query(see parse_aggregate), such an XPath gives no text. 
+sum() is 0 if the XPath takes no number, while min() and max() have no value then.
+Called By: int main(void); the programs using the library
+Input: run--the run; query_id--the place of the XPath in the query(start with 0)
+Output: value--the value of the function
+Return: 1--the value is given; 0--the XPath has no aggregate function, or min() or max() takes no number
+*************************************************/
+int xml_query_aggregate(RunContext* run, int query_id, double* value)
+{
+	Query* query=run->query;
+	Aggregate none={0,0,0,0,0};
+	Aggregate* agg;
+	if(run->status==-1||query_id<0||query_id>=query->queryCount||query->aggregates[query_id]==AGG_NONE) return 0;
+	agg=(run->result.aggs!=NULL)?&run->result.aggs[query_id]:&none;
+	switch(query->aggregates[query_id])
+	{
+		case AGG_COUNT:
+			*value=(double)agg->count;
+			return 1;
+		case AGG_SUM:
+			*value=agg->sum;
+			return 1;
+		case AGG_MIN:
+			*value=agg->min;
+			return agg->numbers>0;
+		default:
+			*value=agg->max;
+			return agg->numbers>0;
 	}
-    /*printf("The final stack tree is shown as follows.\n");
-	printf("For the start tree\n");
-	print_tree(start_root[i],0);
-    printf("For the finish tree\n");
-    print_tree(finish_root[i],0);*/
-    finish_args[i]=1;
-    printf("finish dealing with the state tree.\n");
+}
+
+/*************************************************
+Function: void free_chunks();
+Description: free everything allocated by alloc_chunks for the current run, with the arenas of the slots
+Called By: void xml_free_run(RunContext* run);
+*************************************************/
+void free_chunks()
+{
+	int i;
+	for(i=0;i<ctx->slotCount;i++)
+	{
+		arena_free(i);
+	}
+	for(i=0;i<ctx->chunkCount;i++)
+	{
+		if(ctx->partMaps[i].set.spans!=NULL) free(ctx->partMaps[i].set.spans);
+		free(ctx->partMaps[i].set.aggs);
+	}
+	free(ctx->chunkStatus);
+	free(ctx->buffFiles);
+	free(ctx->buffLens);
+	free(ctx->specRuns);
+	free(ctx->partSlot);
+	free(ctx->partBegin);
+	free(ctx->partMaps);
+	free(ctx->overrunLimit);
+	free(ctx->overrunEnd);
+	free(ctx->endStates);
+	free(ctx->start_root);
+	free(ctx->finish_root);
+	free(ctx->arenas);
+	free(ctx->spanBase);
+	free(ctx->slotLens);
+	free(ctx->treeStates);
+	free(ctx->treeBelow);
+	free(ctx->treeMissed);
+	free(ctx->treeExact);
+	free(ctx->multiExpContent);
+	free(ctx->multiCDATAContent);
+	ctx->chunkCount=0;
+	ctx->slotCount=0;
+}
+
+/*************************************************
+Function: void xml_free_run(RunContext* run);
+Description: free a run with its result, the parts of the file and the mapping
+Called By: int main(void); the programs using the library
+Input: run--the run
+*************************************************/
+void xml_free_run(RunContext* run)
+{
+	RunContext* saved=ctx;
+	if(run==NULL) return;
+	ctx=run;
+	release_parts();    //the texts of the mapping point into the parts, so they are kept until the run is freed
+	unmap_file();
+	free_cache();
+	free_chunks();
+	free(run->result.output);
+	free(run->result.outputEnds);
+	free(run->result.outputStates);
+	free(run->result.spans);
+	free(run->result.aggs);
+	free_sidecar();
+	free(run->structIndex);
+	free(run->indexStack);
+	free(run->queryNext);
+	pthread_mutex_destroy(&run->mergeLock);
+	pthread_mutex_destroy(&run->dfaLock);
+	ctx=(saved==run)?NULL:saved;
+	free(run);
 }
 
 /*********************************************************************************************/
+#ifndef XML_PARALLEL_LIBRARY
 int main(void)
 {
 	struct timeval begin,end;
 	double duration;
-    int ret = 0;
     char* file_name=malloc(MAX_SIZE*sizeof(char));
     file_name=strcpy(file_name,"test.xml");
     char * xpath_name=malloc(MAX_SIZE*sizeof(char));
     xpath_name=strcpy(xpath_name,"XPath.txt");
+    xmlVerbose=1;   //the program shows the progress of the chunks
     printf("Welcome to the XML lexer program! Your file name is test.xml\n\n");
     int choose=0;
-    printf("please choose the version for this program (0--sequential version, 1--parallel version)\n");
+    printf("please choose the version for this program (0--sequential version, 1--parallel version, 2--parallel version with mmap input, 3--streaming version for large files, 4--parallel version with speculative lexing, 5--parallel version with structural index, 6--build the sidecar index of the file for version 5, 7--parallel version with mmap input, going on from test.xml.state for a file which only grows, 8--parallel version with mmap input, taking the chunks not changed since the last run from test.xml.cache)\n");
     scanf("%d",&choose);
-    if(choose!=0&&choose!=1)
+    if(choose<0||choose>8)
     {
     	printf("You just input the wrong number, please check it again!\n");
     	exit(1);
 	}
 
-    int n;
-    if(choose==1)
+    int n=-1;
+    long window_size=0;
+    if(choose>=1)
 	{
-		printf("please input the number-of-threads for this program (no less than 1 and no more than 10)\n");
+		printf("please input the number-of-threads for this program (0 for the number of CPUs)\n");
         scanf("%d",&n);
-        if((n<1)||(n>10))
+        if(n<0)
         {
     	    printf("You just input the wrong number, please check it again!\n");
     	    exit(1);
 	    }
 	}
-    printf("begin to split the file\n");
-    gettimeofday(&begin,NULL);
-    if(choose==0){
-    	n=load_file(file_name);    //load file into memory
+    if(choose==3)
+	{
+		printf("please input the window size (KB) for the streaming version\n");
+        scanf("%ld",&window_size);
+        if(window_size<1)
+        {
+    	    printf("You just input the wrong number, please check it again!\n");
+    	    exit(1);
+	    }
+	    window_size*=1024;
 	}
-    else n=split_file(file_name,n);    //split file into several parts
-    printf("finish cutting the file!\n");
-    gettimeofday(&end,NULL);   
-    duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
-    printf("The duration for spliting the file is %lf\n",duration/1000000);
-    sleep(1);
-        
-    if(n==-1)
-    {
-    	printf("There are something wrong with the xml file, we can not load it. Please check whether it is placed in the right place.\n");
-    	exit(1);
+	if(xml_init(n)==-1) exit(EXIT_FAILURE);    //no worker for the sequential version
+	if(choose==6)
+	{
+		gettimeofday(&begin,NULL);
+		if(xml_build_index(file_name)==-1)    //the later runs of version 5 take the markups from it
+		{
+			printf("There is something wrong with the xml file, the sidecar index could not be built.\n");
+			exit(1);
+		}
+		gettimeofday(&end,NULL);
+		duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
+		printf("The sidecar index is written to %s%s in %lf seconds\n",file_name,SIDECAR_SUFFIX,duration/1000000);
+		xml_finish();
+		return 0;
 	}
 
-	printf("\nbegin to deal with XML file\n");
-	gettimeofday(&begin,NULL);
-	char* xmlPath="/company/develop/programmer";
-	xmlPath=ReadXPath(xpath_name);
+	char* xmlPath=ReadXPath(xpath_name);
 	if(strcmp(xmlPath,"error")==0)
 	{
 		printf("There is something wrong with the XPath file, we can not load it. Please check whether it is placed in the right place.\n");
     	exit(1);
 	}
-    createAutoMachine(xmlPath);     //create automata by xmlpath
+    Query* query=xml_compile(xmlPath);     //create automata by xmlpath, one XPath on each line
+    if(query==NULL)
+    {
+    	printf("There is no XPath or there are too many steps, symbols, tag names or XPaths in the XPath file, or a predicate or an aggregate function could not be parsed, please check it again!\n");
+    	exit(1);
+	}
     printf("The basic structure of the automata is (from to end):\n");
-    int i,rc;
+    int i,q,s,depth;
+    int chain[MAX_STATE];
     char *out=" is an output";
-    for(i=1;i<=machineCount;i=i+2)
+    for(q=0;q<xml_query_count(query);q++)
     {
-    	if(i==1){
-    		printf("%d",stateMachine[i].start);
+    	/*the states of an XPath, from the state of its last step up to the root*/
+    	for(s=2;s<=query->stepCount&&(query->stateMachine[2*s-2].queries>>q&1)==0;s++);
+    	for(depth=0;(query->rootSteps>>s&1)==0;s=query->stateMachine[2*s-2].end) chain[depth++]=s;
+    	for(i=depth-1;i>=0;i--)
+    	{
+    		if(i==depth-1){
+    			printf("%d",query->stateMachine[2*chain[i]-3].start);
+			}
+			printf(" (str:%s%s%s",(query->stateMachine[2*chain[i]-3].descendant==1)?"//":"",query->stateMachine[2*chain[i]-3].str,(query->stepFilters[chain[i]]!=NULL)?query->stepFilters[chain[i]]:"");
+			if(i==0)
+			{
+				printf("%s",out);
+			}
+			printf(") %d",query->stateMachine[2*chain[i]-3].end);
 		}
-		printf(" (str:%s",stateMachine[i].str);
-		if(stateMachine[i].isoutput==1)
+		printf("\n");
+		for(i=0;i<depth;i++)
 		{
-			printf("%s",out);
-		}
-		printf(") %d",stateMachine[i].end);
-	}
-	printf("\n");
-	for(i=machineCount;i>0;i=i-2)
-    {
-    	if(i==machineCount){
-    		printf("%d (str:%s) %d",stateMachine[i].start,stateMachine[i].str,stateMachine[i].end);
+			if(i==0){
+				printf("%d (str:%s) %d",query->stateMachine[2*chain[i]-2].start,query->stateMachine[2*chain[i]-2].str,query->stateMachine[2*chain[i]-2].end);
+			}
+			else
+			{
+				printf(" (str:%s) %d",query->stateMachine[2*chain[i]-2].str,query->stateMachine[2*chain[i]-2].end);
+			}
 		}
-		else
-		{
-			printf(" (str:%s) %d",stateMachine[i].str,stateMachine[i].end);
-		}	
-	}
-	printf("\n\n");
-	if(choose==0)
-	{
-		main_function();
+		printf("\n\n");
 	}
-	else
+
+	printf("\nbegin to deal with XML file\n");
+	gettimeofday(&begin,NULL);
+	RunContext* run;
+	if(choose==7) run=xml_run_append(query,file_name,"test.xml.state");    //deal with the bytes added since the last run only
+	else if(choose==8) run=xml_run_cached(query,file_name,"test.xml.cache");    //deal with the chunks changed since the last run only
+	else run=xml_run_file(query,file_name,choose,window_size);    //cut, deal with and merge the file
+	if(run==NULL)
 	{
-		for(i=0;i<=n;i++)
-        {
-    	    thread_args[i]=i;
-    	    finish_args[i]=0;
-    	    rc=pthread_create(&thread[i], NULL, main_thread, &thread_args[i]);  //parallel xml processing
-    	    if (rc)
-            {
-                printf("ERROR; return code is %d\n", rc);
-                return EXIT_FAILURE;
-            }
-	    }
-	    thread_wait(n);
+		printf("There are something wrong with the xml file, we can not load it. Please check whether it is placed in the right place.\n");
+		exit(1);
 	}
 	printf("\nfinish dealing with the file\n");
 	gettimeofday(&end,NULL);
     duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
     printf("The duration for dealing with the file is %lf\n",duration/1000000);
     printf("\n");
-	printf("All the subthread ended, now the program is merging its results.\n");
-	printf("begin to merge results\n");
-	gettimeofday(&begin,NULL);
-	ResultSet set=getresult(n);
 	printf("The mappings for text.xml is:\n");
-	print_result(set);
-	printf("finish merging these results.\n");
-    gettimeofday(&end,NULL);
-    duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
-    printf("The duration for merging these results is %lf\n",duration/1000000);
+	print_result(&run->result);
+	if(xml_query_count(query)>1)
+	{
+		const char* text;
+		long len;
+		for(q=0;q<xml_query_count(query);q++)
+		{
+			if(query->aggregates[q]!=AGG_NONE) continue;   //it gives its value instead of its texts
+			printf("\nThe texts for XPath %d are:",q+1);    //each XPath takes its own texts out of the mapping
+			while(xml_next_query_result(run,q,&text,&len)==1)
+			{
+				printf(" %.*s",(int)len,text);
+			}
+		}
+		printf("\n");
+	}
+	for(q=0;q<xml_query_count(query);q++)
+	{
+		double value;
+		if(query->aggregates[q]==AGG_NONE) continue;
+		if(xml_query_aggregate(run,q,&value)==1) printf("The %s of XPath %d is: %.15g\n",aggregateNames[query->aggregates[q]],q+1,value);
+		else printf("The %s of XPath %d has no value\n",aggregateNames[query->aggregates[q]],q+1);
+	}
+	xml_free_run(run);
+	xml_free_query(query);
+	xml_finish();
     
     //system("pause");
     return 0;
 }
+#endif
@@ -0,0 +1,64 @@
+/************************************************************
+Copyright (C).
+FileName: XML_parallel.h
+Description: the library interface of XML_parallel.c. Compile XML_parallel.c with -DXML_PARALLEL_LIBRARY to leave out its main function. 
+xml_init starts the workers, a program which does not call it runs every query in the calling thread.
+A query is compiled once and could be run by any number of threads at once, each run keeps everything it changes in its own context.
+e.g.
+	xml_init(0);
+	XmlQuery* query=xml_compile("/company/develop/programmer");
+	XmlRun* run=xml_run_file(query,"test.xml",2,0);
+	while(run!=NULL&&xml_next_result(run,&text,&len)==1) { ... }
+Several XPaths compiled together, e.g. xml_compile("/company/develop/programmer|/company/test/tester"), are run in one pass, 
+and xml_next_query_result(run,id,&text,&len) gives the texts of each of them, the same texts it gives compiled alone. A step after // is taken at any depth, e.g. //develop//programmer.
+A step may be * for any tag name and may test the attributes of its tag, e.g. //programmer[@age="35"], /company/develop/programmer[@age] or //programmer[not(@age)].
+Only the elements are selected, an attribute step such as //programmer/@age is not compiled.
+A query holds at most 127 steps(63 where the compiler has no 128-bit integer) and 64 tag names. The states of its automata are built as the input 
+reaches them, each run builds its own, so many XPaths holding //, e.g. //develop//programmer|//sales//salesman|//test//tester|//team//programmer|//company//manager, 
+are compiled whatever their states could grow to. A run which reaches more than 127 states has no result, xml_run_status gives -1, split such a query into several.
+An XPath in count(), sum(), min() or max(), e.g. sum(//programmer/salary), gives no text, xml_query_aggregate(run,id,&value) gives the value.
+xml_run_file_limit(query,"test.xml",2,0,10) keeps the first 10 texts only and xml_exists_file(query,"test.xml",2,0) tells whether there is any text, 
+both stop the run as soon as the answer is known.
+xml_build_index("test.xml") writes the markups of a file into test.xml.idx, the later runs of mode 5 take them from there instead of lexing the file, 
+until the size or the modification time of the file changes.
+xml_run_append(query,"app.log","app.log.state") runs a query over a file which only grows, such as a log, and saves its state, 
+the next run deals with the bytes added since then only and gives the texts of the whole file.
+xml_run_cached(query,"test.xml","test.xml.cache") keeps the stack trees of the chunks in a cache, the next run of the same query deals only with 
+the chunks whose bytes have changed, e.g. after a few edits of the file.
+	xml_free_run(run);
+	xml_free_query(query);
+	xml_finish();
+***********************************************************/
+#ifndef XML_PARALLEL_H
+#define XML_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Query XmlQuery;   //a compiled XPath
+typedef struct RunContext XmlRun;   //one run of a query and its result
+
+int xml_init(int workers);  //start the workers shared by all the runs, 0 for the number of CPUs, -1 for none; return value: 0--success -1--error
+void xml_finish();  //stop the workers
+XmlQuery* xml_compile(const char* xpath);  //XPaths separated by '|' or new lines; return value: the query NULL--no XPath, out of memory, too many steps or tag names, a wrong predicate or a wrong aggregate function
+void xml_free_query(XmlQuery* query);
+int xml_query_count(XmlQuery* query);  //return value: the number of XPaths in the query
+XmlRun* xml_run_file(XmlQuery* query, const char* file_name, int mode, long window_size);  //mode 0 to 5 as the program asks, window_size in bytes for mode 3 only, 0 for 1 MB; return value: NULL--can't open the file
+XmlRun* xml_run_file_limit(XmlQuery* query, const char* file_name, int mode, long window_size, long limit);  //the first limit texts in the order of the file, 0 for all of them
+int xml_exists_file(XmlQuery* query, const char* file_name, int mode, long window_size);  //return value: 1--there is a text 0--no text -1--can't open the file or the XML text is wrong
+int xml_build_index(const char* file_name);  //write the sidecar index of a file for mode 5; return value: 0--success -1--can't open the file, the XML text is wrong or the index can't be written
+XmlRun* xml_run_append(XmlQuery* query, const char* file_name, const char* state_name);  //mode 2 going on from the state saved by the last run, the element still open at the end of the file is left to the next run; return value: NULL--can't open the file
+XmlRun* xml_run_cached(XmlQuery* query, const char* file_name, const char* cache_name);  //mode 2 taking the chunks not changed since the last run from the cache, which is saved again; return value: NULL--can't open the file
+XmlRun* xml_run_buffer(XmlQuery* query, const char* buff, long len, int mode);  //mode 2, 4 or 5, buff is kept by the caller until the run is freed
+int xml_run_status(XmlRun* run);  //return value: 0--the mapping is found -1--the XML text is wrong or the run needs more states than its automata holds
+int xml_next_result(XmlRun* run, const char** text, long* len);  //return value: 1--the next text is given 0--no more text
+int xml_next_query_result(XmlRun* run, int query_id, const char** text, long* len);  //the texts of the query_id-th XPath only; return value: 1--the next text is given 0--no more text
+int xml_query_aggregate(XmlRun* run, int query_id, double* value);  //the value of the aggregate function around the query_id-th XPath; return value: 1--the value is given 0--no function, or min()/max() of no number
+void xml_free_run(XmlRun* run);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif